@@ -0,0 +1,84 @@
+#include "canvas.h"
+#include "color.h"
+#include "light.h"
+#include "render.h"
+#include "scene.h"
+#include "sphere.h"
+#include "wavefront.h"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Ray trace random sphere fields of increasing size to show how the cost per ray scales with the
+// number of spheres. Without an acceleration structure the time per pixel grows linearly.
+namespace
+{
+  std::vector<cgfs::Sphere> random_spheres(size_t n)
+  {
+    auto rng = std::mt19937{1234};
+    // keep the density roughly constant so that the depth complexity stays the same
+    const auto half_width = 2 * std::cbrt(static_cast<float>(n));
+    auto xy = std::uniform_real_distribution<float>{-half_width, half_width};
+    auto z = std::uniform_real_distribution<float>{3, 3 + 2 * half_width};
+    auto radius = std::uniform_real_distribution<float>{0.2f, 0.8f};
+    const auto colors = std::array{cgfs::Palette1::Orange, cgfs::Palette1::Pink, cgfs::Palette1::Purple, cgfs::Palette1::Yellow};
+
+    auto spheres = std::vector<cgfs::Sphere>{};
+    spheres.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+      spheres.push_back({{xy(rng), xy(rng), z(rng)}, radius(rng), colors[i % colors.size()], 500, 0.2f});
+    return spheres;
+  }
+
+  double milliseconds_since(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+}
+
+int main()
+{
+  const auto extent = cgfs::Extent2D{256, 256};
+  const auto viewport = cgfs::Extent2D{1, 1};
+
+  // one thread, so that the packet render is comparable to the serial one
+  auto pool = cgfs::WorkStealingPool{1};
+
+  auto wavefront = cgfs::WavefrontRenderer{};
+
+  std::printf("%10s %12s %12s %14s %20s %15s\n", "spheres", "build [ms]", "render [ms]", "per pixel [us]", "16-ray packets [ms]", "wavefront [ms]");
+  for (size_t n = 100; n <= 1'000'000; n *= 10)
+  {
+    auto spheres = random_spheres(n);
+
+    const auto build_start = std::chrono::steady_clock::now();
+    const auto scene = cgfs::Scene{
+      std::move(spheres),
+      {
+        cgfs::AmbientLight{0.2f},
+        cgfs::PointLight{0.6f, {2, 1, 0}},
+        cgfs::DirectionalLight{0.2f, {1, 4, 4}}
+      }
+    };
+    const auto build_ms = milliseconds_since(build_start);
+
+    auto canvas = cgfs::Canvas{extent};
+    const auto render_start = std::chrono::steady_clock::now();
+    cgfs::render(scene, canvas, viewport);
+    const auto render_ms = milliseconds_since(render_start);
+
+    const auto packet_start = std::chrono::steady_clock::now();
+    cgfs::render(scene, canvas, viewport, pool, cgfs::RenderOptions{}.tile_size, 16);
+    const auto packet_ms = milliseconds_since(packet_start);
+
+    const auto wavefront_start = std::chrono::steady_clock::now();
+    wavefront.render(scene, canvas, viewport, pool);
+    const auto wavefront_ms = milliseconds_since(wavefront_start);
+
+    std::printf("%10zu %12.1f %12.1f %14.2f %20.1f %15.1f\n", n, build_ms, render_ms, 1000 * render_ms / (extent.width * extent.height), packet_ms, wavefront_ms);
+  }
+}
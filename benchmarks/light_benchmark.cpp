@@ -0,0 +1,157 @@
+#include "light.h"
+#include "position.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Compare the lighting of surface points with the lights of a scene stored as
+//  - the previous cgfs::Light: type erased, a virtual call per light and a heap allocation per copy
+//  - the current cgfs::Light: a std::variant, evaluated one by one
+//  - a cgfs::LightSet: the lights sorted by kind, each kind evaluated in a loop
+namespace legacy
+{
+  // cgfs::Light before it became a std::variant
+  class Light
+  {
+  public:
+    template <typename T>
+    Light(T t)
+    : m_light{std::make_unique<owner_t<T>>(std::move(t))}
+    {}
+
+    Light(const Light& other)
+    : m_light{other.m_light->clone()}
+    {}
+
+    Light& operator=(const Light& other)
+    {
+      Light copy{other};
+      m_light.swap(copy.m_light);
+      return *this;
+    }
+
+    Light(Light&&) = default;
+    Light& operator=(Light&&) = default;
+
+    ~Light() = default;
+
+    float intensity(const cgfs::SurfacePoint& sp, const cgfs::Vector3D& V = {}) const
+    {
+      return m_light->intensity2(sp, V);
+    }
+
+  private:
+    struct light_concept_t
+    {
+      virtual ~light_concept_t() = default;
+      virtual std::unique_ptr<light_concept_t> clone() const = 0;
+      virtual float intensity2(const cgfs::SurfacePoint& sp, const cgfs::Vector3D& V) const = 0;
+    };
+
+    template <typename Owned>
+    struct owner_t : public light_concept_t
+    {
+      Owned o;
+
+      owner_t(Owned o) : o{std::move(o)}{}
+
+      std::unique_ptr<light_concept_t> clone() const override
+      {
+        return std::make_unique<owner_t>(*this);
+      }
+
+      float intensity2(const cgfs::SurfacePoint& sp, const cgfs::Vector3D& V) const override
+      {
+        return o.intensity(sp, V);
+      }
+    };
+
+    std::unique_ptr<light_concept_t> m_light;
+  };
+}
+
+namespace
+{
+  double nanoseconds_since(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  template<typename Lights>
+  float sum(const Lights& lights, const cgfs::SurfacePoint& sp, const cgfs::Vector3D& V)
+  {
+    return std::accumulate(lights.begin(), lights.end(), 0.0f, [&](float acc, const auto& light){ return acc + light.intensity(sp, V); });
+  }
+
+  // the time per surface point of lighting all of the points, and the total (so that the work isn't optimized away)
+  template<typename F>
+  std::pair<double, float> time_per_point(const std::vector<cgfs::SurfacePoint>& points, F&& lighting)
+  {
+    const auto V = cgfs::Vector3D{0, 0, -1};
+    auto total = 0.0f;
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto& sp : points)
+      total += lighting(sp, V);
+    return {nanoseconds_since(start) / points.size(), total};
+  }
+}
+
+int main()
+{
+  auto rng = std::mt19937{1234};
+  auto coordinate = std::uniform_real_distribution<float>{-10, 10};
+  auto intensity = std::uniform_real_distribution<float>{0.05f, 0.2f};
+
+  auto points = std::vector<cgfs::SurfacePoint>{};
+  for (int i = 0; i < 100'000; ++i)
+    points.push_back({{coordinate(rng), coordinate(rng), coordinate(rng)}, {{coordinate(rng), coordinate(rng), coordinate(rng)}}, i % 2 ? 500 : -1});
+
+  std::printf("%8s %22s %22s %22s %18s %18s\n", "lights", "virtual [ns/point]", "variant [ns/point]", "LightSet [ns/point]", "copy virtual [ns]", "copy variant [ns]");
+  for (int n : {1, 4, 16, 64})
+  {
+    auto old_lights = std::vector<legacy::Light>{};
+    auto lights = std::vector<cgfs::Light>{};
+    old_lights.push_back(cgfs::AmbientLight{0.2f});
+    lights.push_back(cgfs::AmbientLight{0.2f});
+    for (int i = 1; i < n; ++i)
+    {
+      const auto I = intensity(rng);
+      const auto xyz = cgfs::Vector3D{coordinate(rng), coordinate(rng), coordinate(rng)};
+      if (i % 2)
+      {
+        old_lights.push_back(cgfs::PointLight{I, cgfs::Position3D{0, 0, 0} + xyz});
+        lights.push_back(cgfs::PointLight{I, cgfs::Position3D{0, 0, 0} + xyz});
+      }
+      else
+      {
+        old_lights.push_back(cgfs::DirectionalLight{I, xyz});
+        lights.push_back(cgfs::DirectionalLight{I, xyz});
+      }
+    }
+    const auto set = cgfs::LightSet{lights};
+
+    const auto [virtual_ns, virtual_total] = time_per_point(points, [&](const auto& sp, const auto& V){ return sum(old_lights, sp, V); });
+    const auto [variant_ns, variant_total] = time_per_point(points, [&](const auto& sp, const auto& V){ return sum(lights, sp, V); });
+    const auto [set_ns, set_total] = time_per_point(points, [&](const auto& sp, const auto& V){ return set.intensity(sp, V); });
+
+    constexpr int copies = 1000;
+    auto copy_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < copies; ++i)
+      [[maybe_unused]] volatile auto size = std::vector<legacy::Light>(old_lights).size();
+    const auto copy_virtual_ns = nanoseconds_since(copy_start) / copies;
+
+    copy_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < copies; ++i)
+      [[maybe_unused]] volatile auto size = std::vector<cgfs::Light>(lights).size();
+    const auto copy_variant_ns = nanoseconds_since(copy_start) / copies;
+
+    std::printf("%8d %22.1f %22.1f %22.1f %18.1f %18.1f\n", n, virtual_ns, variant_ns, set_ns, copy_virtual_ns, copy_variant_ns);
+    if (virtual_total != variant_total)
+      std::printf("the lighting differs: %f vs %f\n", virtual_total, variant_total);
+  }
+}
@@ -0,0 +1,390 @@
+#include "camera.h"
+#include "canvas.h"
+#include "color.h"
+#include "draw.h"
+#include "frustum.h"
+#include "halfspace.h"
+#include "instance.h"
+#include "light.h"
+#include "lod.h"
+#include "mesh.h"
+#include "projection.h"
+#include "render.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "triangle.h"
+#include "vertex_transform.h"
+
+#include "sp3/transform.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Draw random triangles of increasing size with the scanline and the half-space rasterizers, flat shaded
+// (Triangle3D) and Phong shaded (SuperTriangle3D), and report how many triangles per second each draws.
+// Then render a scene of overlapping icosahedra with render_scene(), serially and binned on a pool of threads,
+// with and without the hierarchical depth test, drawing the icosahedra from the nearest and from the farthest,
+// and with forward and deferred shading, drawing them from the farthest.
+// Then assemble the triangles of the scene by transforming the vertices of each face, and by gathering them from a VertexCache.
+// Then transform a large array of points one at a time with sp3::transform, and in batches with transform_points().
+// Then render a grid of icosahedra all around the camera, with and without frustum culling, and with a model for each
+// icosahedron or one model for all of them.
+// Last, list the front faces of a grid of spheres stretching away from the camera, with and without culling their meshlets
+// first, and render the spheres and their levels of detail.
+namespace
+{
+  constexpr int CANVAS_SIZE = 640;
+
+  // triangles whose projections are about 'size' pixels across, at depths in [4, 8]
+  std::vector<cgfs::SuperTriangle3D> random_triangles(size_t n, float size)
+  {
+    auto rng = std::mt19937{1234};
+    auto center = std::uniform_real_distribution<float>{-CANVAS_SIZE / 2 + size, CANVAS_SIZE / 2 - size};
+    auto offset = std::uniform_real_distribution<float>{-size / 2, size / 2};
+    auto depth = std::uniform_real_distribution<float>{4, 8};
+    const auto colors = std::array{cgfs::Palette1::Orange, cgfs::Palette1::Pink, cgfs::Palette1::Purple, cgfs::Palette1::Yellow};
+
+    auto triangles = std::vector<cgfs::SuperTriangle3D>{};
+    triangles.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      const auto cx = center(rng);
+      const auto cy = center(rng);
+      const auto z = depth(rng);
+      // from canvas back to camera coordinates, for a 1x1 viewport at distance 1
+      const auto unproject = [&](float x, float y){ return cgfs::Position3D{x * z / CANVAS_SIZE, y * z / CANVAS_SIZE, z}; };
+      triangles.push_back({
+        {{unproject(cx + offset(rng), cy + offset(rng)), unproject(cx + offset(rng), cy + offset(rng)), unproject(cx + offset(rng), cy + offset(rng))}},
+        {{cgfs::Vector3D{0, 0, -1}, cgfs::Vector3D{0.3f, 0, -1}, cgfs::Vector3D{0, 0.3f, -1}}},
+        colors[i % colors.size()]
+      });
+    }
+    return triangles;
+  }
+
+  // triangles per second
+  template<typename Draw>
+  double throughput(size_t n, Draw&& draw)
+  {
+    auto canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+      draw(canvas, i);
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return n / seconds;
+  }
+
+  double milliseconds_since(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // a grid of n x n icosahedra, at increasing depths so that they overlap
+  cgfs::MeshScene<cgfs::MultiNormalMesh> icosahedra_scene(int n)
+  {
+    auto scene = cgfs::MeshScene<cgfs::MultiNormalMesh>{{}, {cgfs::AmbientLight{0.2f}, cgfs::PointLight{0.6f, {-1, 1, 0}}, cgfs::DirectionalLight{0.2f, {0, 0, 1}}}};
+    for (int i = 0; i < n; ++i)
+      for (int j = 0; j < n; ++j)
+      {
+        const auto depth = 4.f + 0.5f * (i * n + j);
+        const auto x = (j - n / 2.f) * depth / n;
+        const auto y = (i - n / 2.f) * depth / n;
+        scene.instances.push_back({cgfs::solid_icosahedron(), sp3::transform{{x, y, depth}, {}, 0.4f * depth}});
+      }
+    return scene;
+  }
+
+  // a grid of n x n icosahedra on the ground around the camera, most of them out of view (none across the plane z = 0 of the
+  // camera, which would be projected to huge triangles), each with a model of its own or all sharing one
+  cgfs::MeshScene<cgfs::MultiNormalMesh> city_scene(int n, bool shared = false)
+  {
+    auto scene = cgfs::MeshScene<cgfs::MultiNormalMesh>{{}, {cgfs::AmbientLight{0.2f}, cgfs::PointLight{0.6f, {-1, 1, 0}}, cgfs::DirectionalLight{0.2f, {0, 0, 1}}}};
+    const auto icosahedron = cgfs::share(cgfs::solid_icosahedron());
+    for (int i = 0; i < n; ++i)
+      for (int j = 0; j < n; ++j)
+      {
+        const auto T = sp3::transform{{4.f * (j - n / 2) + 2, -2.f, 4.f * (i - n / 2) + 2}};
+        if (shared)
+          scene.instances.push_back({icosahedron, T});
+        else
+          scene.instances.push_back({cgfs::solid_icosahedron(), T});
+      }
+    return scene;
+  }
+
+  // a grid of n x n spheres in front of the camera, going farther and farther away
+  template<typename TModel>
+  cgfs::MeshScene<TModel> spheres_scene(int n, const TModel& sphere)
+  {
+    auto scene = cgfs::MeshScene<TModel>{{}, {cgfs::AmbientLight{0.2f}, cgfs::PointLight{0.6f, {-1, 1, 0}}, cgfs::DirectionalLight{0.2f, {0, 0, 1}}}};
+    const auto model = cgfs::share(sphere);
+    for (int i = 0; i < n; ++i)
+      for (int j = 0; j < n; ++j)
+        scene.instances.push_back({model, sp3::transform{{1.5f * (j - n / 2), -1.f, 3.f + 1.5f * i}}});
+    return scene;
+  }
+}
+
+int main()
+{
+  const auto project = cgfs::Projection{{CANVAS_SIZE, CANVAS_SIZE}, cgfs::Viewport{{1, 1}, 1}};
+  const auto lights = cgfs::LightSet{std::vector<cgfs::Light>{
+    cgfs::AmbientLight{0.2f},
+    cgfs::PointLight{0.6f, {-1, 1, 0}},
+    cgfs::DirectionalLight{0.2f, {0, 0, 1}}
+  }};
+
+  std::printf("%12s %22s %22s %22s %22s\n", "size [px]", "scanline flat [tri/s]", "half-space flat", "scanline Phong", "half-space Phong");
+  for (const float size : {4.f, 16.f, 64.f, 256.f})
+  {
+    const auto n = static_cast<size_t>(4'000'000 / (size * size)) + 1000;
+    const auto triangles = random_triangles(n, size);
+    const auto flat = [&](size_t i){
+      const auto& [v0, v1, v2] = triangles[i].vertices;
+      return cgfs::Triangle3D{v0, v1, v2, triangles[i].col};
+    };
+
+    const auto scanline_flat = throughput(n, [&](cgfs::Canvas& canvas, size_t i){ cgfs::draw_filled_triangle(canvas, flat(i), project, lights); });
+    const auto halfspace_flat = throughput(n, [&](cgfs::Canvas& canvas, size_t i){ cgfs::draw_filled_triangle_halfspace(canvas, flat(i), project, lights); });
+    const auto scanline_phong = throughput(n, [&](cgfs::Canvas& canvas, size_t i){ cgfs::draw_filled_triangle(canvas, triangles[i], project, lights); });
+    const auto halfspace_phong = throughput(n, [&](cgfs::Canvas& canvas, size_t i){ cgfs::draw_filled_triangle_halfspace(canvas, triangles[i], project, lights); });
+
+    std::printf("%12.0f %22.0f %22.0f %22.0f %22.0f\n", size, scanline_flat, halfspace_flat, scanline_phong, halfspace_phong);
+  }
+
+  auto pool = cgfs::WorkStealingPool{};
+  const auto camera = cgfs::Camera{};
+  std::printf("\n%12s %12s %14s %14s\n", "instances", "rasterizer", "serial [ms]", "binned [ms]");
+  for (const int n : {4, 8, 16})
+  {
+    const auto scene = icosahedra_scene(n);
+    for (const auto rasterizer : {cgfs::Rasterizer::scanline, cgfs::Rasterizer::half_space})
+    {
+      auto canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+      const auto serial_start = std::chrono::steady_clock::now();
+      cgfs::render_scene(canvas, scene, camera, {rasterizer});
+      const auto serial_ms = milliseconds_since(serial_start);
+
+      auto binned_canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+      const auto binned_start = std::chrono::steady_clock::now();
+      cgfs::render_scene(binned_canvas, scene, camera, pool, {rasterizer});
+      const auto binned_ms = milliseconds_since(binned_start);
+
+      std::printf("%12d %12s %14.1f %14.1f (%u threads)\n", n * n, rasterizer == cgfs::Rasterizer::scanline ? "scanline" : "half-space", serial_ms, binned_ms, pool.size());
+    }
+  }
+
+  std::printf("\n%12s %12s %14s %18s %18s\n", "instances", "rasterizer", "order", "per-pixel [ms]", "hierarchical [ms]");
+  for (const int n : {8, 16})
+  {
+    auto scene = icosahedra_scene(n);
+    for (const auto* order : {"near to far", "far to near"})
+    {
+      for (const auto rasterizer : {cgfs::Rasterizer::scanline, cgfs::Rasterizer::half_space})
+      {
+        auto ms = std::array<double, 2>{};
+        for (const auto depth_test : {cgfs::DepthTest::per_pixel, cgfs::DepthTest::hierarchical})
+        {
+          auto canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+          const auto start = std::chrono::steady_clock::now();
+          cgfs::render_scene(canvas, scene, camera, {rasterizer, 16, depth_test});
+          ms[depth_test == cgfs::DepthTest::hierarchical] = milliseconds_since(start);
+        }
+        std::printf("%12d %12s %14s %18.1f %18.1f\n", n * n, rasterizer == cgfs::Rasterizer::scanline ? "scanline" : "half-space", order, ms[0], ms[1]);
+      }
+      std::ranges::reverse(scene.instances);
+    }
+  }
+
+  std::printf("\n%12s %12s %14s %14s\n", "instances", "rasterizer", "forward [ms]", "deferred [ms]");
+  for (const int n : {8, 16})
+  {
+    auto scene = icosahedra_scene(n);
+    std::ranges::reverse(scene.instances);
+    for (const auto rasterizer : {cgfs::Rasterizer::scanline, cgfs::Rasterizer::half_space})
+    {
+      auto ms = std::array<double, 2>{};
+      for (const auto shading : {cgfs::Shading::forward, cgfs::Shading::deferred})
+      {
+        auto canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+        const auto start = std::chrono::steady_clock::now();
+        cgfs::render_scene(canvas, scene, camera, {rasterizer, 16, cgfs::DepthTest::hierarchical, shading});
+        ms[shading == cgfs::Shading::deferred] = milliseconds_since(start);
+      }
+      std::printf("%12d %12s %14.1f %14.1f\n", n * n, rasterizer == cgfs::Rasterizer::scanline ? "scanline" : "half-space", ms[0], ms[1]);
+    }
+  }
+
+  const auto M_camera = cgfs::make_camera_matrix(camera.pose());
+  const auto scene = icosahedra_scene(16);
+  constexpr int REPETITIONS = 1000;
+  auto checksum = 0.f; // so that no part of the triangles is optimized away
+  const auto sum = [](const cgfs::SuperTriangle3D& t){
+    auto s = 0.f;
+    for (size_t k = 0; k < 3; ++k)
+      s += t.vertices[k].x + t.vertices[k].y + t.vertices[k].z + t.normals[k].x + t.normals[k].y + t.normals[k].z;
+    return s;
+  };
+  const auto per_face_start = std::chrono::steady_clock::now();
+  for (int r = 0; r < REPETITIONS; ++r)
+    for (const auto& I : scene.instances)
+      for (const auto& t : I.model->triangles(M_camera * I.transform))
+        checksum += sum(t);
+  const auto per_face_ms = milliseconds_since(per_face_start);
+
+  auto cache = cgfs::VertexCache{};
+  const auto cached_start = std::chrono::steady_clock::now();
+  for (int r = 0; r < REPETITIONS; ++r)
+    for (const auto& I : scene.instances)
+    {
+      I.model->transform(cache, M_camera * I.transform);
+      for (const auto& t : I.model->triangles(cache))
+        checksum -= sum(t);
+    }
+  const auto cached_ms = milliseconds_since(cached_start);
+  std::printf("\n%12s %18s %18s\n%12zu %18.1f %18.1f (checksum %g)\n", "instances", "per face [ms]", "vertex cache [ms]",
+              scene.instances.size() * REPETITIONS, per_face_ms, cached_ms, checksum);
+
+  constexpr size_t POINTS = 1 << 16;
+  auto points = std::vector<cgfs::Position3D>{};
+  auto rng = std::mt19937{1234};
+  auto coordinate = std::uniform_real_distribution<float>{-1, 1};
+  for (size_t i = 0; i < POINTS; ++i)
+    points.push_back({coordinate(rng), coordinate(rng), coordinate(rng)});
+  const auto T = M_camera * scene.instances.front().transform;
+  auto transformed = std::vector<cgfs::Position3D>(POINTS);
+
+  const auto single_start = std::chrono::steady_clock::now();
+  for (int r = 0; r < 100; ++r)
+    std::ranges::transform(points, transformed.begin(), [&](const cgfs::Position3D& p){ return T(p); });
+  const auto single_ms = milliseconds_since(single_start);
+  checksum += transformed.back().x;
+
+  const auto batch_start = std::chrono::steady_clock::now();
+  for (int r = 0; r < 100; ++r)
+    cgfs::transform_points(T, points, transformed);
+  const auto batch_ms = milliseconds_since(batch_start);
+  checksum -= transformed.back().x;
+  std::printf("\n%12s %18s %18s\n%12zu %18.1f %18.1f (checksum %g)\n", "points", "one by one [ms]", "batch [ms]",
+              POINTS * 100, single_ms, batch_ms, checksum);
+
+  std::printf("\n%12s %12s %14s %14s %14s\n", "instances", "culled", "all [ms]", "culled [ms]", "binned [ms]");
+  for (const int n : {50, 100})
+  {
+    const auto city = city_scene(n);
+    auto ms = std::array<double, 3>{};
+    auto stats = cgfs::RasterStats{};
+    for (const auto culling : {false, true})
+    {
+      auto options = cgfs::RasterOptions{};
+      options.frustum_culling = culling;
+      auto canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+      const auto start = std::chrono::steady_clock::now();
+      stats = cgfs::render_scene(canvas, city, camera, options);
+      ms[culling] = milliseconds_since(start);
+    }
+    auto canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+    const auto binned_start = std::chrono::steady_clock::now();
+    cgfs::render_scene(canvas, city, camera, pool);
+    ms[2] = milliseconds_since(binned_start);
+    std::printf("%12zu %12zu %14.1f %14.1f %14.1f\n", stats.instances, stats.culled_instances, ms[0], ms[1], ms[2]);
+  }
+
+  // the same grid, each icosahedron with a model of its own, and all of them sharing one
+  std::printf("\n%12s %14s %14s\n", "instances", "own [ms]", "shared [ms]");
+  for (const int n : {100, 200})
+  {
+    auto ms = std::array<double, 2>{};
+    for (const auto shared : {false, true})
+    {
+      const auto city = city_scene(n, shared);
+      auto canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+      const auto start = std::chrono::steady_clock::now();
+      for (int r = 0; r < 10; ++r)
+        cgfs::render_scene(canvas, city, camera);
+      ms[shared] = milliseconds_since(start);
+    }
+    std::printf("%12d %14.1f %14.1f\n", n * n * 10, ms[0], ms[1]);
+  }
+
+  // wireframes: the edges of every face (the shared ones twice) against each unique edge once
+  const auto wireframes = [&]{
+    auto instances = std::vector<cgfs::Instance<cgfs::Mesh>>{};
+    for (const auto& I : scene.instances)
+      instances.push_back({cgfs::wireframe_icosahedron(), M_camera * I.transform});
+    return instances;
+  }();
+  auto wireframe_ms = std::array<double, 2>{};
+  for (const auto by_edges : {false, true})
+  {
+    auto canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < 10; ++r)
+      for (const auto& I : wireframes)
+      {
+        if (by_edges)
+        {
+          cgfs::render_instance(canvas, *I.model, I.transform, {1, 1}, 1);
+          continue;
+        }
+        auto projected = std::vector<cgfs::Index2D>{};
+        for (const auto& v : I.model->vertices)
+          projected.push_back(cgfs::detail::project_vertex(I.transform(v), 1, {1, 1}, canvas.extent()));
+        for (const auto& t : I.model->faces)
+          cgfs::render_triangle(canvas, t, projected);
+      }
+    wireframe_ms[by_edges] = milliseconds_since(start);
+  }
+  std::printf("\n%12s %18s %18s\n%12zu %18.1f %18.1f\n", "wireframes", "per face [ms]", "unique edges [ms]",
+              wireframes.size() * 10, wireframe_ms[0], wireframe_ms[1]);
+
+  // the front faces of spheres, culled one by one, and by meshlets first
+  const auto sphere = cgfs::solid_sphere(3);
+  const auto spheres = spheres_scene(32, sphere);
+  const auto P = camera.projection({CANVAS_SIZE, CANVAS_SIZE});
+  const auto frustum = cgfs::Frustum{P, cgfs::detail::near_plane};
+  auto whole_sphere = sphere;
+  whole_sphere.meshlets.clear();
+  auto meshlet_ms = std::array<double, 2>{};
+  auto meshlet_stats = cgfs::RasterStats{};
+  auto front_faces = size_t{0};
+  for (const auto by_meshlets : {false, true})
+  {
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < 100; ++r)
+    {
+      meshlet_stats = {};
+      for (const auto& I : spheres.instances)
+      {
+        cgfs::detail::front_faces(by_meshlets ? sphere : whole_sphere, M_camera * I.transform, &frustum, cache, meshlet_stats);
+        front_faces += cache.faces.size();
+      }
+    }
+    meshlet_ms[by_meshlets] = milliseconds_since(start);
+  }
+  std::printf("\n%12s %12s %12s %12s %18s %18s\n%12zu %12zu %12zu %12zu %18.1f %18.1f (checksum %zu)\n", "instances", "meshlets", "culled",
+              "back facing", "per face [ms]", "meshlets [ms]", spheres.instances.size() * 100, meshlet_stats.meshlets,
+              meshlet_stats.culled_meshlets, meshlet_stats.back_facing_meshlets, meshlet_ms[0], meshlet_ms[1], front_faces);
+
+  // the same spheres, at full detail and at the level of detail each of them calls for
+  const auto chain = cgfs::make_lod_chain(sphere);
+  const auto full_spheres = spheres_scene(32, sphere);
+  const auto lod_spheres = spheres_scene(32, chain);
+  auto lod_ms = std::array<double, 2>{};
+  for (const auto lod : {false, true})
+  {
+    auto canvas = cgfs::Canvas{{CANVAS_SIZE, CANVAS_SIZE}};
+    const auto start = std::chrono::steady_clock::now();
+    if (lod)
+      cgfs::render_scene(canvas, lod_spheres, camera);
+    else
+      cgfs::render_scene(canvas, full_spheres, camera);
+    lod_ms[lod] = milliseconds_since(start);
+  }
+  std::printf("\n%12s %12s %18s %18s\n%12zu %12zu %18.1f %18.1f\n", "instances", "levels", "full detail [ms]", "lod [ms]",
+              full_spheres.instances.size(), chain.levels.size(), lod_ms[0], lod_ms[1]);
+}
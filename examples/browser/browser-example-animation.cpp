@@ -88,7 +88,7 @@ namespace
     const auto M_camera = cgfs::make_camera_matrix(camera.pose());
 
     for (const auto& I : scene.instances)
-      render_model(I.model, canvas, vp, M_camera * I.transform);
+      render_model(*I.model, canvas, vp, M_camera * I.transform);
   }
 }
 
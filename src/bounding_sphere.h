@@ -0,0 +1,53 @@
+#pragma once
+
+#include "position.h"
+
+#include "sp3/transform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <span>
+
+namespace cgfs
+{
+  // A sphere that contains a set of points, e.g. the vertices of a model
+  struct BoundingSphere
+  {
+    Position3D center = {0, 0, 0};
+    float radius = 0;
+  };
+
+  // The sphere around the center of the bounding box of the points, through the farthest of them
+  inline BoundingSphere bounding_sphere(std::span<const Position3D> points)
+  {
+    if (points.empty())
+      return {};
+
+    auto lo = points.front();
+    auto hi = points.front();
+    for (const auto& p : points)
+    {
+      lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+      hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+    }
+
+    const auto center = (lo + hi) / 2;
+    auto radius_squared = 0.f;
+    for (const auto& p : points)
+      radius_squared = std::max(radius_squared, sp3::dot(p - center, p - center));
+    // a little larger, so that no point is outside because of rounding
+    return {center, std::sqrt(radius_squared) * (1 + 4 * std::numeric_limits<float>::epsilon())};
+  }
+
+  // The sphere with T applied to it: sp3 transforms scale lengths by the same factor along every axis
+  inline BoundingSphere transform_sphere(const sp3::transform& T, const BoundingSphere& sphere)
+  {
+    const auto length = [&](const Vector3D& axis){
+      const auto v = T(axis);
+      return std::sqrt(sp3::dot(v, v));
+    };
+    const auto scale = std::max({length({1, 0, 0}), length({0, 1, 0}), length({0, 0, 1})});
+    return {T(sphere.center), sphere.radius * scale};
+  }
+}
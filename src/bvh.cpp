@@ -0,0 +1,200 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cgfs
+{
+  namespace
+  {
+    struct BuildItem
+    {
+      AABB bounds;
+      std::array<float, 3> centroid;
+      std::uint32_t index;
+    };
+
+    constexpr int NUM_BINS = 16;
+
+    constexpr float BOUNDS_PADDING = 1e-4f;
+
+    // beyond this depth nodes are split at the median, which bounds the depth of the tree
+    constexpr int MAX_SAH_DEPTH = 32;
+
+    void grow(AABB& box, const AABB& other)
+    {
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        box.min[axis] = std::min(box.min[axis], other.min[axis]);
+        box.max[axis] = std::max(box.max[axis], other.max[axis]);
+      }
+    }
+
+    void grow(AABB& box, const std::array<float, 3>& p)
+    {
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        box.min[axis] = std::min(box.min[axis], p[axis]);
+        box.max[axis] = std::max(box.max[axis], p[axis]);
+      }
+    }
+
+    // half the surface area of the box
+    float area(const AABB& box)
+    {
+      const auto dx = box.max[0] - box.min[0];
+      const auto dy = box.max[1] - box.min[1];
+      const auto dz = box.max[2] - box.min[2];
+      if (dx < 0 || dy < 0 || dz < 0)
+        return 0;
+      return dx * dy + dy * dz + dz * dx;
+    }
+
+    struct Split
+    {
+      int axis = -1;
+      int bin = 0; // items in bins [0, bin] go left
+      float cost = std::numeric_limits<float>::infinity();
+    };
+
+    int bin_of(const BuildItem& item, int axis, const AABB& centroid_bounds)
+    {
+      const auto lo = centroid_bounds.min[axis];
+      const auto extent = centroid_bounds.max[axis] - lo;
+      const auto b = static_cast<int>((item.centroid[axis] - lo) * (NUM_BINS / extent));
+      return std::clamp(b, 0, NUM_BINS - 1);
+    }
+
+    // Binned SAH: the cost of a split is A_left * N_left + A_right * N_right (relative to the parent's area)
+    Split find_split(const std::vector<BuildItem>& items, size_t first, size_t last, const AABB& centroid_bounds)
+    {
+      auto best = Split{};
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        if (!(centroid_bounds.max[axis] > centroid_bounds.min[axis]))
+          continue;
+
+        auto bounds = std::array<AABB, NUM_BINS>{};
+        auto counts = std::array<size_t, NUM_BINS>{};
+        for (auto i = first; i < last; ++i)
+        {
+          const auto b = bin_of(items[i], axis, centroid_bounds);
+          grow(bounds[b], items[i].bounds);
+          ++counts[b];
+        }
+
+        // sweep from the right to get the cost of everything right of each plane
+        auto right_cost = std::array<float, NUM_BINS>{};
+        auto right_box = AABB{};
+        auto right_count = size_t{0};
+        for (int b = NUM_BINS - 1; b > 0; --b)
+        {
+          grow(right_box, bounds[b]);
+          right_count += counts[b];
+          right_cost[b] = area(right_box) * right_count;
+        }
+
+        auto left_box = AABB{};
+        auto left_count = size_t{0};
+        for (int b = 0; b < NUM_BINS - 1; ++b)
+        {
+          grow(left_box, bounds[b]);
+          left_count += counts[b];
+          if (left_count == 0 || left_count == last - first)
+            continue;
+
+          const auto cost = area(left_box) * left_count + right_cost[b + 1];
+          if (cost < best.cost)
+            best = {axis, b, cost};
+        }
+      }
+      return best;
+    }
+
+    std::uint32_t build(std::vector<SphereBVH::Node>& nodes, std::vector<BuildItem>& items, size_t first, size_t last, int depth)
+    {
+      const auto node_index = static_cast<std::uint32_t>(nodes.size());
+      nodes.push_back({});
+
+      auto bounds = AABB{};
+      auto centroid_bounds = AABB{};
+      for (auto i = first; i < last; ++i)
+      {
+        grow(bounds, items[i].bounds);
+        grow(centroid_bounds, items[i].centroid);
+      }
+      nodes[node_index].bounds = bounds;
+
+      const auto count = last - first;
+      const auto make_leaf = [&]{
+        nodes[node_index].offset = static_cast<std::uint32_t>(first);
+        nodes[node_index].count = static_cast<std::uint32_t>(count);
+        return node_index;
+      };
+
+      if (count == 1)
+        return make_leaf();
+
+      auto mid = first;
+      const auto split = depth < MAX_SAH_DEPTH ? find_split(items, first, last, centroid_bounds) : Split{};
+      if (split.axis != -1)
+      {
+        // SAH with unit costs for traversal and intersection: a leaf costs 'count', a split 1 + cost / area
+        const auto parent_area = area(bounds);
+        const auto split_cost = parent_area > 0 ? 1 + split.cost / parent_area : static_cast<float>(count);
+        if (count <= SphereBVH::max_leaf_size && count <= split_cost)
+          return make_leaf();
+
+        const auto it = std::partition(items.begin() + first, items.begin() + last, [&](const BuildItem& item){
+          return bin_of(item, split.axis, centroid_bounds) <= split.bin;
+        });
+        mid = static_cast<size_t>(it - items.begin());
+      }
+      else
+      {
+        if (count <= SphereBVH::max_leaf_size)
+          return make_leaf();
+
+        // coincident centroids or a very deep tree: split in the middle of the widest axis
+        int axis = 0;
+        for (int a = 1; a < 3; ++a)
+          if (centroid_bounds.max[a] - centroid_bounds.min[a] > centroid_bounds.max[axis] - centroid_bounds.min[axis])
+            axis = a;
+        mid = first + count / 2;
+        std::nth_element(items.begin() + first, items.begin() + mid, items.begin() + last, [axis](const BuildItem& a, const BuildItem& b){
+          return a.centroid[axis] < b.centroid[axis];
+        });
+      }
+
+      build(nodes, items, first, mid, depth + 1);
+      const auto second = build(nodes, items, mid, last, depth + 1);
+      nodes[node_index].offset = second;
+      return node_index;
+    }
+  }
+
+  SphereBVH::SphereBVH(const std::vector<Sphere>& spheres)
+  {
+    if (spheres.empty())
+      return;
+
+    auto items = std::vector<BuildItem>{};
+    items.reserve(spheres.size());
+    for (std::uint32_t i = 0; i < spheres.size(); ++i)
+    {
+      const auto& [x, y, z] = spheres[i].center;
+      // The float ray/sphere test loses precision on large spheres and can report hits slightly outside
+      // of them, so the boxes are padded to never cull what the brute force search would have found
+      const auto r = std::abs(spheres[i].radius) * (1 + BOUNDS_PADDING);
+      items.push_back({{{x - r, y - r, z - r}, {x + r, y + r, z + r}}, {x, y, z}, i});
+    }
+
+    m_nodes.reserve(2 * spheres.size());
+    build(m_nodes, items, 0, items.size(), 0);
+    m_nodes.shrink_to_fit();
+
+    m_primitives.reserve(items.size());
+    for (const auto& item : items)
+      m_primitives.push_back(item.index);
+  }
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "ray.h"
+#include "sphere.h"
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace cgfs
+{
+  struct AABB
+  {
+    std::array<float, 3> min = {std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+    std::array<float, 3> max = {-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+  };
+
+  namespace detail
+  {
+    // slab test of a ray against axis aligned boxes
+    struct RaySlabs
+    {
+      RaySlabs() = default;
+      explicit RaySlabs(const Ray3D& ray)
+      : O{ray.origin.x, ray.origin.y, ray.origin.z}
+      , D_inv{1 / ray.direction.x, 1 / ray.direction.y, 1 / ray.direction.z}
+      {}
+
+      // does the ray hit the box in [t0, t1]? t_enter is the distance at which it enters it
+      bool hit(const AABB& box, float t0, float t1, float& t_enter) const
+      {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+          auto t_near = (box.min[axis] - O[axis]) * D_inv[axis];
+          auto t_exit = (box.max[axis] - O[axis]) * D_inv[axis];
+          if (t_exit < t_near)
+            std::swap(t_near, t_exit);
+          t0 = t_near > t0 ? t_near : t0;
+          t1 = t_exit < t1 ? t_exit : t1;
+        }
+        t_enter = t0;
+        return t0 <= t1;
+      }
+
+      std::array<float, 3> O = {};
+      std::array<float, 3> D_inv = {};
+    };
+  }
+
+  // Bounding volume hierarchy over the spheres of a scene.
+  //
+  // The tree is built top-down with the surface area heuristic (SAH) and stored depth-first in a
+  // flat array of 32 byte nodes: the first child of an interior node is the next node in the array,
+  // the second child is at node.offset. A leaf refers to node.count consecutive entries of primitives().
+  class SphereBVH
+  {
+  public:
+    struct Node
+    {
+      AABB bounds;
+      std::uint32_t offset = 0; // interior: index of the second child; leaf: first entry in primitives()
+      std::uint32_t count = 0;  // number of primitives in a leaf, 0 for interior nodes
+    };
+
+    static constexpr std::uint32_t max_leaf_size = 8;
+
+    SphereBVH() = default;
+    explicit SphereBVH(const std::vector<Sphere>& spheres);
+
+    const std::vector<Node>& nodes() const { return m_nodes; }
+
+    // indices into the spheres the hierarchy was built from, in leaf order
+    const std::vector<std::uint32_t>& primitives() const { return m_primitives; }
+
+    // Visit the leaves whose bounds are hit by the ray in [ray.t_min, t_far], nearest child first.
+    //
+    // visit(first, last) is called with a range [first, last) of positions in primitives().
+    // It may reduce t_far (e.g. to the closest hit found so far), which prunes the rest of the traversal.
+    template<typename Visitor>
+    void traverse(const Ray3D& ray, float& t_far, Visitor&& visit) const
+    {
+      if (m_nodes.empty())
+        return;
+
+      const auto slabs = detail::RaySlabs{ray};
+      const auto hits = [&](const AABB& box, float& t_enter){ return slabs.hit(box, ray.t_min, t_far, t_enter); };
+
+      auto stack = std::array<std::uint32_t, 64>{};
+      auto top = size_t{0};
+      stack[top++] = 0;
+
+      while (top != 0)
+      {
+        const auto& node = m_nodes[stack[--top]];
+        auto t_node = 0.0f;
+        if (!hits(node.bounds, t_node))
+          continue;
+
+        if (node.count != 0)
+        {
+          visit(node.offset, node.offset + node.count);
+          continue;
+        }
+
+        // push the far child first so that the near child is visited first
+        const auto first = static_cast<std::uint32_t>(&node - m_nodes.data()) + 1;
+        const auto second = node.offset;
+        auto t_first = 0.0f;
+        auto t_second = 0.0f;
+        const auto hit_first = hits(m_nodes[first].bounds, t_first);
+        const auto hit_second = hits(m_nodes[second].bounds, t_second);
+        if (hit_first && hit_second)
+        {
+          stack[top++] = t_first <= t_second ? second : first;
+          stack[top++] = t_first <= t_second ? first : second;
+        }
+        else if (hit_first)
+          stack[top++] = first;
+        else if (hit_second)
+          stack[top++] = second;
+      }
+    }
+
+    static constexpr size_t max_packet_size = 32;
+
+    // traverse() for a packet of (at most max_packet_size) coherent rays, e.g. the primary rays of neighbouring pixels.
+    //
+    // Interior nodes are only tested against the rays until the first one that hits them ("first active ray"),
+    // which amortizes the box tests over the packet, and are skipped when every ray misses them.
+    // visit(first, last, mask) is called with the mask of the rays whose [rays[i].t_min, t_far[i]] overlaps the
+    // leaf's bounds. It may reduce the t_far of those rays. Children are visited nearest first for the first active ray.
+    template<typename Visitor>
+    void traverse(std::span<const Ray3D> rays, std::span<float> t_far, Visitor&& visit) const
+    {
+      assert(rays.size() <= max_packet_size);
+      if (m_nodes.empty() || rays.empty())
+        return;
+
+      const auto num_rays = static_cast<std::uint32_t>(rays.size());
+      auto slabs = std::array<detail::RaySlabs, max_packet_size>{};
+      for (std::uint32_t i = 0; i < num_rays; ++i)
+        slabs[i] = detail::RaySlabs{rays[i]};
+
+      const auto hits = [&](const AABB& box, std::uint32_t i, float& t_enter){ return slabs[i].hit(box, rays[i].t_min, t_far[i], t_enter); };
+
+      // the first ray at or after 'active' that hits the box (num_rays if none does)
+      const auto first_hit = [&](const AABB& box, std::uint32_t active, float& t_enter)
+      {
+        while (active < num_rays && !hits(box, active, t_enter))
+          ++active;
+        return active;
+      };
+
+      struct Entry
+      {
+        std::uint32_t node;
+        std::uint32_t active; // the rays before it are known to miss the node
+      };
+
+      auto stack = std::array<Entry, 64>{};
+      auto top = size_t{0};
+      stack[top++] = {0, 0};
+
+      while (top != 0)
+      {
+        const auto [index, parent_active] = stack[--top];
+        const auto& node = m_nodes[index];
+        auto t_node = 0.0f;
+        const auto active = first_hit(node.bounds, parent_active, t_node);
+        if (active == num_rays)
+          continue;
+
+        if (node.count != 0)
+        {
+          auto mask = std::uint32_t{1} << active;
+          for (auto i = active + 1; i < num_rays; ++i)
+            if (hits(node.bounds, i, t_node))
+              mask |= std::uint32_t{1} << i;
+          visit(node.offset, node.offset + node.count, mask);
+          continue;
+        }
+
+        const auto first = index + 1;
+        const auto second = node.offset;
+        auto t_first = 0.0f;
+        auto t_second = 0.0f;
+        const auto active_first = first_hit(m_nodes[first].bounds, active, t_first);
+        const auto active_second = first_hit(m_nodes[second].bounds, active, t_second);
+        const auto first_is_near = active_first != active_second ? active_first < active_second : t_first <= t_second;
+        if (active_first != num_rays && active_second != num_rays)
+        {
+          stack[top++] = first_is_near ? Entry{second, active_second} : Entry{first, active_first};
+          stack[top++] = first_is_near ? Entry{first, active_first} : Entry{second, active_second};
+        }
+        else if (active_first != num_rays)
+          stack[top++] = {first, active_first};
+        else if (active_second != num_rays)
+          stack[top++] = {second, active_second};
+      }
+    }
+
+    // Visit the leaves whose bounds are hit by the ray in [ray.t_min, ray.t_max], in no particular order,
+    // until visit(first, last) returns true. Returns whether it did.
+    template<typename Visitor>
+    bool any(const Ray3D& ray, Visitor&& visit) const
+    {
+      if (m_nodes.empty())
+        return false;
+
+      const auto slabs = detail::RaySlabs{ray};
+
+      auto stack = std::array<std::uint32_t, 64>{};
+      auto top = size_t{0};
+      stack[top++] = 0;
+
+      while (top != 0)
+      {
+        const auto index = stack[--top];
+        const auto& node = m_nodes[index];
+        auto t_node = 0.0f;
+        if (!slabs.hit(node.bounds, ray.t_min, ray.t_max, t_node))
+          continue;
+
+        if (node.count != 0)
+        {
+          if (visit(node.offset, node.offset + node.count))
+            return true;
+          continue;
+        }
+
+        stack[top++] = node.offset;
+        stack[top++] = index + 1;
+      }
+      return false;
+    }
+
+  private:
+    std::vector<Node> m_nodes;
+    std::vector<std::uint32_t> m_primitives;
+  };
+}
@@ -3,8 +3,11 @@
 #include "extent.h"
 #include "index.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
+#include <string>
 
 namespace cgfs
 {
@@ -34,16 +37,104 @@ namespace cgfs
     m_data[index + 2] = rgb.b;
   }
 
+  float Canvas::depthBuffer(Index2D xy) const
+  { 
+    const auto [Sx, Sy] = screenIndex(xy, "Canvas::depthBuffer()");
+    return m_depth_buffer[Sy * m_extent.width + Sx];
+  }
+
   float& Canvas::depthBuffer(Index2D xy)
   { 
-    const auto& [Sx, Sy] = to_screen(xy, m_extent);
-    
-    if ( Sx >= m_extent.width || Sy >= m_extent.height || Sx < 0 || Sy < 0) [[unlikely]]
-      throw std::out_of_range{"Canvas::depthBuffer() access out of range"};
+    const auto [Sx, Sy] = screenIndex(xy, "Canvas::depthBuffer()");
+
+    // anything can be written through the reference, so only -infinity is sure to stay a lower bound
+    const auto tile = depthTileIndex(Sx, Sy);
+    m_farthest_depth[tile] = -std::numeric_limits<float>::infinity();
+    m_depth_tile_written[tile] = 1;
+
+    return m_depth_buffer[Sy * m_extent.width + Sx];
+  }
+
+  bool Canvas::testAndSetDepth(Index2D xy, float z_inv)
+  {
+    const auto [Sx, Sy] = screenIndex(xy, "Canvas::testAndSetDepth()");
+
+    auto& depth = m_depth_buffer[Sy * m_extent.width + Sx];
+    if (!(z_inv > depth))
+      return false;
+
+    // the depth only gets nearer, so the lower bound of the tile stays one
+    depth = z_inv;
+    m_depth_tile_written[depthTileIndex(Sx, Sy)] = 1;
+    return true;
+  }
+
+  float Canvas::farthestDepth(Index2D xy) const
+  {
+    const auto [Sx, Sy] = screenIndex(xy, "Canvas::farthestDepth()");
+    return m_farthest_depth[depthTileIndex(Sx, Sy)];
+  }
+
+  float Canvas::updateFarthestDepth(Index2D xy)
+  {
+    const auto [Sx, Sy] = screenIndex(xy, "Canvas::updateFarthestDepth()");
+
+    const auto tile = depthTileIndex(Sx, Sy);
+    if (m_depth_tile_written[tile])
+    {
+      const auto x0 = Sx / depth_tile_size * depth_tile_size;
+      const auto y0 = Sy / depth_tile_size * depth_tile_size;
+      const auto x1 = std::min(x0 + depth_tile_size, m_extent.width);
+      const auto y1 = std::min(y0 + depth_tile_size, m_extent.height);
+
+      auto farthest = std::numeric_limits<float>::infinity();
+      for (int y = y0; y < y1; ++y)
+      {
+        const auto row = m_depth_buffer.begin() + y * m_extent.width;
+        farthest = std::min(farthest, *std::min_element(row + x0, row + x1));
+      }
+
+      m_farthest_depth[tile] = farthest;
+      m_depth_tile_written[tile] = 0;
+    }
+
+    return m_farthest_depth[tile];
+  }
+
+  Canvas::Span Canvas::span(int y, int x0, int x1)
+  {
+    const auto Sy = m_extent.height/2 - y;
+    const auto Sx0 = std::max(m_extent.width/2 + x0, 0);
+    const auto Sx1 = std::min(m_extent.width/2 + x1, m_extent.width - 1);
 
-    int index = (Sy * m_extent.width + Sx);
+    auto row = Span{};
+    if (Sy < 0 || Sy >= m_extent.height || Sx1 < Sx0)
+      return row;
 
-    return m_depth_buffer.at(index);
+    row.x0 = Sx0 - m_extent.width/2;
+    row.x1 = Sx1 - m_extent.width/2;
+    row.y = y;
+    row.m_color = m_data.data() + (size_t(Sy) * m_extent.width + Sx0) * m_pixel_size_bytes;
+    row.m_depth = m_depth_buffer.data() + size_t(Sy) * m_extent.width + Sx0;
+    row.m_depth_tile_written = m_depth_tile_written.data() + depthTileIndex(0, Sy);
+    row.m_tile_x0 = -m_extent.width/2;
+    row.m_pixel_size_bytes = m_pixel_size_bytes;
+    return row;
   }
 
+  size_t Canvas::depthTileIndex(int Sx, int Sy) const
+  {
+    return size_t(Sy / depth_tile_size) * m_depth_tiles_per_row + Sx / depth_tile_size;
+  }
+
+  Index2D Canvas::screenIndex(Index2D xy, const char* caller) const
+  {
+    const auto S_xy = to_screen(xy, m_extent);
+    const auto& [Sx, Sy] = S_xy;
+
+    if ( Sx >= m_extent.width || Sy >= m_extent.height || Sx < 0 || Sy < 0) [[unlikely]]
+      throw std::out_of_range{std::string{caller} + " access out of range"};
+
+    return S_xy;
+  }
 }
@@ -71,13 +71,103 @@ namespace cgfs
         size_t num_bytes() const { return m_data.size() * sizeof(unsigned char); }
 
         // Throws std::out_of_range if the index exceeds the canvas' extent
+        float depthBuffer(Index2D xy) const;
+
+        // Throws std::out_of_range if the index exceeds the canvas' extent
+        //
+        // Anything could be written through the reference, so the depth tile of the pixel loses its lower bound until
+        // updated (see farthestDepth()): read through the const overload, and depth test with testAndSetDepth().
         float& depthBuffer(Index2D xy);
 
+        // The depth test: if z_inv (the 1/z of a surface at pixel xy) is nearer than the depth buffer there,
+        // it is stored in the depth buffer and the test passes.
+        // Throws std::out_of_range if the index exceeds the canvas' extent
+        bool testAndSetDepth(Index2D xy, float z_inv);
+
+        // The depth buffer is split into depth tiles of depth_tile_size x depth_tile_size pixels, from the top left
+        // corner of the canvas, each with a lower bound on the 1/z of its pixels (the farthest surface drawn in it).
+        // A surface that is not nearer than that is hidden everywhere in the tile, so a rasterizer can skip it
+        // without depth testing its pixels one by one.
+        static constexpr int depth_tile_size = 8;
+
+        // The lower bound of the depth tile of the pixel xy: exact but for the depth tests passed in it since its last update.
+        // Throws std::out_of_range if the index exceeds the canvas' extent
+        float farthestDepth(Index2D xy) const;
+
+        // Recomputes the lower bound of the depth tile of the pixel xy if it has been written to since its last update, and returns it.
+        // Throws std::out_of_range if the index exceeds the canvas' extent
+        float updateFarthestDepth(Index2D xy);
+
+        // A run of pixels of one row of the canvas, for a rasterizer to depth test and draw without converting and
+        // checking the coordinates of each pixel: the color and depth buffers of the pixels are contiguous.
+        // The pixels are addressed by their canvas x coordinates, which must be in [x0, x1].
+        class Span
+        {
+        public:
+            int x0 = 0;
+            int x1 = -1; // x1 < x0 if the span is empty
+            int y = 0;
+
+            bool empty() const { return x1 < x0; }
+
+            float depth(int x) const { return m_depth[x - x0]; }
+
+            // Canvas::testAndSetDepth()
+            bool testAndSetDepth(int x, float z_inv)
+            {
+                auto& depth = m_depth[x - x0];
+                if (!(z_inv > depth))
+                    return false;
+
+                depth = z_inv;
+                m_depth_tile_written[(x - m_tile_x0) / depth_tile_size] = 1;
+                return true;
+            }
+
+            // Canvas::putPixel()
+            void putPixel(int x, Color rgb)
+            {
+                auto* pixel = m_color + (x - x0) * m_pixel_size_bytes;
+                pixel[0] = rgb.r;
+                pixel[1] = rgb.g;
+                pixel[2] = rgb.b;
+            }
+
+        private:
+            friend class Canvas;
+
+            unsigned char* m_color = nullptr;              // of pixel x0
+            float* m_depth = nullptr;                      // of pixel x0
+            unsigned char* m_depth_tile_written = nullptr; // of the first depth tile of the row
+            int m_tile_x0 = 0;                             // the canvas x coordinate of the first pixel of the row
+            int m_pixel_size_bytes = 3;
+        };
+
+        // The pixels [x0, x1] of the row y (in canvas coordinates) that are on the canvas
+        Span span(int y, int x0, int x1);
+
     private:
+        // the depth tile of a pixel, from its screen coordinates
+        size_t depthTileIndex(int Sx, int Sy) const;
+        // the screen coordinates of a pixel; throws std::out_of_range, naming the caller, if it is off the canvas
+        Index2D screenIndex(Index2D xy, const char* caller) const;
+
         Extent2D m_extent;
         std::vector<unsigned char> m_data;
         int m_pixel_size_bytes = 3;
         std::vector<float> m_depth_buffer = std::vector<float>(size_t(m_extent.width * m_extent.height), 0);
+
+        int m_depth_tiles_per_row = (m_extent.width + depth_tile_size - 1) / depth_tile_size;
+        int m_depth_tiles_per_column = (m_extent.height + depth_tile_size - 1) / depth_tile_size;
+        std::vector<float> m_farthest_depth = std::vector<float>(size_t(m_depth_tiles_per_row * m_depth_tiles_per_column), 0);
+        std::vector<unsigned char> m_depth_tile_written = std::vector<unsigned char>(m_farthest_depth.size(), 0); // not vector<bool>: different tiles may be written to by different threads
+    };
+
+    // How a rasterizer depth tests the pixels of a triangle
+    enum class DepthTest
+    {
+        per_pixel,    // against the depth buffer only
+        hierarchical, // against the farthest depth of the depth tiles first, skipping what is hidden behind them
     };
 
 } // namespace cgfs
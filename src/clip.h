@@ -0,0 +1,165 @@
+#pragma once
+
+#include "position.h"
+#include "projection.h"
+#include "triangle.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+namespace cgfs
+{
+  namespace detail
+  {
+    // The guard band: how far from the center of the canvas (in pixels) the projected vertices of a triangle may be.
+    // The rasterizers take the triangles inside it as they are and only draw their pixels that are on the canvas, so
+    // triangles are only ever clipped against the sides of the guard band, and only the few that reach out of it are.
+    // (Its size keeps the edge functions of the half-space rasterizer exact.)
+    inline constexpr int guard_band = 1 << 12;
+
+    // The near plane z = near_plane, in camera coordinates, whatever the distance of the viewport: what is between the
+    // camera and the viewport is drawn, only what is at (or nearly at) the camera or behind it is cut off.
+    // (A power of two, so that the points cut at it are exactly on it.)
+    inline constexpr float near_plane = 1.f / 128;
+
+    // The planes a triangle (in camera coordinates) is clipped against before it is projected: the near plane,
+    // then the four sides of the guard band (or of the canvas, if it is larger).
+    class ClipPlanes
+    {
+    public:
+      static constexpr size_t count = 5;
+      static constexpr size_t near = 0;
+
+      explicit ClipPlanes(const Projection& P)
+      {
+        const auto& [Cw, Ch] = P.canvas_dimensions();
+        const auto& [Vw, Vh] = P.viewport().size;
+        const auto d = P.viewport().distance;
+
+        // a point with x = a z is projected to guard_band pixels from the center of the canvas
+        const auto a = std::max(guard_band, Cw/2 + 1) * Vw / (std::max(Cw, 1) * d);
+        const auto b = std::max(guard_band, Ch/2 + 1) * Vh / (std::max(Ch, 1) * d);
+        m_planes = {{
+          {0, 0, 1, -near_plane},
+          {-1, 0, a, 0},
+          {1, 0, a, 0},
+          {0, -1, b, 0},
+          {0, 1, b, 0},
+        }};
+      }
+
+      // the signed distance (up to a factor) of p to plane i, positive inside
+      float distance(size_t i, const Position3D& p) const
+      {
+        const auto& [A, B, C, D] = m_planes[i];
+        return A * p.x + B * p.y + C * p.z + D;
+      }
+
+      // bit i is set if p is outside plane i
+      unsigned outcode(const Position3D& p) const
+      {
+        auto code = 0u;
+        for (size_t i = 0; i < count; ++i)
+          code |= (distance(i, p) < 0 ? 1u : 0u) << i;
+        return code;
+      }
+
+    private:
+      std::array<std::array<float, 4>, count> m_planes = {};
+    };
+
+    // A vertex of a polygon being clipped, with N values (e.g. its normal) to interpolate along with its position
+    template<size_t N>
+    struct ClipVertex
+    {
+      Position3D p = {};
+      std::array<float, N> values = {};
+    };
+
+    // Cutting a convex polygon by a plane adds at most one vertex to it
+    template<size_t N>
+    using ClipPolygon = std::array<ClipVertex<N>, 3 + ClipPlanes::count>;
+
+    // Sutherland-Hodgman: cut the polygon of 'size' vertices by the planes whose bits are set in the mask.
+    // Returns the number of vertices left, in the same order around the polygon.
+    template<size_t N>
+    size_t clip_polygon(ClipPolygon<N>& polygon, size_t size, const ClipPlanes& planes, unsigned mask)
+    {
+      for (size_t i = 0; i < ClipPlanes::count && size >= 3; ++i)
+      {
+        if ((mask & (1u << i)) == 0)
+          continue;
+
+        auto clipped = ClipPolygon<N>{};
+        size_t n = 0;
+        for (size_t k = 0; k < size; ++k)
+        {
+          const auto& u = polygon[k];
+          const auto& v = polygon[(k + 1) % size];
+          const auto du = planes.distance(i, u.p);
+          const auto dv = planes.distance(i, v.p);
+          if (du >= 0)
+            clipped[n++] = u;
+          if ((du >= 0) == (dv >= 0))
+            continue;
+
+          // where the edge uv crosses the plane
+          const auto t = du / (du - dv);
+          auto& w = clipped[n++];
+          w.p = {u.p.x + t * (v.p.x - u.p.x), u.p.y + t * (v.p.y - u.p.y), u.p.z + t * (v.p.z - u.p.z)};
+          if (i == ClipPlanes::near)
+            w.p.z = near_plane; // exactly on it, not in front of the camera by a rounding error
+          for (size_t j = 0; j < N; ++j)
+            w.values[j] = u.values[j] + t * (v.values[j] - u.values[j]);
+        }
+        polygon = clipped;
+        size = n;
+      }
+      return size >= 3 ? size : 0;
+    }
+
+    // Calls draw(piece) for each of the triangles the part of the triangle inside the clip planes is cut into:
+    // the triangle itself (the same object) if it is all inside (as nearly all of them are), none if it is all outside one of the planes.
+    // The pieces are a fan with the winding of the triangle.
+    void clip_triangle(const Triangle3D& triangle, const ClipPlanes& planes, auto&& draw)
+    {
+      const auto& [a, b, c, color] = triangle;
+      const auto codes = std::array{planes.outcode(a), planes.outcode(b), planes.outcode(c)};
+      if ((codes[0] | codes[1] | codes[2]) == 0)
+        return draw(triangle);
+      if ((codes[0] & codes[1] & codes[2]) != 0)
+        return;
+
+      auto polygon = ClipPolygon<0>{{{a}, {b}, {c}}};
+      const auto size = clip_polygon(polygon, 3, planes, codes[0] | codes[1] | codes[2]);
+      for (size_t k = 2; k < size; ++k)
+        draw(Triangle3D{polygon[0].p, polygon[k - 1].p, polygon[k].p, color});
+    }
+
+    // The normals are interpolated like the positions
+    void clip_triangle(const SuperTriangle3D& triangle, const ClipPlanes& planes, auto&& draw)
+    {
+      const auto& v = triangle.vertices;
+      const auto& n = triangle.normals;
+      const auto codes = std::array{planes.outcode(v[0]), planes.outcode(v[1]), planes.outcode(v[2])};
+      if ((codes[0] | codes[1] | codes[2]) == 0)
+        return draw(triangle);
+      if ((codes[0] & codes[1] & codes[2]) != 0)
+        return;
+
+      auto polygon = ClipPolygon<3>{};
+      for (size_t k = 0; k < 3; ++k)
+        polygon[k] = {v[k], {n[k].x, n[k].y, n[k].z}};
+      const auto size = clip_polygon(polygon, 3, planes, codes[0] | codes[1] | codes[2]);
+
+      const auto normal = [](const ClipVertex<3>& w){ return Vector3D{w.values[0], w.values[1], w.values[2]}; };
+      for (size_t k = 2; k < size; ++k)
+        draw(SuperTriangle3D{
+          {{polygon[0].p, polygon[k - 1].p, polygon[k].p}},
+          {{normal(polygon[0]), normal(polygon[k - 1]), normal(polygon[k])}},
+          triangle.col
+        });
+    }
+  }
+}
@@ -1,17 +1,23 @@
 #pragma once
 
 #include "canvas.h"
+#include "clip.h"
 #include "color.h"
 #include "extent.h"
+#include "gbuffer.h"
 #include "index.h"
 #include "interpolation.h"
 #include "light.h"
 #include "mesh.h"
 #include "position.h"
+#include "projection.h"
+#include "tile.h"
 #include "triangle.h"
 
 #include <array>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <ranges>
 #include <utility>
 #include <vector>
@@ -22,7 +28,7 @@ namespace cgfs
 {
   namespace detail
   {
-    float phong(const Index2D& xy_prime, float z_inv, float d, const Vector3D& N, const std::vector<Light>& lights)
+    inline float phong(const Index2D& xy_prime, float z_inv, float d, const Vector3D& N, const LightSet& lights)
     {
       const auto [xp, yp] = xy_prime;
       const auto p_camera = Position3D{xp/(d*z_inv), yp/(d*z_inv), 1/z_inv};
@@ -30,56 +36,99 @@ namespace cgfs
       // V is the "view vector" (the direction from the surface point to the camera (in world coordinates?))
       const auto V = Position3D{0, 0, 0} - sp.pos; // vector coordinates are the same in camera and world space
       
-      return std::accumulate(lights.begin(), lights.end(), 0.0f, [&](float acc, const Light& light){
-        return acc + light.intensity(sp, V);
-      });
+      return lights.intensity(sp, V);
     }
 
-    // return x012, x02
-    std::pair<std::vector<int>, std::vector<int>> triangle_edges(std::array<int, 3> ys, std::array<int, 3> xs)
+    // the intensity of the light on a flat shaded triangle (in camera coordinates), 1 if there are no lights
+    inline float flat_intensity(const Triangle3D& triangle, const LightSet& lights)
     {
-      const auto& [y0, y1, y2] = ys;
-      const auto& [x0, x1, x2] = xs;
+      if (lights.empty())
+        return 1.0f;
 
-      // compute the x coordinates of the triangle edges
-            auto x01 = interpolate(y0, x0, y1, x1);
-      const auto x12 = interpolate(y1, x1, y2, x2);
-      const auto x02 = interpolate(y0, x0, y2, x2);
+      const auto& [v0, v1, v2, color] = triangle;
+      const auto sp = SurfacePoint{(v0 + v1 + v2) / 3, sp3::cross(v1-v0, v2-v0)};
+      // V is the "view vector" (the direction from the surface point to the camera (in world coordinates?))
+      const auto V = Position3D{0, 0, 0} - sp.pos; // vector coordinates are the same in camera and world space
+      return lights.intensity(sp, V);
+    }
 
-      // concatenate the short sides
-      x01.pop_back();
-      x01.insert(x01.end(), x12.begin(), x12.end());
-      
-      return {x01, x02};
+    // the pixels of a tile as ranges of canvas coordinates, [x_min, x_max] x [y_min, y_max]
+    struct CanvasRect
+    {
+      int x_min = 0;
+      int x_max = -1;
+      int y_min = 0;
+      int y_max = -1;
+    };
+
+    inline CanvasRect canvas_rect(const Tile& tile, const Extent2D& C_wh)
+    {
+      const auto& [Cw, Ch] = C_wh;
+      return {tile.x0 - Cw/2, tile.x1 - 1 - Cw/2, Ch/2 - (tile.y1 - 1), Ch/2 - tile.y0};
     }
 
-    // return z012, z02
-    template<typename T>
-    std::pair<std::vector<T>, std::vector<T>> triangle_edgesf(std::array<int, 3> ys, std::array<T, 3> zs)
+    inline Tile whole_canvas(const Extent2D& C_wh)
     {
-      const auto& [y0, y1, y2] = ys;
-      const auto& [z0, z1, z2] = zs;
+      return {0, 0, C_wh.width, C_wh.height};
+    }
 
-      // compute the x coordinates of the triangle edges
-            auto z01 = interpolatef<T>(y0, z0, y1, z1);
-      const auto z12 = interpolatef<T>(y1, z1, y2, z2);
-      const auto z02 = interpolatef<T>(y0, z0, y2, z2);
+    // The pixels of the triangle with vertices p in rect, or an empty rect
+    inline CanvasRect bounding_rect(const std::array<Index2D, 3>& p, const CanvasRect& rect)
+    {
+      return {
+        std::max({rect.x_min, std::min({p[0].x, p[1].x, p[2].x})}),
+        std::min({rect.x_max, std::max({p[0].x, p[1].x, p[2].x})}),
+        std::max({rect.y_min, std::min({p[0].y, p[1].y, p[2].y})}),
+        std::min({rect.y_max, std::max({p[0].y, p[1].y, p[2].y})})
+      };
+    }
 
-      // concatenate the short sides
-      z01.pop_back();
-      z01.insert(z01.end(), z12.begin(), z12.end());
-      
-      return {z01, z02};
+    inline bool empty(const CanvasRect& rect)
+    {
+      return rect.x_max < rect.x_min || rect.y_max < rect.y_min;
+    }
+
+    // z_inv, interpolated from values of at most 'magnitude' in 'steps' additions, plus a bound on its rounding error
+    inline float nearest_bound(float z_inv, float magnitude, int steps)
+    {
+      return z_inv + static_cast<float>(steps + 8) * std::numeric_limits<float>::epsilon() * magnitude;
+    }
+
+    // Is a surface with a 1/z of at most z_inv hidden in all the pixels of rect, which must be on the canvas?
+    // With update, the depth tiles whose lower bound is too low to tell are recomputed (see Canvas::updateFarthestDepth()).
+    inline bool hidden(Canvas& canvas, float z_inv, const CanvasRect& rect, bool update)
+    {
+      const auto& [Cw, Ch] = canvas.extent();
+      constexpr auto T = Canvas::depth_tile_size;
+
+      // the tiles in screen coordinates, each of them probed at its top left pixel
+      for (int ty = (Ch/2 - rect.y_max) / T; ty <= (Ch/2 - rect.y_min) / T; ++ty)
+        for (int tx = (rect.x_min + Cw/2) / T; tx <= (rect.x_max + Cw/2) / T; ++tx)
+        {
+          const auto xy = Index2D{tx * T - Cw/2, Ch/2 - ty * T};
+          if (z_inv <= canvas.farthestDepth(xy))
+            continue;
+          if (!update || !(z_inv <= canvas.updateFarthestDepth(xy)))
+            return false;
+        }
+      return true;
     }
   }
 }
 
 namespace cgfs
 {
+  // The pixels of interpolate(a, b) that are on the canvas, without collecting them first.
+  // The pixels of a row are written through one Canvas::Span.
   inline void draw_line(Canvas& canvas, const Index2D& a, const Index2D& b, const Color& color)
   {
-    for (const auto& p : interpolate(a, b))
-      canvas.putPixel(p, color);
+    const auto rect = detail::canvas_rect(detail::whole_canvas(canvas.extent()), canvas.extent());
+    auto row = Canvas::Span{};
+    detail::line_pixels(a, b, {rect.x_min, rect.y_min}, {rect.x_max, rect.y_max}, [&](const Index2D& xy){
+      if (row.empty() || row.y != xy.y)
+        row = canvas.span(xy.y, rect.x_min, rect.x_max);
+      row.putPixel(xy.x, color);
+    });
   }
 
   inline void draw_wireframe_triangle(Canvas& canvas, const Index2D& a, const Index2D& b, const Index2D& c, const Color& color)
@@ -96,24 +145,19 @@ namespace cgfs
     std::sort(vertices.begin(), vertices.end(), [](const Index2D& lhs, const Index2D& rhs){ return lhs.y < rhs.y; });
     const auto& [p0, p1, p2] = vertices;
 
-    // compute the x coordinates of the triangle edges
-    auto x01 = interpolate(p0.y, p0.x, p1.y, p1.x);
-    const auto x12 = interpolate(p1.y, p1.x, p2.y, p2.x);
-    const auto x02 = interpolate(p0.y, p0.x, p2.y, p2.x);
-
-    // concatenate the short sides
-    x01.pop_back();
-    x01.insert(x01.end(), x12.begin(), x12.end());
-    const auto& x012 = x01;
+    // the x coordinates of the triangle edges, one row at a time
+    auto x02 = detail::TriangleSide{detail::rounding_stepper(p0.y, p0.x, p2.y, p2.x)};
+    auto x012 = detail::TriangleSide{detail::rounding_stepper(p0.y, p0.x, p1.y, p1.x), p0.y, p1.y, detail::rounding_stepper(p1.y, p1.x, p2.y, p2.x)};
 
     // determine which is left and which is right
-    const auto m = x02.size() / 2;
-    const auto& x_left = (x02[m] < x012[m]) ? x02 : x012;
-    const auto& x_right = (x02[m] < x012[m]) ? x012 : x02;
+    const auto m = (p2.y - p0.y + 1) / 2;
+    const bool x02_left = detail::round(x02.value_after(m)) < detail::round(x012.value_after(m));
+    auto& x_left = x02_left ? x02 : x012;
+    auto& x_right = x02_left ? x012 : x02;
 
     // draw the horizontal segments
-    for (auto y = p0.y; y <= p2.y; ++y)
-      for (auto x = x_left.at(y-p0.y); x <= x_right.at(y-p0.y); ++x)
+    for (auto y = p0.y; y <= p2.y; ++y, x_left.step(), x_right.step())
+      for (auto x = detail::round(x_left.value()); x <= detail::round(x_right.value()); ++x)
         canvas.putPixel({x, y}, color);
   }
 
@@ -126,180 +170,360 @@ namespace cgfs
     auto vertices = std::array<Vertex2D, 3>{t.a, t.b, t.c};
     std::sort(vertices.begin(), vertices.end(), [](const Vertex2D& lhs, const Vertex2D& rhs){ return lhs.v.y < rhs.v.y; });
     const auto& [v0, v1, v2] = vertices;
+    const auto& y0 = v0.v.y;
+    const auto& y1 = v1.v.y;
+    const auto& y2 = v2.v.y;
 
-    // compute the x coordinates of the triangle edges
-    auto x01 = interpolate(v0.v.y, v0.v.x, v1.v.y, v1.v.x);
-    const auto x12 = interpolate(v1.v.y, v1.v.x, v2.v.y, v2.v.x);
-    const auto x02 = interpolate(v0.v.y, v0.v.x, v2.v.y, v2.v.x);
-
-    auto h01 = interpolatef(v0.v.y, v0.intensity, v1.v.y, v1.intensity);
-    const auto h12 = interpolatef(v1.v.y, v1.intensity, v2.v.y, v2.intensity);
-    const auto h02 = interpolatef(v0.v.y, v0.intensity, v2.v.y, v2.intensity);
-
-    // concatenate the short sides
-    x01.pop_back();
-    x01.insert(x01.end(), x12.begin(), x12.end());
-    const auto& x012 = x01;
-
-    h01.pop_back();
-    h01.insert(h01.end(), h12.begin(), h12.end());
-    const auto& h012 = h01;
+    // the x coordinates and the intensities along the triangle edges, one row at a time
+    auto x02 = detail::TriangleSide{detail::rounding_stepper(y0, v0.v.x, y2, v2.v.x)};
+    auto x012 = detail::TriangleSide{detail::rounding_stepper(y0, v0.v.x, y1, v1.v.x), y0, y1, detail::rounding_stepper(y1, v1.v.x, y2, v2.v.x)};
+    auto h02 = detail::TriangleSide{detail::stepper(y0, v0.intensity, y2, v2.intensity)};
+    auto h012 = detail::TriangleSide{detail::stepper(y0, v0.intensity, y1, v1.intensity), y0, y1, detail::stepper(y1, v1.intensity, y2, v2.intensity)};
 
     // determine which is left and which is right
-    const auto m = x02.size() / 2;
-    const bool x02_left = (x02[m] < x012[m]); 
-    const auto& x_left = x02_left ? x02 : x012;
-    const auto& h_left = x02_left ? h02 : h012;
-    const auto& x_right = x02_left ? x012 : x02;
-    const auto& h_right = x02_left ? h012 : h02;
+    const auto m = (y2 - y0 + 1) / 2;
+    const bool x02_left = detail::round(x02.value_after(m)) < detail::round(x012.value_after(m));
+    auto& x_left = x02_left ? x02 : x012;
+    auto& h_left = x02_left ? h02 : h012;
+    auto& x_right = x02_left ? x012 : x02;
+    auto& h_right = x02_left ? h012 : h02;
 
     // draw the horizontal segments
-    const auto& y0 = v0.v.y;
-    const auto& y2 = v2.v.y;
-    for (auto y = y0; y <= y2; ++y)
+    for (auto y = y0; y <= y2; ++y, x_left.step(), h_left.step(), x_right.step(), h_right.step())
     {
-      const auto& x_l = x_left.at(y-y0);
-      const auto& x_r = x_right.at(y-y0);
-      const auto h_segment = interpolatef(x_l, h_left.at(y-y0), x_r, h_right.at(y-y0));
-      for (auto x = x_l; x <= x_r; ++x)
+      const auto x_l = detail::round(x_left.value());
+      const auto x_r = detail::round(x_right.value());
+      if (x_r < x_l)
+        continue;
+
+      auto h = detail::stepper(x_l, h_left.value(), x_r, h_right.value());
+      for (auto x = x_l; x <= x_r; ++x, h.step())
       {
-        const auto shaded_color = h_segment.at(x - x_l) * color;
+        const auto shaded_color = h.value() * color;
         canvas.putPixel({x, y}, shaded_color);
       }
     }
   } 
 
-  // the vertices of triangle are in camera coordinates
-  // the Projection operator projects from camera (3D) coordinates to canvas (2D) coordinates
-  inline void draw_filled_triangle(Canvas& canvas, const Triangle3D& triangle, const cgfs::Projection& project, const std::vector<Light>& lights = {})
+  namespace detail
   {
-    const auto& [v0, v1, v2, color] = triangle;
-
-    const float intensity = lights.empty()
-    ? 1.0f
-    : [&](){
-        const auto sp = SurfacePoint{(v0 + v1 + v2) / 3, sp3::cross(v1-v0, v2-v0)};
-        // V is the "view vector" (the direction from the surface point to the camera (in world coordinates?))
-        const auto V = Position3D{0, 0, 0} - sp.pos; // vector coordinates are the same in camera and world space
-        return std::accumulate(lights.begin(), lights.end(), 0.0f, [&sp, &V](float acc, const Light& light){
-          return acc + light.intensity(sp, V);
-        });
-      } ();
-      
-    // sort the vertices so that a.y <= b.y <= c.y
-    auto vertices = std::array<std::pair<Index2D, float>, 3>{
-      std::pair{project(v0), v0.z},
-      std::pair{project(v1), v1.z},
-      std::pair{project(v2), v2.z}
-    };
-    std::sort(vertices.begin(), vertices.end(), [](const auto& lhs, const auto& rhs){ return lhs.first.y < rhs.first.y; });
-    const auto& [A, B, C] = vertices;
-    const auto& [p0, z0] = A;
-    const auto& [p1, z1] = B;
-    const auto& [p2, z2] = C;
-
-    auto [x_left, x_right] = detail::triangle_edges({{p0.y, p1.y, p2.y}}, {{p0.x, p1.x, p2.x}});
-    auto [z_left, z_right] = detail::triangle_edgesf<float>({{p0.y, p1.y, p2.y}}, {{1/z0, 1/z1, 1/z2}});
+    // The scanline rasterizers: fragment(row, xy, ...) is called for each pixel of the triangle in the clip tile that
+    // passes the depth test, with the Canvas::Span of its row and the values interpolated there.
+    // With DepthTest::hierarchical, the triangle and the spans of it that are hidden behind the depth tiles of the canvas are skipped.
+    // The triangle must be in front of the near plane and inside the guard band (see clip_triangle()), and p are the
+    // projections of its vertices.
+
+    // the projections of the vertices of the triangle
+    inline std::array<Index2D, 3> projections(const Triangle3D& triangle, const cgfs::Projection& project)
+    {
+      return {project(triangle.a), project(triangle.b), project(triangle.c)};
+    }
 
-    // determine which is left and which is right
-    size_t m = x_right.size() / 2;
-    if (x_right[m] == x_left[m])
-      m = std::max<size_t>(0, m - 1);
+    inline std::array<Index2D, 3> projections(const SuperTriangle3D& triangle, const cgfs::Projection& project)
+    {
+      const auto& [v0, v1, v2] = triangle.vertices;
+      return {project(v0), project(v1), project(v2)};
+    }
 
-    if (x_right[m] < x_left[m])
+    // fragment(row, xy)
+    inline void scan_triangle(Canvas& canvas, const Triangle3D& triangle, const std::array<Index2D, 3>& p, const Tile& clip, DepthTest depth_test, auto&& fragment)
     {
-      std::swap(x_left, x_right);
-      std::swap(z_left, z_right);
+      const auto& [v0, v1, v2, color] = triangle;
+
+      // sort the vertices so that a.y <= b.y <= c.y
+      auto vertices = std::array<std::pair<Index2D, float>, 3>{
+        std::pair{p[0], v0.z},
+        std::pair{p[1], v1.z},
+        std::pair{p[2], v2.z}
+      };
+      std::sort(vertices.begin(), vertices.end(), [](const auto& lhs, const auto& rhs){ return lhs.first.y < rhs.first.y; });
+      const auto& [A, B, C] = vertices;
+      const auto& [p0, z0] = A;
+      const auto& [p1, z1] = B;
+      const auto& [p2, z2] = C;
+
+      const auto rect = detail::bounding_rect({p0, p1, p2}, detail::canvas_rect(clip, canvas.extent()));
+      if (detail::empty(rect))
+        return;
+
+      const auto hierarchical = depth_test == DepthTest::hierarchical;
+      if (hierarchical)
+      {
+        const auto z_nearest = std::max({1/z0, 1/z1, 1/z2});
+        const auto magnitude = std::max({std::abs(1/z0), std::abs(1/z1), std::abs(1/z2)});
+        const auto steps = (p2.y - p0.y) + (std::max({p0.x, p1.x, p2.x}) - std::min({p0.x, p1.x, p2.x}));
+        if (detail::hidden(canvas, detail::nearest_bound(z_nearest, magnitude, steps), rect, true))
+          return;
+      }
+
+      // the x coordinates and the 1/z values along the triangle edges, one row at a time
+      auto x_left = detail::TriangleSide{detail::rounding_stepper(p0.y, p0.x, p1.y, p1.x), p0.y, p1.y, detail::rounding_stepper(p1.y, p1.x, p2.y, p2.x)};
+      auto x_right = detail::TriangleSide{detail::rounding_stepper(p0.y, p0.x, p2.y, p2.x)};
+      auto z_left = detail::TriangleSide{detail::stepper(p0.y, 1/z0, p1.y, 1/z1), p0.y, p1.y, detail::stepper(p1.y, 1/z1, p2.y, 1/z2)};
+      auto z_right = detail::TriangleSide{detail::stepper(p0.y, 1/z0, p2.y, 1/z2)};
+
+      // determine which is left and which is right
+      auto m = (p2.y - p0.y + 1) / 2;
+      if (detail::round(x_right.value_after(m)) == detail::round(x_left.value_after(m)) && m > 0)
+        m = m - 1;
+
+      if (detail::round(x_right.value_after(m)) < detail::round(x_left.value_after(m)))
+      {
+        std::swap(x_left, x_right);
+        std::swap(z_left, z_right);
+      }
+
+      // draw the horizontal segments, from the first row in the clip tile
+      const auto y_first = std::max(p0.y, rect.y_min);
+      for (auto* side : {&x_left, &x_right, &z_left, &z_right})
+        side->advance(y_first - p0.y);
+      for (auto y = y_first; y <= rect.y_max; ++y, x_left.step(), z_left.step(), x_right.step(), z_right.step())
+      {
+        const auto x_l = detail::round(x_left.value());
+        const auto x_r = detail::round(x_right.value());
+        if (x_r < x_l)
+          continue;
+
+        const auto span = detail::CanvasRect{std::max(x_l, rect.x_min), std::min(x_r, rect.x_max), y, y};
+        if (detail::empty(span))
+          continue;
+        if (hierarchical)
+        {
+          const auto z_nearest = std::max(z_left.value(), z_right.value());
+          const auto magnitude = std::max(std::abs(z_left.value()), std::abs(z_right.value()));
+          if (detail::hidden(canvas, detail::nearest_bound(z_nearest, magnitude, x_r - x_l), span, false))
+            continue;
+        }
+
+        // from the first pixel in the clip tile
+        auto z = detail::stepper(x_l, z_left.value(), x_r, z_right.value());
+        z.advance(span.x_min - x_l);
+        auto row = canvas.span(y, span.x_min, span.x_max);
+        for (auto x = span.x_min; x <= span.x_max; ++x, z.step())
+        {
+          if (row.testAndSetDepth(x, z.value()))
+            fragment(row, Index2D{x, y});
+        }
+      }
     }
 
-    // draw the horizontal segments
-    for (auto y = p0.y; y <= p2.y; ++y)
+    // fragment(row, xy, 1/z, N)
+    inline void scan_triangle(Canvas& canvas, const SuperTriangle3D& triangle, const std::array<Index2D, 3>& p, const Tile& clip, DepthTest depth_test, auto&& fragment)
     {
-      const size_t i = (y - p0.y);
-      const auto& x_l = x_left.at(i);
-      const auto& x_r = x_right.at(i);
-      const auto z_segment = interpolatef(x_l, z_left.at(i), x_r, z_right.at(i));
-      for (auto x = x_l; x <= x_r; ++x)
+      const auto& [v0, v1, v2] = triangle.vertices;
+      const auto& [n0, n1, n2] = triangle.normals;
+
+      // sort the vertices so that a.y <= b.y <= c.y
+      auto vertices = std::array<std::tuple<Index2D, float, Vector3D>, 3>{{
+        {p[0], v0.z, n0},
+        {p[1], v1.z, n1},
+        {p[2], v2.z, n2}
+      }};
+      std::sort(vertices.begin(), vertices.end(), [](const auto& lhs, const auto& rhs){ return std::get<0>(lhs).y < std::get<0>(rhs).y; });
+      const auto& [A, B, C] = vertices;
+      const auto& [p0, z0, nn0] = A;
+      const auto& [p1, z1, nn1] = B;
+      const auto& [p2, z2, nn2] = C;
+
+      const auto rect = detail::bounding_rect({p0, p1, p2}, detail::canvas_rect(clip, canvas.extent()));
+      if (detail::empty(rect))
+        return;
+
+      const auto hierarchical = depth_test == DepthTest::hierarchical;
+      if (hierarchical)
+      {
+        const auto z_nearest = std::max({1/z0, 1/z1, 1/z2});
+        const auto magnitude = std::max({std::abs(1/z0), std::abs(1/z1), std::abs(1/z2)});
+        const auto steps = (p2.y - p0.y) + (std::max({p0.x, p1.x, p2.x}) - std::min({p0.x, p1.x, p2.x}));
+        if (detail::hidden(canvas, detail::nearest_bound(z_nearest, magnitude, steps), rect, true))
+          return;
+      }
+
+      // the short sides (from vertex 0 to 1 to 2) and the long side (from vertex 0 to 2) of a value along the edges
+      const auto y0 = p0.y;
+      const auto y1 = p1.y;
+      const auto y2 = p2.y;
+      const auto short_sides = [=](float f0, float f1, float f2){
+        return detail::TriangleSide{detail::stepper(y0, f0, y1, f1), y0, y1, detail::stepper(y1, f1, y2, f2)};
+      };
+      const auto long_side = [=](float f0, float f2){
+        return detail::TriangleSide{detail::stepper(y0, f0, y2, f2)};
+      };
+
+      // the x coordinates, the 1/z values and the normals along the triangle edges, one row at a time
+      auto x_left = detail::TriangleSide{detail::rounding_stepper(p0.y, p0.x, p1.y, p1.x), p0.y, p1.y, detail::rounding_stepper(p1.y, p1.x, p2.y, p2.x)};
+      auto x_right = detail::TriangleSide{detail::rounding_stepper(p0.y, p0.x, p2.y, p2.x)};
+      auto z_left = short_sides(1/z0, 1/z1, 1/z2);
+      auto z_right = long_side(1/z0, 1/z2);
+      auto nx_left = short_sides(nn0.x, nn1.x, nn2.x);
+      auto nx_right = long_side(nn0.x, nn2.x);
+      auto ny_left = short_sides(nn0.y, nn1.y, nn2.y);
+      auto ny_right = long_side(nn0.y, nn2.y);
+      auto nz_left = short_sides(nn0.z, nn1.z, nn2.z);
+      auto nz_right = long_side(nn0.z, nn2.z);
+
+      // determine which is left and which is right
+      auto m = (p2.y - p0.y + 1) / 2;
+      if (detail::round(x_right.value_after(m)) == detail::round(x_left.value_after(m)) && m > 0)
+        m = m - 1;
+
+      if (detail::round(x_right.value_after(m)) < detail::round(x_left.value_after(m)))
       {
-        const size_t j = (x - x_l);
-        const auto z = z_segment.at(j);
-        if (z > canvas.depthBuffer({x, y}))
+        std::swap(x_left, x_right);
+        std::swap(z_left, z_right);
+        std::swap(nx_left, nx_right);
+        std::swap(ny_left, ny_right);
+        std::swap(nz_left, nz_right);
+      }
+
+      // draw the horizontal segments, from the first row in the clip tile
+      const auto sides = {&x_left, &x_right, &z_left, &z_right, &nx_left, &nx_right, &ny_left, &ny_right, &nz_left, &nz_right};
+      const auto y_first = std::max(p0.y, rect.y_min);
+      for (auto* side : sides)
+        side->advance(y_first - p0.y);
+      const auto next_row = [&](){
+        for (auto* side : sides)
+          side->step();
+      };
+      for (auto y = y_first; y <= rect.y_max; ++y, next_row())
+      {
+        const auto x_l = detail::round(x_left.value());
+        const auto x_r = detail::round(x_right.value());
+        if (x_r < x_l)
+          continue;
+
+        const auto span = detail::CanvasRect{std::max(x_l, rect.x_min), std::min(x_r, rect.x_max), y, y};
+        if (detail::empty(span))
+          continue;
+        if (hierarchical)
         {
-          canvas.putPixel({x, y}, intensity * color);
-          canvas.depthBuffer({x, y}) = z;
+          const auto z_nearest = std::max(z_left.value(), z_right.value());
+          const auto magnitude = std::max(std::abs(z_left.value()), std::abs(z_right.value()));
+          if (detail::hidden(canvas, detail::nearest_bound(z_nearest, magnitude, x_r - x_l), span, false))
+            continue;
+        }
+
+        // from the first pixel in the clip tile
+        auto z = detail::stepper(x_l, z_left.value(), x_r, z_right.value());
+        auto nx = detail::stepper(x_l, nx_left.value(), x_r, nx_right.value());
+        auto ny = detail::stepper(x_l, ny_left.value(), x_r, ny_right.value());
+        auto nz = detail::stepper(x_l, nz_left.value(), x_r, nz_right.value());
+        for (auto* value : {&z, &nx, &ny, &nz})
+          value->advance(span.x_min - x_l);
+        auto row = canvas.span(y, span.x_min, span.x_max);
+        for (auto x = span.x_min; x <= span.x_max; ++x, z.step(), nx.step(), ny.step(), nz.step())
+        {
+          if (row.testAndSetDepth(x, z.value()))
+            fragment(row, Index2D{x, y}, z.value(), Vector3D{nx.value(), ny.value(), nz.value()});
         }
       }
     }
+
+    // scan_triangle() for any triangle: the part of it behind the near plane (or out of the guard band) is clipped off first
+    // A triangle that is drawn whole is drawn with its projections, if they are given (not null), the pieces of one that
+    // is clipped with those of their own vertices.
+    inline void fill_triangle(Canvas& canvas, const auto& triangle, const std::array<Index2D, 3>* projected, const cgfs::Projection& project, const Tile& clip, DepthTest depth_test, auto&& fragment)
+    {
+      detail::clip_triangle(triangle, ClipPlanes{project}, [&](const auto& piece){
+        scan_triangle(canvas, piece, projected && &piece == &triangle ? *projected : projections(piece, project), clip, depth_test, fragment);
+      });
+    }
+  }
+
+  // the vertices of triangle are in camera coordinates
+  // the Projection operator projects from camera (3D) coordinates to canvas (2D) coordinates
+  // Only the pixels in the clip tile are drawn, with the same values as if the whole triangle was drawn.
+  // With DepthTest::hierarchical, the triangle and the spans of it that are hidden behind the depth tiles of the canvas are skipped.
+  // The part of the triangle behind the near plane (z < detail::near_plane, see clip.h) is not drawn.
+  // projected, if not null, are the projections of the vertices of the triangle by project, computed already (once for each
+  // vertex of a model, see render_model() in render.h).
+  inline void draw_filled_triangle(Canvas& canvas, const Triangle3D& triangle, const cgfs::Projection& project, const LightSet& lights, const Tile& clip, DepthTest depth_test = DepthTest::hierarchical, const std::array<Index2D, 3>* projected = nullptr)
+  {
+    const auto shaded_color = detail::flat_intensity(triangle, lights) * triangle.col;
+    detail::fill_triangle(canvas, triangle, projected, project, clip, depth_test, [&](Canvas::Span& row, const Index2D& xy){
+      row.putPixel(xy.x, shaded_color);
+    });
+  }
+
+  // the vertices of triangle are in camera coordinates
+  // the Projection operator projects from camera (3D) coordinates to canvas (2D) coordinates
+  inline void draw_filled_triangle(Canvas& canvas, const Triangle3D& triangle, const cgfs::Projection& project, const LightSet& lights = {})
+  {
+    draw_filled_triangle(canvas, triangle, project, lights, detail::whole_canvas(canvas.extent()));
+  }
+
+  // (with the lights as a scene lists them: prefer making their LightSet once, for all the triangles)
+  inline void draw_filled_triangle(Canvas& canvas, const Triangle3D& triangle, const cgfs::Projection& project, const std::vector<Light>& lights)
+  {
+    draw_filled_triangle(canvas, triangle, project, LightSet{lights});
   }
 
   // the vertices of triangle are in camera coordinates
   // the Projection operator projects from camera (3D) coordinates to canvas (2D) coordinates
-  inline void draw_filled_triangle(Canvas& canvas, const SuperTriangle3D& triangle, const cgfs::Projection& project, const std::vector<Light>& lights = {})
+  // Only the pixels in the clip tile are drawn, with the same values as if the whole triangle was drawn.
+  // With DepthTest::hierarchical, the triangle and the spans of it that are hidden behind the depth tiles of the canvas are skipped.
+  inline void draw_filled_triangle(Canvas& canvas, const SuperTriangle3D& triangle, const cgfs::Projection& project, const LightSet& lights, const Tile& clip, DepthTest depth_test = DepthTest::hierarchical, const std::array<Index2D, 3>* projected = nullptr)
   {
-    const auto& [v0, v1, v2] = triangle.vertices;
-    const auto& [n0, n1, n2] = triangle.normals;
     const auto& color = triangle.col;
     const float d = project.viewport().distance;
-      
-    // sort the vertices so that a.y <= b.y <= c.y
-    auto vertices = std::array<std::tuple<Index2D, float, Vector3D>, 3>{{
-      {project(v0), v0.z, n0},
-      {project(v1), v1.z, n1},
-      {project(v2), v2.z, n2}
-    }};
-    std::sort(vertices.begin(), vertices.end(), [](const auto& lhs, const auto& rhs){ return std::get<0>(lhs).y < std::get<0>(rhs).y; });
-    const auto& [A, B, C] = vertices;
-    const auto& [p0, z0, nn0] = A;
-    const auto& [p1, z1, nn1] = B;
-    const auto& [p2, z2, nn2] = C;
-
-    auto [x_left, x_right] = detail::triangle_edges({{p0.y, p1.y, p2.y}}, {{p0.x, p1.x, p2.x}});
-    auto [z_left, z_right] = detail::triangle_edgesf<float>({{p0.y, p1.y, p2.y}}, {{1/z0, 1/z1, 1/z2}});
-    auto [nx_left, nx_right] = detail::triangle_edgesf<float>({{p0.y, p1.y, p2.y}}, {{nn0.x, nn1.x, nn2.x}});
-    auto [ny_left, ny_right] = detail::triangle_edgesf<float>({{p0.y, p1.y, p2.y}}, {{nn0.y, nn1.y, nn2.y}});
-    auto [nz_left, nz_right] = detail::triangle_edgesf<float>({{p0.y, p1.y, p2.y}}, {{nn0.z, nn1.z, nn2.z}});
+    detail::fill_triangle(canvas, triangle, projected, project, clip, depth_test, [&](Canvas::Span& row, const Index2D& xy, float z_inv, const Vector3D& N){
+      row.putPixel(xy.x, detail::phong(xy, z_inv, d, N, lights) * color);
+    });
+  }
 
-    // determine which is left and which is right
-    size_t m = x_right.size() / 2;
-    if (x_right[m] == x_left[m])
-      m = std::max<size_t>(0, m - 1);
+  // the vertices of triangle are in camera coordinates
+  // the Projection operator projects from camera (3D) coordinates to canvas (2D) coordinates
+  inline void draw_filled_triangle(Canvas& canvas, const SuperTriangle3D& triangle, const cgfs::Projection& project, const LightSet& lights = {})
+  {
+    draw_filled_triangle(canvas, triangle, project, lights, detail::whole_canvas(canvas.extent()));
+  }
 
-    if (x_right[m] < x_left[m])
-    {
-      std::swap(x_left, x_right);
-      std::swap(z_left, z_right);
-      std::swap(nx_left, nx_right);
-      std::swap(ny_left, ny_right);
-      std::swap(nz_left, nz_right);
-    }
+  // (with the lights as a scene lists them: prefer making their LightSet once, for all the triangles)
+  inline void draw_filled_triangle(Canvas& canvas, const SuperTriangle3D& triangle, const cgfs::Projection& project, const std::vector<Light>& lights)
+  {
+    draw_filled_triangle(canvas, triangle, project, LightSet{lights});
+  }
 
-    // draw the horizontal segments
-    for (auto y = p0.y; y <= p2.y; ++y)
-    {
-      const size_t i = (y - p0.y);
-      const auto& x_l = x_left.at(i);
-      const auto& x_r = x_right.at(i);
-      const auto z_segment = interpolatef(x_l, z_left.at(i), x_r, z_right.at(i));
-      const auto nx_segment = interpolatef(x_l, nx_left.at(i), x_r, nx_right.at(i));
-      const auto ny_segment = interpolatef(x_l, ny_left.at(i), x_r, ny_right.at(i));
-      const auto nz_segment = interpolatef(x_l, nz_left.at(i), x_r, nz_right.at(i));
-      for (auto x = x_l; x <= x_r; ++x)
+  // The geometry pass of deferred shading: like draw_filled_triangle(), but the pixels that pass the depth test
+  // (against the depth buffer of the canvas) are written to the G-buffer instead of the canvas.
+  // A flat shaded triangle is shaded once, as it is drawn.
+  inline void draw_filled_triangle(Canvas& canvas, GBuffer& gbuffer, const Triangle3D& triangle, const cgfs::Projection& project, const LightSet& lights, const Tile& clip, DepthTest depth_test = DepthTest::hierarchical, const std::array<Index2D, 3>* projected = nullptr)
+  {
+    const auto shaded_color = detail::flat_intensity(triangle, lights) * triangle.col;
+    detail::fill_triangle(canvas, triangle, projected, project, clip, depth_test, [&](Canvas::Span&, const Index2D& xy){
+      gbuffer.setFlat(xy, shaded_color);
+    });
+  }
+
+  inline void draw_filled_triangle(Canvas& canvas, GBuffer& gbuffer, const SuperTriangle3D& triangle, const cgfs::Projection& project, const Tile& clip, DepthTest depth_test = DepthTest::hierarchical, const std::array<Index2D, 3>* projected = nullptr)
+  {
+    const auto& color = triangle.col;
+    detail::fill_triangle(canvas, triangle, projected, project, clip, depth_test, [&](Canvas::Span&, const Index2D& xy, float, const Vector3D& N){
+      gbuffer.setPhong(xy, N, color);
+    });
+  }
+
+  // The lighting pass of deferred shading: the pixels of the tile drawn in the G-buffer are shaded, once each,
+  // to the same colors as draw_filled_triangle() shades them.
+  // d is the distance of the viewport of the projection the G-buffer was drawn with.
+  inline void shade_deferred(Canvas& canvas, const GBuffer& gbuffer, float d, const LightSet& lights, const Tile& tile)
+  {
+    const auto& [Cw, Ch] = canvas.extent();
+    for (int Sy = tile.y0; Sy < tile.y1; ++Sy)
+      for (int Sx = tile.x0; Sx < tile.x1; ++Sx)
       {
-        const size_t j = (x - x_l);
-        const auto z = z_segment.at(j);
-        if (z > canvas.depthBuffer({x, y}))
+        const auto xy = Index2D{Sx - Cw/2, Ch/2 - Sy};
+        switch (gbuffer.surface(xy))
         {
-          const auto& nx = nx_segment.at(j);
-          const auto& ny = ny_segment.at(j);
-          const auto& nz = nz_segment.at(j);
-          const auto intensity = detail::phong({x, y}, z, d, {nx, ny, nz}, lights);
-
-          canvas.putPixel({x, y}, intensity * color);
-          canvas.depthBuffer({x, y}) = z;
+          case GBuffer::Surface::none:
+            break;
+          case GBuffer::Surface::flat:
+            canvas.putPixel(xy, gbuffer.color(xy));
+            break;
+          case GBuffer::Surface::phong:
+            canvas.putPixel(xy, detail::phong(xy, std::as_const(canvas).depthBuffer(xy), d, gbuffer.normal(xy), lights) * gbuffer.color(xy));
+            break;
         }
       }
-    }
   }
-
-
 }
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "bounding_sphere.h"
+#include "position.h"
+#include "projection.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace cgfs
+{
+  // The part of camera space that the Projection maps onto the canvas: the pyramid with its apex at the camera
+  // and its sides through the edges of the viewport, widened by a pixel, cut by the plane z = near.
+  // There is no far plane.
+  class Frustum
+  {
+  public:
+    explicit Frustum(const Projection& P, float near = 0)
+    {
+      const auto& [Cw, Ch] = P.canvas_dimensions();
+      const auto& [Vw, Vh] = P.viewport().size;
+      const auto d = P.viewport().distance;
+
+      // the slopes x/z and y/z of the sides: (Cw/2 + 1) pixels from the center of the canvas at z = d
+      const auto a = (std::max(Cw, 1) / 2.f + 1) * Vw / (std::max(Cw, 1) * d);
+      const auto b = (std::max(Ch, 1) / 2.f + 1) * Vh / (std::max(Ch, 1) * d);
+      const auto side = [](float x, float y, float z){
+        const auto n = std::sqrt(x*x + y*y + z*z);
+        return Plane{{x / n, y / n, z / n}, 0};
+      };
+      m_planes = {
+        side(-1, 0, a),  // right: x <= a z
+        side(1, 0, a),   // left: -a z <= x
+        side(0, -1, b),  // top: y <= b z
+        side(0, 1, b),   // bottom: -b z <= y
+        Plane{{0, 0, 1}, -near},
+      };
+    }
+
+    // Is the sphere (in camera coordinates) entirely outside of the frustum? Then nothing in it is drawn.
+    // Spheres that are outside but close to an edge of the pyramid can pass.
+    bool outside(const BoundingSphere& sphere) const
+    {
+      return std::ranges::any_of(m_planes, [&](const Plane& plane){ return plane.distance(sphere.center) < -sphere.radius; });
+    }
+
+  private:
+    struct Plane
+    {
+      Vector3D normal;  // unit length, pointing inside
+      float offset = 0;
+
+      float distance(const Position3D& p) const
+      {
+        return sp3::dot(normal, p - Position3D{0, 0, 0}) + offset;
+      }
+    };
+
+    std::array<Plane, 5> m_planes = {};
+  };
+}
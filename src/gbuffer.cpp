@@ -0,0 +1,52 @@
+#include "gbuffer.h"
+
+#include <stdexcept>
+
+namespace cgfs
+{
+  GBuffer::GBuffer(Extent2D ext)
+  : m_extent{ext}
+  {}
+
+  void GBuffer::setFlat(Index2D xy, Color col)
+  {
+    const auto i = index(xy);
+    m_surfaces[i] = Surface::flat;
+    m_colors[i] = col;
+  }
+
+  void GBuffer::setPhong(Index2D xy, const Vector3D& N, Color col)
+  {
+    const auto i = index(xy);
+    m_surfaces[i] = Surface::phong;
+    m_normals[i] = N;
+    m_colors[i] = col;
+  }
+
+  GBuffer::Surface GBuffer::surface(Index2D xy) const
+  {
+    return m_surfaces[index(xy)];
+  }
+
+  const Vector3D& GBuffer::normal(Index2D xy) const
+  {
+    return m_normals[index(xy)];
+  }
+
+  Color GBuffer::color(Index2D xy) const
+  {
+    return m_colors[index(xy)];
+  }
+
+  size_t GBuffer::index(Index2D xy) const
+  {
+    // from canvas to screen coordinates
+    const auto Sx = m_extent.width/2 + xy.x;
+    const auto Sy = m_extent.height/2 - xy.y;
+
+    if ( Sx >= m_extent.width || Sy >= m_extent.height || Sx < 0 || Sy < 0) [[unlikely]]
+      throw std::out_of_range{"GBuffer access out of range"};
+
+    return size_t(Sy) * m_extent.width + Sx;
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "color.h"
+#include "extent.h"
+#include "index.h"
+#include "position.h"
+
+#include <vector>
+
+namespace cgfs
+{
+  // The geometry buffer of deferred shading: for each pixel of a canvas, what the nearest surface drawn in it so far needs
+  // to be shaded. The surfaces are drawn first (the geometry pass, whose depth test is against the depth buffer of the canvas)
+  // and only the visible ones are shaded, once per pixel (the lighting pass, see shade_deferred() in draw.h).
+  class GBuffer
+  {
+  public:
+    enum class Surface : unsigned char
+    {
+      none,  // nothing drawn in the pixel
+      flat,  // the color of the pixel is already shaded
+      phong, // the pixel is shaded from its normal, its color and its depth
+    };
+
+    explicit GBuffer(Extent2D ext);
+
+    const Extent2D& extent() const { return m_extent; }
+
+    // The coordinates are those of the canvas: (0, 0) is its center.
+    // Each of them throws std::out_of_range if the index exceeds the extent.
+
+    // the pixel has the final color col
+    void setFlat(Index2D xy, Color col);
+
+    // the pixel is to be Phong shaded, from the normal N and the color col
+    void setPhong(Index2D xy, const Vector3D& N, Color col);
+
+    Surface surface(Index2D xy) const;
+    const Vector3D& normal(Index2D xy) const;
+    Color color(Index2D xy) const;
+
+  private:
+    size_t index(Index2D xy) const;
+
+    Extent2D m_extent;
+    std::vector<Surface> m_surfaces = std::vector<Surface>(size_t(m_extent.width * m_extent.height), Surface::none);
+    std::vector<Vector3D> m_normals = std::vector<Vector3D>(m_surfaces.size());
+    std::vector<Color> m_colors = std::vector<Color>(m_surfaces.size());
+  };
+}
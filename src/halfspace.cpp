@@ -0,0 +1,369 @@
+#include "halfspace.h"
+
+#include "draw.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CGFS_HALFSPACE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CGFS_HALFSPACE_SSE2
+#endif
+
+namespace cgfs
+{
+  namespace
+  {
+    // the blocks are the depth tiles of the canvas
+    constexpr int BLOCK_SIZE = Canvas::depth_tile_size;
+    static_assert(BLOCK_SIZE == 8, "a row of a block is what a RowKernel covers");
+
+    // the largest vertex coordinate and canvas size for which the edge functions of the pixels fit in 32 bits
+    constexpr int MAX_COORDINATE = 1 << 13;
+    static_assert(detail::guard_band < MAX_COORDINATE, "the triangles clipped to the guard band are never too large");
+
+    // E(x, y) = A x + B y + C, zero on the line through an edge
+    struct EdgeFunction
+    {
+      int A = 0;
+      int B = 0;
+      int C = 0;
+
+      int at(int x, int y) const { return A * x + B * y + C; }
+    };
+
+    EdgeFunction edge_function(const Index2D& a, const Index2D& b)
+    {
+      const auto A = b.y - a.y;
+      const auto B = a.x - b.x;
+      return {A, B, -(A * a.x + B * a.y)};
+    }
+
+    // f(x, y) = f0 + dfdx x + dfdy y
+    struct Plane
+    {
+      float f0 = 0;
+      float dfdx = 0;
+      float dfdy = 0;
+
+      float at(int x, int y) const { return f0 + dfdx * x + dfdy * y; }
+    };
+
+    // The plane through the values f[i] at the vertices, i.e. the sum of f[i] weighted by the barycentric coordinates.
+    // e[i] is the edge function of the edge opposite vertex i, equal to area at that vertex.
+    // (The sums are in double: C can be too large for a float to hold exactly.)
+    Plane plane(const std::array<float, 3>& f, const std::array<EdgeFunction, 3>& e, int area)
+    {
+      auto f0 = 0.0, dfdx = 0.0, dfdy = 0.0;
+      for (size_t i = 0; i < 3; ++i)
+      {
+        f0 += static_cast<double>(f[i]) * e[i].C;
+        dfdx += static_cast<double>(f[i]) * e[i].A;
+        dfdy += static_cast<double>(f[i]) * e[i].B;
+      }
+      return {static_cast<float>(f0 / area), static_cast<float>(dfdx / area), static_cast<float>(dfdy / area)};
+    }
+
+    // Each kernel computes which of 8 consecutive pixels in a row are inside all three edges (edge functions >= 0),
+    // given the edge functions at the first one, as a mask with bit i set for the pixel i to its right.
+#if defined(CGFS_HALFSPACE_AVX2)
+    struct RowKernel
+    {
+      explicit RowKernel(const std::array<EdgeFunction, 3>& e)
+      {
+        for (size_t k = 0; k < 3; ++k)
+          steps[k] = _mm256_mullo_epi32(_mm256_set1_epi32(e[k].A), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+      }
+
+      std::uint32_t coverage(const std::array<int, 3>& E) const
+      {
+        const auto minus_one = _mm256_set1_epi32(-1);
+        auto inside = minus_one;
+        for (size_t k = 0; k < 3; ++k)
+          inside = _mm256_and_si256(inside, _mm256_cmpgt_epi32(_mm256_add_epi32(_mm256_set1_epi32(E[k]), steps[k]), minus_one));
+        return static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(inside)));
+      }
+
+      __m256i steps[3];
+    };
+#elif defined(CGFS_HALFSPACE_SSE2)
+    struct RowKernel
+    {
+      explicit RowKernel(const std::array<EdgeFunction, 3>& e)
+      {
+        for (size_t k = 0; k < 3; ++k)
+        {
+          const auto A = e[k].A;
+          lo[k] = _mm_setr_epi32(0, A, 2 * A, 3 * A);
+          hi[k] = _mm_setr_epi32(4 * A, 5 * A, 6 * A, 7 * A);
+        }
+      }
+
+      std::uint32_t coverage(const std::array<int, 3>& E) const
+      {
+        const auto minus_one = _mm_set1_epi32(-1);
+        auto inside_lo = minus_one;
+        auto inside_hi = minus_one;
+        for (size_t k = 0; k < 3; ++k)
+        {
+          const auto Ek = _mm_set1_epi32(E[k]);
+          inside_lo = _mm_and_si128(inside_lo, _mm_cmpgt_epi32(_mm_add_epi32(Ek, lo[k]), minus_one));
+          inside_hi = _mm_and_si128(inside_hi, _mm_cmpgt_epi32(_mm_add_epi32(Ek, hi[k]), minus_one));
+        }
+        const auto mask_lo = _mm_movemask_ps(_mm_castsi128_ps(inside_lo));
+        const auto mask_hi = _mm_movemask_ps(_mm_castsi128_ps(inside_hi));
+        return static_cast<std::uint32_t>(mask_lo | (mask_hi << 4));
+      }
+
+      __m128i lo[3];
+      __m128i hi[3];
+    };
+#else
+    struct RowKernel
+    {
+      explicit RowKernel(const std::array<EdgeFunction, 3>& e)
+      : A{e[0].A, e[1].A, e[2].A}
+      {}
+
+      std::uint32_t coverage(const std::array<int, 3>& E) const
+      {
+        auto mask = std::uint32_t{0};
+        for (int i = 0; i < BLOCK_SIZE; ++i)
+          if (E[0] + i * A[0] >= 0 && E[1] + i * A[1] >= 0 && E[2] + i * A[2] >= 0)
+            mask |= 1u << i;
+        return mask;
+      }
+
+      std::array<int, 3> A;
+    };
+#endif
+
+    // Rasterize the triangle p in 8x8 blocks, interpolating the attributes (attributes[0] must be 1/z) over it.
+    // fragment(row, xy, attributes at xy) is called for every pixel inside the triangle and the clip tile that passes the depth test,
+    // with the Canvas::Span of the part of its row in the block.
+    // Returns false, without drawing anything, if the coordinates are too large for the edge functions.
+    template<size_t N, typename Fragment>
+    bool rasterize(Canvas& canvas, const std::array<Index2D, 3>& p, const std::array<std::array<float, 3>, N>& attributes, const Tile& clip, DepthTest depth_test, Fragment&& fragment)
+    {
+      const auto [Cw, Ch] = canvas.extent();
+      const auto too_large = [](int c){ return std::abs(c) > MAX_COORDINATE; };
+      if (too_large(Cw) || too_large(Ch) || std::ranges::any_of(p, [&](const Index2D& v){ return too_large(v.x) || too_large(v.y); }))
+        return false;
+
+      // Everything below is relative to the bottom left corner of the bounding box of the triangle,
+      // so that the values in the blocks are the same however the triangle is clipped.
+      const auto origin = Index2D{std::min({p[0].x, p[1].x, p[2].x}), std::min({p[0].y, p[1].y, p[2].y})};
+      const auto q = std::array<Index2D, 3>{p[0] - origin, p[1] - origin, p[2] - origin};
+
+      // the pixels to draw: the bounding box clipped to the canvas and to the clip tile
+      const auto in_canvas = detail::canvas_rect(detail::whole_canvas(canvas.extent()), canvas.extent());
+      const auto in_clip = detail::canvas_rect(clip, canvas.extent());
+      const auto pixels = detail::bounding_rect(p, {std::max(in_canvas.x_min, in_clip.x_min), std::min(in_canvas.x_max, in_clip.x_max),
+                                                   std::max(in_canvas.y_min, in_clip.y_min), std::min(in_canvas.y_max, in_clip.y_max)});
+      if (detail::empty(pixels))
+        return true;
+      const auto x_first = pixels.x_min - origin.x;
+      const auto x_last = pixels.x_max - origin.x;
+      const auto y_first = pixels.y_min - origin.y;
+      const auto y_last = pixels.y_max - origin.y;
+
+      // e[i] is the edge opposite vertex i, oriented so that the inside of the triangle is where all three are positive
+      auto e = std::array<EdgeFunction, 3>{edge_function(q[1], q[2]), edge_function(q[2], q[0]), edge_function(q[0], q[1])};
+      auto area = e[0].at(q[0].x, q[0].y);
+      if (area == 0)
+        return true;
+      if (area < 0)
+      {
+        for (auto& ei : e)
+          ei = {-ei.A, -ei.B, -ei.C};
+        area = -area;
+      }
+
+      auto planes = std::array<Plane, N>{};
+      for (size_t k = 0; k < N; ++k)
+        planes[k] = plane(attributes[k], e, area);
+
+      // The largest 1/z in the pixels [x0, x1] x [y0, y1], which is at one of their corners since the plane is linear, plus
+      // a bound on the rounding errors of evaluating the plane (from the block corner to the left of x0) in either place.
+      const auto& z_plane = planes[0];
+      const auto nearest = [&](int x0, int x1, int y0, int y1){
+        const auto z = z_plane.f0 + std::max(z_plane.dfdx * x0, z_plane.dfdx * x1) + std::max(z_plane.dfdy * y0, z_plane.dfdy * y1);
+        const auto magnitude = std::abs(z_plane.f0)
+                             + std::abs(z_plane.dfdx) * static_cast<float>(std::max(std::abs(x0), std::abs(x1)) + BLOCK_SIZE)
+                             + std::abs(z_plane.dfdy) * static_cast<float>(std::max(std::abs(y0), std::abs(y1)));
+        return detail::nearest_bound(z, magnitude, 0);
+      };
+
+      const auto hierarchical = depth_test == DepthTest::hierarchical;
+      if (hierarchical && detail::hidden(canvas, nearest(x_first, x_last, y_first, y_last), pixels, true))
+        return true;
+
+      // Top-left fill rule: a pixel exactly on an edge is inside only if the edge faces one way.
+      // A shared edge faces opposite ways in its two triangles, so it belongs to exactly one of them.
+      for (auto& ei : e)
+        if (!(ei.A > 0 || (ei.A == 0 && ei.B > 0)))
+          ei.C -= 1;
+
+      // the blocks are the depth tiles, which are aligned to the top left corner of the canvas (screen coordinates)
+      const auto Cw_half = Cw/2;
+      const auto Ch_half = Ch/2;
+      const auto tx_first = (origin.x + x_first + Cw_half) / BLOCK_SIZE;
+      const auto tx_last = (origin.x + x_last + Cw_half) / BLOCK_SIZE;
+      const auto ty_first = (Ch_half - (origin.y + y_last)) / BLOCK_SIZE;
+      const auto ty_last = (Ch_half - (origin.y + y_first)) / BLOCK_SIZE;
+
+      const auto kernel = RowKernel{e};
+      for (int ty = ty_first; ty <= ty_last; ++ty)
+        for (int tx = tx_first; tx <= tx_last; ++tx)
+        {
+          // the bottom left corner of the block
+          const auto bx = tx * BLOCK_SIZE - Cw_half - origin.x;
+          const auto by = Ch_half - (ty * BLOCK_SIZE + BLOCK_SIZE - 1) - origin.y;
+
+          // the part of the block to draw
+          const auto x0 = std::max(bx, x_first);
+          const auto x1 = std::min(bx + BLOCK_SIZE - 1, x_last);
+          const auto y0 = std::max(by, y_first);
+          const auto y1 = std::min(by + BLOCK_SIZE - 1, y_last);
+
+          // the edge functions are linear, so their extremes over it are at its corners
+          bool outside = false;
+          bool inside = true;
+          for (const auto& ei : e)
+          {
+            const auto E = ei.at(x0, y0);
+            const auto E_max = E + std::max(ei.A, 0) * (x1 - x0) + std::max(ei.B, 0) * (y1 - y0);
+            const auto E_min = E + std::min(ei.A, 0) * (x1 - x0) + std::min(ei.B, 0) * (y1 - y0);
+            outside = outside || E_max < 0;
+            inside = inside && E_min >= 0;
+          }
+          if (outside)
+            continue;
+
+          if (hierarchical && detail::hidden(canvas, nearest(x0, x1, y0, y1), {origin.x + x0, origin.x + x1, origin.y + y0, origin.y + y1}, true))
+            continue;
+
+          const auto columns = ((1u << (x1 - x0 + 1)) - 1) << (x0 - bx);
+          for (int y = y0; y <= y1; ++y)
+          {
+            auto mask = inside ? columns : kernel.coverage({e[0].at(bx, y), e[1].at(bx, y), e[2].at(bx, y)}) & columns;
+            if (mask == 0)
+              continue;
+
+            const auto z_row = planes[0].at(bx, y);
+            auto row = canvas.span(origin.y + y, origin.x + x0, origin.x + x1);
+            for (; mask != 0; mask &= mask - 1)
+            {
+              const auto i = std::countr_zero(mask);
+              const auto x = bx + i;
+              const auto xy = Index2D{origin.x + x, origin.y + y};
+
+              // the other attributes are only needed for the pixels that pass the depth test
+              const auto z = z_row + planes[0].dfdx * i;
+              if (!row.testAndSetDepth(xy.x, z))
+                continue;
+
+              auto values = std::array<float, N>{z};
+              for (size_t k = 1; k < N; ++k)
+                values[k] = planes[k].at(x, y);
+
+              fragment(row, xy, values);
+            }
+          }
+        }
+
+      return true;
+    }
+
+    // rasterize() 1/z over the triangle, calling fragment(row, xy) like the scanline rasterizer does
+    bool rasterize(Canvas& canvas, const std::array<Index2D, 3>& p, const Triangle3D& triangle, const Tile& clip, DepthTest depth_test, auto&& fragment)
+    {
+      const auto& [v0, v1, v2, color] = triangle;
+
+      const auto z_inv = std::array<float, 3>{1/v0.z, 1/v1.z, 1/v2.z};
+      return rasterize<1>(canvas, p, {z_inv}, clip, depth_test, [&](Canvas::Span& row, const Index2D& xy, const std::array<float, 1>&){
+        fragment(row, xy);
+      });
+    }
+
+    // rasterize() 1/z and the normal over the triangle, calling fragment(row, xy, 1/z, N) like the scanline rasterizer does
+    bool rasterize(Canvas& canvas, const std::array<Index2D, 3>& p, const SuperTriangle3D& triangle, const Tile& clip, DepthTest depth_test, auto&& fragment)
+    {
+      const auto& [v0, v1, v2] = triangle.vertices;
+      const auto& [n0, n1, n2] = triangle.normals;
+
+      const auto attributes = std::array<std::array<float, 3>, 4>{{
+        {1/v0.z, 1/v1.z, 1/v2.z},
+        {n0.x, n1.x, n2.x},
+        {n0.y, n1.y, n2.y},
+        {n0.z, n1.z, n2.z}
+      }};
+      return rasterize(canvas, p, attributes, clip, depth_test, [&](Canvas::Span& row, const Index2D& xy, const std::array<float, 4>& values){
+        const auto& [z, nx, ny, nz] = values;
+        fragment(row, xy, z, Vector3D{nx, ny, nz});
+      });
+    }
+
+    // The part of the triangle in front of the near plane, cut into pieces inside the guard band (see detail::clip_triangle()).
+    // The pieces too large for the edge functions (on a canvas larger than the guard band) are drawn by the scanline rasterizer.
+    // A triangle that is drawn whole is drawn with its projections, if they are given, like detail::fill_triangle() does.
+    void rasterize_clipped(Canvas& canvas, const Projection& project, const auto& triangle, const std::array<Index2D, 3>* projected, const Tile& clip, DepthTest depth_test, auto&& fragment)
+    {
+      detail::clip_triangle(triangle, detail::ClipPlanes{project}, [&](const auto& piece){
+        const auto p = projected && &piece == &triangle ? *projected : detail::projections(piece, project);
+        if (!rasterize(canvas, p, piece, clip, depth_test, fragment))
+          detail::scan_triangle(canvas, piece, p, clip, depth_test, fragment);
+      });
+    }
+  }
+
+  void draw_filled_triangle_halfspace(Canvas& canvas, const Triangle3D& triangle, const Projection& project, const LightSet& lights, const Tile& clip, DepthTest depth_test, const std::array<Index2D, 3>* projected)
+  {
+    const auto shaded_color = detail::flat_intensity(triangle, lights) * triangle.col;
+    rasterize_clipped(canvas, project, triangle, projected, clip, depth_test, [&](Canvas::Span& row, const Index2D& xy){
+      row.putPixel(xy.x, shaded_color);
+    });
+  }
+
+  void draw_filled_triangle_halfspace(Canvas& canvas, const SuperTriangle3D& triangle, const Projection& project, const LightSet& lights, const Tile& clip, DepthTest depth_test, const std::array<Index2D, 3>* projected)
+  {
+    const auto& color = triangle.col;
+    const float d = project.viewport().distance;
+    rasterize_clipped(canvas, project, triangle, projected, clip, depth_test, [&](Canvas::Span& row, const Index2D& xy, float z_inv, const Vector3D& N){
+      row.putPixel(xy.x, detail::phong(xy, z_inv, d, N, lights) * color);
+    });
+  }
+
+  void draw_filled_triangle_halfspace(Canvas& canvas, const Triangle3D& triangle, const Projection& project, const LightSet& lights)
+  {
+    draw_filled_triangle_halfspace(canvas, triangle, project, lights, detail::whole_canvas(canvas.extent()));
+  }
+
+  void draw_filled_triangle_halfspace(Canvas& canvas, const SuperTriangle3D& triangle, const Projection& project, const LightSet& lights)
+  {
+    draw_filled_triangle_halfspace(canvas, triangle, project, lights, detail::whole_canvas(canvas.extent()));
+  }
+
+  void draw_filled_triangle_halfspace(Canvas& canvas, GBuffer& gbuffer, const Triangle3D& triangle, const Projection& project, const LightSet& lights, const Tile& clip, DepthTest depth_test, const std::array<Index2D, 3>* projected)
+  {
+    const auto shaded_color = detail::flat_intensity(triangle, lights) * triangle.col;
+    rasterize_clipped(canvas, project, triangle, projected, clip, depth_test, [&](Canvas::Span&, const Index2D& xy){
+      gbuffer.setFlat(xy, shaded_color);
+    });
+  }
+
+  void draw_filled_triangle_halfspace(Canvas& canvas, GBuffer& gbuffer, const SuperTriangle3D& triangle, const Projection& project, const Tile& clip, DepthTest depth_test, const std::array<Index2D, 3>* projected)
+  {
+    const auto& color = triangle.col;
+    rasterize_clipped(canvas, project, triangle, projected, clip, depth_test, [&](Canvas::Span&, const Index2D& xy, float, const Vector3D& N){
+      gbuffer.setPhong(xy, N, color);
+    });
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "canvas.h"
+#include "gbuffer.h"
+#include "index.h"
+#include "light.h"
+#include "projection.h"
+#include "tile.h"
+#include "triangle.h"
+
+#include <array>
+
+namespace cgfs
+{
+  // Rasterizers that test whole 8x8 blocks of pixels against the three edge functions of a triangle,
+  // as an alternative to the scanline draw_filled_triangle() in draw.h.
+  //
+  // Blocks entirely outside an edge are skipped and blocks entirely inside all three are filled without
+  // testing their pixels; the coverage of the other blocks is computed a row of 8 (AVX2) or 4 (SSE2)
+  // pixels at a time. 1/z and the normals are interpolated from the barycentric coordinates of the pixels.
+  //
+  // A pixel on an edge shared by two triangles belongs to exactly one of them (the top-left fill rule), so
+  // the output can differ from the scanline rasterizer by a pixel along the edges. Degenerate triangles
+  // aren't drawn. Like the scanline rasterizer, the part of a triangle behind the near plane is clipped off,
+  // and so is any part out of the guard band, which keeps the edge functions exact in 32 bits.
+
+  // the vertices of triangle are in camera coordinates
+  // the Projection operator projects from camera (3D) coordinates to canvas (2D) coordinates
+  void draw_filled_triangle_halfspace(Canvas& canvas, const Triangle3D& triangle, const Projection& project, const LightSet& lights = {});
+
+  // the vertices of triangle are in camera coordinates
+  // the Projection operator projects from camera (3D) coordinates to canvas (2D) coordinates
+  void draw_filled_triangle_halfspace(Canvas& canvas, const SuperTriangle3D& triangle, const Projection& project, const LightSet& lights = {});
+
+  // Only the pixels in the clip tile are drawn, with the same values as if the whole triangle was drawn.
+  // With DepthTest::hierarchical, the triangle and the blocks of it that are hidden behind the depth tiles of the canvas are skipped.
+  // projected, if not null, are the projections of the vertices by project, computed already (see draw_filled_triangle()).
+  void draw_filled_triangle_halfspace(Canvas& canvas, const Triangle3D& triangle, const Projection& project, const LightSet& lights, const Tile& clip, DepthTest depth_test = DepthTest::hierarchical, const std::array<Index2D, 3>* projected = nullptr);
+  void draw_filled_triangle_halfspace(Canvas& canvas, const SuperTriangle3D& triangle, const Projection& project, const LightSet& lights, const Tile& clip, DepthTest depth_test = DepthTest::hierarchical, const std::array<Index2D, 3>* projected = nullptr);
+
+  // The geometry pass of deferred shading, like the draw_filled_triangle() overloads with a GBuffer in draw.h
+  void draw_filled_triangle_halfspace(Canvas& canvas, GBuffer& gbuffer, const Triangle3D& triangle, const Projection& project, const LightSet& lights, const Tile& clip, DepthTest depth_test = DepthTest::hierarchical, const std::array<Index2D, 3>* projected = nullptr);
+  void draw_filled_triangle_halfspace(Canvas& canvas, GBuffer& gbuffer, const SuperTriangle3D& triangle, const Projection& project, const Tile& clip, DepthTest depth_test = DepthTest::hierarchical, const std::array<Index2D, 3>* projected = nullptr);
+}
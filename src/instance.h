@@ -3,12 +3,45 @@
 #include "mesh.h"
 #include "sp3/transform.h"
 
+#include <memory>
+#include <utility>
+
 namespace cgfs
 {
+  // A model placed in the world: the model is shared, immutable, by all the instances that are made from the same handle,
+  // so a scene takes as much memory as its different models, however many instances there are of each
   template<typename TModel = Mesh>
   struct Instance
   {
-    TModel model = {};
+    std::shared_ptr<const TModel> model = empty_model(); // never null
     sp3::transform transform = {};
+
+    Instance() = default;
+
+    Instance(std::shared_ptr<const TModel> shared_model, sp3::transform instance_transform = {})
+    : model{std::move(shared_model)}
+    , transform{std::move(instance_transform)}
+    {}
+
+    // an instance with a model of its own
+    Instance(TModel own_model, sp3::transform instance_transform = {})
+    : model{std::make_shared<const TModel>(std::move(own_model))}
+    , transform{std::move(instance_transform)}
+    {}
+
+  private:
+    // the one model of all the default instances, made once
+    static const std::shared_ptr<const TModel>& empty_model()
+    {
+      static const auto empty = std::make_shared<const TModel>();
+      return empty;
+    }
   };
+
+  // A handle to the model, for instances to share
+  template<typename TModel>
+  std::shared_ptr<const TModel> share(TModel model)
+  {
+    return std::make_shared<const TModel>(std::move(model));
+  }
 }
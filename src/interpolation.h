@@ -2,15 +2,19 @@
 
 #include "index.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
 #include <vector>
 
 namespace cgfs
 {
   // Interpolate between the dependent variables d0 and d1 along the 'axis' of the independent variables i0 and i1
   // Returns a vector of (i1-i0)+1 values in the range[d0, d1)
-  std::vector<int> interpolate(int i0, int d0, int i1, int d1)
+  inline std::vector<int> interpolate(int i0, int d0, int i1, int d1)
   {
     assert(i1 >= i0);
 	  
@@ -44,51 +48,188 @@ namespace cgfs
 
   namespace detail
   {
-      // Interpolate between two points a and b along the x-axis 
-      inline std::vector<Index2D> interpolate_x(const Index2D& a, const Index2D& b, float slope)
+    // The values d0, d0 + a, d0 + a + a, ... one at a time.
+    // The values are accumulated by repeated addition, like interpolate() and interpolatef() do, so they are the same bit for bit.
+    template<typename T>
+    class Stepper
+    {
+    public:
+      Stepper() = default;
+      Stepper(const T& d0, const T& a) : m_value{d0}, m_slope{a} {}
+
+      const T& value() const { return m_value; }
+      void step() { m_value += m_slope; }
+
+      // move on by k values, adding a k times: d0 + k a would round differently from k steps
+      void advance(int k)
       {
-        if(b.x < a.x) // make sure a.x < b.x
-          return interpolate_x(b, a, slope);
-        
-        std::vector<Index2D> result;
-        result.reserve(b.x - a.x + 1);
-        
-        auto y = static_cast<float>(a.y);
-        const auto dy = slope;
-        for (auto x = a.x; x <= b.x; ++x, y+=dy)
-          result.push_back({x, static_cast<int>(std::round(y))});
-        
-        return result;
+        for (; k > 0; --k)
+          m_value += m_slope;
       }
-      
-      // Interpolate between two points a and b along the y-axis 
-      inline std::vector<Index2D> interpolate_y(const Index2D& a, const Index2D& b, float slope)
+
+    private:
+      T m_value = {};
+      T m_slope = {};
+    };
+
+    // the values of interpolatef(i0, d0, i1, d1), without allocating
+    template<typename T>
+    Stepper<T> stepper(int i0, const T& d0, int i1, const T& d1)
+    {
+      assert(i1 >= i0);
+      return {d0, i1 != i0 ? T{(d1 - d0) / (i1 - i0)} : T{}};
+    }
+
+    // the values of interpolate(i0, d0, i1, d1) before rounding, without allocating
+    inline Stepper<float> rounding_stepper(int i0, int d0, int i1, int d1)
+    {
+      assert(i1 >= i0);
+      return {static_cast<float>(d0), i1 != i0 ? static_cast<float>(d1 - d0) / (i1 - i0) : 0.f};
+    }
+
+    // the value of interpolate() from the value of a rounding_stepper()
+    inline int round(float d)
+    {
+      return static_cast<int>(std::round(d));
+    }
+
+    // One side of a triangle whose vertices are sorted by y, stepped one row at a time from y0 to y2:
+    // either the long side (from vertex 0 to 2), or the short sides (from vertex 0 to 1, then from 1 to 2).
+    // The values of the short sides are those of interpolating over 01 up to y1 and over 12 from y1 on,
+    // as the rasterizer concatenates them.
+    template<typename T>
+    class TriangleSide
+    {
+    public:
+      // the long side
+      explicit TriangleSide(const Stepper<T>& side) : m_side{side} {}
+
+      // the short sides: 'first' for the rows [y0, y1), then 'second'
+      TriangleSide(const Stepper<T>& first, int y0, int y1, const Stepper<T>& second)
+      : m_side{y1 == y0 ? second : first}
+      , m_next{second}
+      , m_rows_left{y1 - y0}
+      {}
+
+      const T& value() const { return m_side.value(); }
+
+      // move on to the next row
+      void step()
       {
-        if(b.y < a.y) // make sure a.y < b.y
-          return interpolate_y(b, a, slope);
-  
-        std::vector<Index2D> result;
-        result.reserve(b.y - a.y + 1);
-        
-        auto x = static_cast<float>(a.x);
-        const auto dx = 1.f / slope;
-        
-        for (auto y = a.y; y <= b.y; ++y, x+=dx)
-          result.push_back({static_cast<int>(std::round(x)), y});
-  
-        return result;
+        if (m_rows_left > 0 && --m_rows_left == 0)
+          m_side = m_next;
+        else
+          m_side.step();
+      }
+
+      // move on by k >= 0 rows, switching to the second short side on the way if it is reached (the same as k steps)
+      void advance(int k)
+      {
+        if (m_rows_left > 0 && k >= m_rows_left)
+        {
+          k -= m_rows_left;
+          m_rows_left = 0;
+          m_side = m_next;
+        }
+        else if (m_rows_left > 0)
+          m_rows_left -= k;
+        m_side.advance(k);
+      }
+
+      // the value k rows further down, leaving this side where it is
+      T value_after(int k) const
+      {
+        auto side = *this;
+        side.advance(k);
+        return side.value();
+      }
+
+    private:
+      Stepper<T> m_side;
+      Stepper<T> m_next;
+      int m_rows_left = 0; // before switching to m_next
+    };
+
+    // n / d rounded to the nearest integer for d > 0, halves away from zero like std::round()
+    inline std::int64_t round_div(std::int64_t n, std::int64_t d)
+    {
+      return n >= 0 ? (2 * n + d) / (2 * d) : -((-2 * n + d) / (2 * d));
+    }
+
+    // Bresenham's algorithm: for the line from (i0, m0) to (i0 + di, m0 + dm) with |dm| <= di, calls pixel(i, m) for
+    // each i in [first, last] (a part of [i0, i0 + di]), m being the exact value on the line rounded like round_div() does.
+    // Only integers are added up, so the pixels are the same whichever end the line is drawn from.
+    inline void bresenham(int i0, int m0, int di, int dm, int first, int last, auto&& pixel)
+    {
+      assert(std::abs(dm) <= di || di == 0);
+      if (last < first)
+        return;
+      if (di == 0)
+        return pixel(i0, m0);
+
+      // the exact value at first is n / di, e = 2 (n - m di) is what was rounded off (times 2 di): m is rounded to the
+      // next value once e is past di, or at di for the halves that round away from zero
+      const auto n = std::int64_t{m0} * di + std::int64_t{first - i0} * dm;
+      auto m = round_div(n, di);
+      auto e = 2 * (n - m * di);
+      const auto step = 2 * std::int64_t{dm};
+      const auto wrap = 2 * std::int64_t{di};
+      const auto round_up = [&]{ return e > di || (e == di && m >= 0); };
+      const auto round_down = [&]{ return e < -di || (e == -di && m <= 0); };
+      // m moves one way only, by at most one at a time (as |dm| <= di)
+      if (dm >= 0)
+        for (auto i = first; ; ++i)
+        {
+          pixel(i, static_cast<int>(m));
+          if (i == last)
+            break;
+          for (e += step; round_up(); e -= wrap)
+            ++m;
+        }
+      else
+        for (auto i = first; ; ++i)
+        {
+          pixel(i, static_cast<int>(m));
+          if (i == last)
+            break;
+          for (e += step; round_down(); e += wrap)
+            --m;
+        }
+    }
+
+    // Calls pixel(xy) for the pixels of the line from a to b in the box [lo.x, hi.x] x [lo.y, hi.y], in order of increasing x
+    // (or y, if the line is vertical-ish). The line is clipped to the box along its major axis before it is stepped along.
+    inline void line_pixels(const Index2D& a, const Index2D& b, const Index2D& lo, const Index2D& hi, auto&& pixel)
+    {
+      const auto [dx, dy] = b - a;
+      if (std::abs(dy) < std::abs(dx)) // the line is horizontal-ish
+      {
+        const auto& [p, q] = dx > 0 ? std::pair{a, b} : std::pair{b, a};
+        bresenham(p.x, p.y, q.x - p.x, q.y - p.y, std::max(lo.x, p.x), std::min(hi.x, q.x), [&](int x, int y){
+          if (lo.y <= y && y <= hi.y)
+            pixel(Index2D{x, y});
+        });
+      }
+      else // the line is vertical-ish
+      {
+        const auto& [p, q] = dy > 0 ? std::pair{a, b} : std::pair{b, a};
+        bresenham(p.y, p.x, q.y - p.y, q.x - p.x, std::max(lo.y, p.y), std::min(hi.y, q.y), [&](int y, int x){
+          if (lo.x <= x && x <= hi.x)
+            pixel(Index2D{x, y});
+        });
       }
     }
-  
+  }
+
+  // The pixels of the line from a to b, one for each column (or row, if the line is vertical-ish) between them
   inline std::vector<Index2D> interpolate(const Index2D& a, const Index2D& b)
   {
     const auto [dx, dy] = b - a;
-    // TODO: handle case where dx = 0
-    const auto slope = static_cast<float>(dy) / dx;
-
-    if (std::abs(slope) < 1) // line is horizontal-ish
-        return detail::interpolate_x(a, b, slope);
-    else // line is vertical-ish
-        return detail::interpolate_y(a, b, slope);
-  }  
-}
\ No newline at end of file
+    auto result = std::vector<Index2D>{};
+    result.reserve(std::max(std::abs(dx), std::abs(dy)) + 1);
+    constexpr auto lo = std::numeric_limits<int>::min();
+    constexpr auto hi = std::numeric_limits<int>::max();
+    detail::line_pixels(a, b, {lo, lo}, {hi, hi}, [&](const Index2D& p){ result.push_back(p); });
+    return result;
+  }
+}
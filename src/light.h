@@ -3,81 +3,17 @@
 #include "position.h"
 #include "ray.h"
 
-#include <memory>
-#include <numeric>
+#include <cassert>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <variant>
 #include <vector>
 
 namespace cgfs
 {
-    class Light
-    {
-    public:
-        template <typename T>
-        Light(T t)
-        : m_light{std::make_unique<owner_t<T>>(std::move(t))}
-        {}
-
-        Light(const Light& other)
-        : m_light{other.m_light->clone()}
-        {}
-
-        Light& operator=(const Light& other)
-        {
-            Light copy{other};
-            m_light.swap(copy.m_light);
-            return *this;
-        }
-
-        Light(Light&&) = default;
-        Light& operator=(Light&&) = default;
-
-        ~Light() = default;
-
-        float intensity(const SurfacePoint& sp, const Vector3D& V = {}) const
-        {
-            return m_light->intensity2(sp, V);
-        }
-
-        Ray3D back_ray(const Position3D& P) const
-        {
-            return m_light->back_ray(P);
-        }
-
-    private:
-        struct light_concept_t
-        {
-            virtual ~light_concept_t() = default;
-            virtual std::unique_ptr<light_concept_t> clone() const = 0;
-            virtual float intensity2(const SurfacePoint& sp, const Vector3D& V) const = 0;
-            virtual Ray3D back_ray(const Position3D& P) const = 0;
-        };
-
-        template <typename Owned>
-        struct owner_t : public light_concept_t
-        {
-            Owned o;
-
-            owner_t(Owned o) : o{std::move(o)}{}
-
-            std::unique_ptr<light_concept_t> clone() const override
-            {
-                return std::make_unique<owner_t>(*this);
-            }
-
-            float intensity2(const SurfacePoint& sp, const Vector3D& V) const override
-            {
-                return o.intensity(sp, V);
-            }
-
-            Ray3D back_ray(const Position3D& P) const override
-            {
-                return o.back_ray(P);
-            }
-        };
-
-        std::unique_ptr<light_concept_t> m_light;
-    };
-    
     class AmbientLight
     {
       public:
@@ -125,41 +61,206 @@ namespace cgfs
     class PointLight
     {
       public:
-        PointLight(float intensity, Position3D pos) : position{pos}, intensity_{intensity} {}
+        PointLight(float intensity, Position3D pos) : position_{pos}, intensity_{intensity} {}
 
         float intensity(const SurfacePoint& sp, const Vector3D& V = {}) const
         {
-            return detail::calculate_intensity(intensity_, position - sp.pos, sp.normal, sp.specularity, V);
+            return detail::calculate_intensity(intensity_, position_ - sp.pos, sp.normal, sp.specularity, V);
         }
 
+        // the intensity of the light source
+        float intensity() const { return intensity_; }
+        const Position3D& position() const { return position_; }
+
         Ray3D back_ray(const Position3D& P) const
         {
-            return {P, position - P, 0.0f,  1.0f};
+            return {P, position_ - P, 0.0f,  1.0f};
         }
 
       private:
-        Position3D position;
+        Position3D position_;
         float intensity_;
     };
 
     class DirectionalLight
     {
       public:
-        DirectionalLight(float intensity, Vector3D dir) : direction{dir}, intensity_{intensity} {}
+        DirectionalLight(float intensity, Vector3D dir) : direction_{dir}, intensity_{intensity} {}
 
         float intensity(const SurfacePoint& sp, const Vector3D& V = {}) const
         {
-            return detail::calculate_intensity(intensity_, direction, sp.normal, sp.specularity, V);
+            return detail::calculate_intensity(intensity_, direction_, sp.normal, sp.specularity, V);
         }
 
+        // the intensity of the light source
+        float intensity() const { return intensity_; }
+        const Vector3D& direction() const { return direction_; }
+
         Ray3D back_ray(const Position3D& P) const
         {
-            return {P, direction, 0.0f, std::numeric_limits<float>::infinity()};
+            return {P, direction_, 0.0f, std::numeric_limits<float>::infinity()};
         }
 
       private:
-        Vector3D direction;
+        Vector3D direction_;
         float intensity_;
     };
-    
-} // namespace cgfs
\ No newline at end of file
+
+    // One of the kinds of light sources, as a value: copying a Light doesn't allocate
+    class Light
+    {
+    public:
+        using variant_type = std::variant<AmbientLight, PointLight, DirectionalLight>;
+
+        template <typename T>
+        requires std::same_as<T, AmbientLight> || std::same_as<T, PointLight> || std::same_as<T, DirectionalLight>
+        Light(T t)
+        : m_light{std::move(t)}
+        {}
+
+        float intensity(const SurfacePoint& sp, const Vector3D& V = {}) const
+        {
+            return std::visit([&](const auto& light){ return light.intensity(sp, V); }, m_light);
+        }
+
+        Ray3D back_ray(const Position3D& P) const
+        {
+            return std::visit([&](const auto& light){ return light.back_ray(P); }, m_light);
+        }
+
+        const variant_type& variant() const { return m_light; }
+
+    private:
+        variant_type m_light;
+    };
+
+    // The lights of a scene sorted by kind, each kind in contiguous arrays of floats, one for each of its coordinates
+    // and one for the intensities (a structure of arrays).
+    //
+    // intensity() adds up the lights kind by kind, each kind in one loop over its arrays, without a virtual call, a switch
+    // or a callback per light: first the ambient lights (summed up once, when the set is made), then the point lights, then
+    // the directional lights, each in the order they were given. Float addition is not associative, so unless the lights
+    // were given in that order, the sum can differ in its last bits from adding up the lights of the std::vector<Light> one
+    // by one.
+    // Making a set allocates: make it once (e.g. once per frame, as render_scene() does), not once per model.
+    class LightSet
+    {
+    public:
+        LightSet() = default;
+
+        explicit LightSet(const std::vector<Light>& lights)
+        {
+            for (const auto& light : lights)
+            {
+                if (const auto* ambient = std::get_if<AmbientLight>(&light.variant()))
+                    m_ambient += ambient->intensity();
+                else if (const auto* point = std::get_if<PointLight>(&light.variant()))
+                    m_point.push_back(point->position() - Position3D{0, 0, 0}, point->intensity());
+                else
+                {
+                    const auto& directional = std::get<DirectionalLight>(light.variant());
+                    m_directional.push_back(directional.direction(), directional.intensity());
+                }
+                ++m_size;
+            }
+        }
+
+        bool empty() const { return m_size == 0; }
+        size_t size() const { return m_size; }
+
+        // the number of lights that can be blocked, i.e. the point and directional lights
+        size_t num_blockable() const { return m_point.size() + m_directional.size(); }
+
+        // the intensity of the light reaching sp, viewed from V, leaving out the lights that are blocked
+        // blocked is either empty (none of them is) or has a flag for each of the num_blockable() lights, in the order of
+        // for_each_back_ray()
+        float intensity(const SurfacePoint& sp, const Vector3D& V = {}, std::span<const unsigned char> blocked = {}) const
+        {
+            assert(blocked.empty() || blocked.size() == num_blockable());
+            const auto blocked_points = blocked.empty() ? blocked : blocked.first(m_point.size());
+            const auto blocked_directionals = blocked.empty() ? blocked : blocked.subspan(m_point.size());
+            auto i = m_ambient;
+            i = add<true>(m_point, sp, V, blocked_points, i);
+            i = add<false>(m_directional, sp, V, blocked_directionals, i);
+            return i;
+        }
+
+        // call f(k, back_ray) for each of the num_blockable() lights, with its back_ray() from P
+        template <typename F>
+        void for_each_back_ray(const Position3D& P, F&& f) const
+        {
+            auto k = size_t{0};
+            for (size_t j = 0; j < m_point.size(); ++j)
+                f(k++, Ray3D{P, Position3D{m_point.x[j], m_point.y[j], m_point.z[j]} - P, 0.0f, 1.0f});
+            for (size_t j = 0; j < m_directional.size(); ++j)
+                f(k++, Ray3D{P, Vector3D{m_directional.x[j], m_directional.y[j], m_directional.z[j]}, 0.0f, std::numeric_limits<float>::infinity()});
+        }
+
+    private:
+        // lights of one kind, a coordinate at a time
+        struct Lights
+        {
+            std::vector<float> x; // of the positions of point lights, or the directions of directional lights
+            std::vector<float> y;
+            std::vector<float> z;
+            std::vector<float> intensity;
+
+            size_t size() const { return intensity.size(); }
+
+            void push_back(const Vector3D& v, float i)
+            {
+                x.push_back(v.x);
+                y.push_back(v.y);
+                z.push_back(v.z);
+                intensity.push_back(i);
+            }
+        };
+
+        // i plus the lights that are not blocked, one after the other: the point lights at (x, y, z), or the directional
+        // lights towards (x, y, z)
+        // The terms are those of detail::calculate_intensity(), operation for operation, so that the sum is the same.
+        template <bool at_position>
+        static float add(const Lights& lights, const SurfacePoint& sp, const Vector3D& V, std::span<const unsigned char> blocked, float i)
+        {
+            const auto Nx = sp.normal.x, Ny = sp.normal.y, Nz = sp.normal.z;
+            const auto Vx = V.x, Vy = V.y, Vz = V.z;
+            const auto length_N = std::sqrt(Nx * Nx + Ny * Ny + Nz * Nz);
+            const auto length_V = std::sqrt(Vx * Vx + Vy * Vy + Vz * Vz);
+            const auto s = sp.specularity;
+            const auto* x = lights.x.data();
+            const auto* y = lights.y.data();
+            const auto* z = lights.z.data();
+            const auto* intensity = lights.intensity.data();
+            for (size_t j = 0; j < lights.size(); ++j)
+            {
+                if (!blocked.empty() && blocked[j])
+                    continue;
+
+                // L: the direction to the light
+                const auto Lx = at_position ? x[j] - sp.pos.x : x[j];
+                const auto Ly = at_position ? y[j] - sp.pos.y : y[j];
+                const auto Lz = at_position ? z[j] - sp.pos.z : z[j];
+                const auto dotLN = Lx * Nx + Ly * Ny + Lz * Nz;
+                auto light = 0.f;
+                if (dotLN > 0) // diffuse
+                    light += intensity[j] * dotLN / (std::sqrt(Lx * Lx + Ly * Ly + Lz * Lz) * length_N);
+                if (s != -1) // specular
+                {
+                    const auto Rx = 2 * dotLN * Nx - Lx;
+                    const auto Ry = 2 * dotLN * Ny - Ly;
+                    const auto Rz = 2 * dotLN * Nz - Lz;
+                    const auto length_R = std::sqrt(Rx * Rx + Ry * Ry + Rz * Rz);
+                    light += intensity[j] * static_cast<float>(std::pow((Rx * Vx + Ry * Vy + Rz * Vz) / (length_R * length_V), s));
+                }
+                i += light;
+            }
+            return i;
+        }
+
+        float m_ambient = 0; // the sum of the ambient lights, which are the same everywhere
+        Lights m_point;
+        Lights m_directional;
+        size_t m_size = 0;
+    };
+
+} // namespace cgfs
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "bounding_sphere.h"
+#include "projection.h"
+#include "simplify.h"
+
+#include "sp3/transform.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace cgfs
+{
+  namespace detail
+  {
+    // The model made of the faces left in s, on the vertices they are left with. The faces keep their colors, and the corners
+    // take the normals of their source corners (for a MultiNormalMesh): those of the vertices they are moved onto, if they are.
+    // The vertices (and normals) that no face uses any more are dropped.
+    template<typename TModel>
+    TModel simplified_model(const TModel& model, const SimplifiedFaces& s)
+    {
+      constexpr auto unused = std::numeric_limits<size_t>::max();
+      auto level = TModel{};
+
+      auto vertex_index = std::vector<size_t>(model.vertices.size(), unused);
+      const auto vertex = [&](size_t v){
+        if (vertex_index[v] == unused)
+        {
+          vertex_index[v] = level.vertices.size();
+          level.vertices.push_back(model.vertices[v]);
+        }
+        return vertex_index[v];
+      };
+
+      // (for a MultiNormalMesh)
+      auto normal_index = std::vector<size_t>{};
+      if constexpr (requires { model.normals; })
+        normal_index.resize(model.normals.size(), unused);
+
+      level.faces.reserve(s.faces.size());
+      for (size_t k = 0; k < s.faces.size(); ++k)
+      {
+        auto face = model.faces[s.faces[k]];
+        face.a = vertex(s.corners[k][0]);
+        face.b = vertex(s.corners[k][1]);
+        face.c = vertex(s.corners[k][2]);
+        if constexpr (requires { face.na; })
+        {
+          const auto source_normal = [&](size_t corner){
+            const auto& source = model.faces[corner / 3];
+            return std::array{source.na, source.nb, source.nc}[corner % 3];
+          };
+          const auto normals = std::array{&face.na, &face.nb, &face.nc};
+          for (size_t i = 0; i < 3; ++i)
+          {
+            const auto n = source_normal(s.sources[k][i]);
+            if (normal_index[n] == unused)
+            {
+              normal_index[n] = level.normals.size();
+              level.normals.push_back(model.normals[n]);
+            }
+            *normals[i] = normal_index[n];
+          }
+        }
+        level.faces.push_back(face);
+      }
+      level.update();
+      // (as many as the model has)
+      if constexpr (requires { model.meshlets; })
+        if (!model.meshlets.empty())
+          level.build_meshlets();
+      return level;
+    }
+  }
+
+  struct LodOptions
+  {
+    float ratio = 0.5f;    // of the number of faces of a level to the number of faces of the one before
+    size_t min_faces = 32; // of the coarsest level
+    size_t max_levels = 8; // including the model itself
+  };
+
+  // A model and its levels of detail: versions of it simplified further and further, to draw instead of it where the
+  // difference doesn't show. It is drawn like the model by render_scene(), which draws one of its levels for each instance
+  // (see select()).
+  template<typename TModel>
+  struct LodChain
+  {
+    std::vector<TModel> levels; // levels[0] is the model, each of the next ones has fewer faces than the one before
+    std::vector<float> errors;  // how far the surface of each level may be from the model's, in model coordinates
+    BoundingSphere bounds = {}; // of the model
+
+    // The coarsest level whose error is at most max_error pixels where it is projected by P, M being the transformation from
+    // model to camera coordinates. The error is taken at the nearest point of the bounding sphere, so the level is the same
+    // as the model, to within max_error pixels, all over it.
+    const TModel& select(const Projection& P, const sp3::transform& M, float max_error) const
+    {
+      const auto sphere = transform_sphere(M, bounds);
+      const auto z = sphere.center.z - sphere.radius;
+      if (levels.size() == 1 || bounds.radius <= 0 || z <= 0)
+        return levels.front();
+
+      // the number of pixels a unit of length in model coordinates is projected to, at most
+      const auto& [Cw, Ch] = P.canvas_dimensions();
+      const auto& [Vw, Vh] = P.viewport().size;
+      const auto pixels = sphere.radius / bounds.radius * P.viewport().distance / z * std::max(float(Cw) / Vw, float(Ch) / Vh);
+
+      auto level = size_t{0};
+      while (level + 1 < levels.size() && errors[level + 1] * pixels <= max_error)
+        ++level;
+      return levels[level];
+    }
+  };
+
+  // The levels of detail of the model, simplified with simplify(), down to options.ratio of the faces of the level before each
+  // time. The chain stops early where the model can't be simplified any further.
+  template<typename TModel>
+  LodChain<TModel> make_lod_chain(TModel model, const LodOptions& options = {})
+  {
+    auto faces = std::vector<std::array<size_t, 3>>{};
+    faces.reserve(model.faces.size());
+    for (const auto& f : model.faces)
+      faces.push_back({f.a, f.b, f.c});
+
+    auto face_counts = std::vector<size_t>{};
+    auto count = static_cast<float>(model.faces.size());
+    while (face_counts.size() + 1 < options.max_levels && static_cast<size_t>(count * options.ratio) >= options.min_faces)
+    {
+      count *= options.ratio;
+      face_counts.push_back(static_cast<size_t>(count));
+    }
+    const auto simplified = simplify(model.vertices, faces, face_counts);
+
+    auto chain = LodChain<TModel>{};
+    chain.bounds = model.bounds;
+    chain.levels.reserve(simplified.size() + 1);
+    chain.levels.push_back(std::move(model));
+    chain.errors.push_back(0);
+    for (const auto& s : simplified)
+    {
+      if (s.faces.size() >= chain.levels.back().faces.size())
+        break;
+      chain.levels.push_back(detail::simplified_model(chain.levels.front(), s));
+      chain.errors.push_back(s.error);
+    }
+    return chain;
+  }
+}
@@ -1,17 +1,139 @@
 #pragma once
 
+#include "bounding_sphere.h"
 #include "color.h"
+#include "index.h"
+#include "meshlet.h"
 #include "position.h"
 #include "triangle.h"
+#include "vertex_transform.h"
 
 #include "sp3/transform.h"
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
 #include <ranges>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 namespace cgfs
 {
+  // Which way a face of a model faces, in model coordinates, for back-face culling before its vertices are transformed
+  struct FaceNormal
+  {
+    Position3D point = {}; // on the face (or its center)
+    Vector3D normal = {};
+
+    // Is the face turned away from a camera at eye (in model coordinates)?
+    // The same test as detail::is_back_facing() (see render.h) in camera coordinates.
+    bool back_facing(const Position3D& eye) const
+    {
+      return sp3::dot(normal, point - eye) > 0;
+    }
+  };
+
+  // An edge of the wireframe of a model: its two vertices, by index, and its color
+  struct MeshEdge
+  {
+    size_t a;
+    size_t b;
+    Color col;
+  };
+
+  namespace detail
+  {
+    // Each edge of the faces once, in the color of the last face that has it.
+    // The edges are in the order of their last appearance in the faces (taking the edges of a face as ab, bc, ca),
+    // so drawing them covers every pixel in the color that drawing the edges of every face would leave there.
+    std::vector<MeshEdge> unique_edges(const auto& faces)
+    {
+      struct Appearance
+      {
+        size_t lo;
+        size_t hi;
+        size_t order;
+        MeshEdge edge;
+      };
+
+      auto appearances = std::vector<Appearance>{};
+      appearances.reserve(3 * faces.size());
+      for (const auto& f : faces)
+        for (const auto& [a, b] : {std::pair{f.a, f.b}, std::pair{f.b, f.c}, std::pair{f.c, f.a}})
+          appearances.push_back({std::min(a, b), std::max(a, b), appearances.size(), {a, b, f.col}});
+
+      // the last appearance of each edge
+      std::ranges::sort(appearances, {}, [](const Appearance& e){ return std::tuple{e.lo, e.hi, e.order}; });
+      auto last = std::vector<Appearance>{};
+      for (size_t i = 0; i < appearances.size(); ++i)
+        if (i + 1 == appearances.size() || appearances[i].lo != appearances[i + 1].lo || appearances[i].hi != appearances[i + 1].hi)
+          last.push_back(appearances[i]);
+      std::ranges::sort(last, {}, &Appearance::order);
+
+      auto edges = std::vector<MeshEdge>{};
+      edges.reserve(last.size());
+      for (const auto& e : last)
+        edges.push_back(e.edge);
+      return edges;
+    }
+
+    // the normals of the planes of the faces, through their first vertices
+    std::vector<FaceNormal> plane_normals(const std::vector<Position3D>& vertices, const auto& faces)
+    {
+      auto normals = std::vector<FaceNormal>{};
+      normals.reserve(faces.size());
+      for (const auto& f : faces)
+      {
+        const auto& a = vertices[f.a];
+        normals.push_back({a, sp3::cross(vertices[f.b] - a, vertices[f.c] - a)});
+      }
+      return normals;
+    }
+
+    // the meshlets of the faces, with the cones of the normals they are culled by
+    std::vector<Meshlet> face_meshlets(const std::vector<Position3D>& vertices, const auto& faces, const std::vector<FaceNormal>& face_normals)
+    {
+      auto corners = std::vector<std::array<size_t, 3>>{};
+      corners.reserve(faces.size());
+      for (const auto& f : faces)
+        corners.push_back({f.a, f.b, f.c});
+      auto normals = std::vector<Vector3D>{};
+      normals.reserve(face_normals.size());
+      for (const auto& n : face_normals)
+        normals.push_back(n.normal);
+      return make_meshlets(vertices, corners, normals);
+    }
+
+    // the averages of the normals at the vertices of the faces, at their centers
+    std::vector<FaceNormal> average_normals(const std::vector<Position3D>& vertices, const std::vector<Vector3D>& vertex_normals, const auto& faces)
+    {
+      auto normals = std::vector<FaceNormal>{};
+      normals.reserve(faces.size());
+      for (const auto& f : faces)
+        normals.push_back({
+          (vertices[f.a] + vertices[f.b] + vertices[f.c]) / 3,
+          (vertex_normals[f.na] + vertex_normals[f.nb] + vertex_normals[f.nc]) / 3
+        });
+      return normals;
+    }
+  }
+
+  // The vertices (and normals) of a model with a transform applied to them once each, rather than once for each face that
+  // shares them (as a batch for large models, see transform_points()), and their projections on the canvas (see render.h),
+  // for the faces to gather by index, and the faces that are drawn.
+  // The buffers keep their capacity, so one cache can be reused for model after model.
+  struct VertexCache
+  {
+    std::vector<Position3D> vertices;
+    std::vector<Vector3D> normals;
+    std::vector<Index2D> projected;
+    std::vector<std::uint32_t> faces; // the faces to draw, by index (see render_model() in render.h)
+    std::vector<std::uint64_t> face_bits; // which faces to draw, while they are listed (see front_faces() in render.h)
+  };
+
   struct Mesh
   {
     struct TFace
@@ -23,6 +145,18 @@ namespace cgfs
     };
     std::vector<Position3D> vertices;
     std::vector<TFace> faces;
+    // The bounds, the face normals and the edges are computed when the mesh is made: call update() after changing its
+    // vertices or faces. A Mesh has no meshlets: its faces are culled one by one (see front_faces() in render.h).
+    BoundingSphere bounds = bounding_sphere(vertices);
+    std::vector<FaceNormal> face_normals = detail::plane_normals(vertices, faces);
+    std::vector<MeshEdge> edges = detail::unique_edges(faces);
+
+    void update()
+    {
+      bounds = bounding_sphere(vertices);
+      face_normals = detail::plane_normals(vertices, faces);
+      edges = detail::unique_edges(faces);
+    }
 
     // faces as triangles (Triangle3D) in model space
     auto triangles() const
@@ -46,6 +180,22 @@ namespace cgfs
       };
       return faces | std::ranges::views::transform(to_triangle);
     }
+
+    // apply xform to the vertices, into the cache
+    void transform(VertexCache& cache, const sp3::transform& xform) const
+    {
+      cache.vertices.resize(vertices.size());
+      transform_points(xform, vertices, cache.vertices);
+    }
+
+    // faces as triangles (Triangle3D), gathered from the vertices transformed into the cache
+    auto triangles(const VertexCache& cache) const
+    {
+      const auto to_triangle = [&cache](const TFace& t){
+        return Triangle3D{cache.vertices[t.a], cache.vertices[t.b], cache.vertices[t.c], t.col};
+      };
+      return faces | std::ranges::views::transform(to_triangle);
+    }
   };
 
   struct MultiNormalMesh
@@ -63,6 +213,27 @@ namespace cgfs
     std::vector<Position3D> vertices;
     std::vector<Vector3D> normals;
     std::vector<TFace> faces;
+    // The bounds and the face normals (the averages of the normals at their vertices) are computed when the mesh is made:
+    // call update() after changing its vertices, normals or faces.
+    BoundingSphere bounds = bounding_sphere(vertices);
+    std::vector<FaceNormal> face_normals = detail::average_normals(vertices, normals, faces);
+    // The meshlets, which are culled before their faces are (see front_faces() in render.h), are only made by
+    // build_meshlets(), for the models with enough faces to be worth it; without them, the faces are culled one by one.
+    std::vector<Meshlet> meshlets = {};
+
+    // (and the meshlets, if the mesh has them)
+    void update()
+    {
+      bounds = bounding_sphere(vertices);
+      face_normals = detail::average_normals(vertices, normals, faces);
+      if (!meshlets.empty())
+        build_meshlets();
+    }
+
+    void build_meshlets()
+    {
+      meshlets = detail::face_meshlets(vertices, faces, face_normals);
+    }
 
     // faces as triangles (SuperTriangle3D) with xform applied to the vertices (whose coordinates are in model space)
     auto triangles(sp3::transform T) const
@@ -76,6 +247,28 @@ namespace cgfs
       };
       return faces | std::ranges::views::transform(to_super_triangle);
     }
+
+    // apply T to the vertices and the normals, into the cache
+    void transform(VertexCache& cache, const sp3::transform& T) const
+    {
+      cache.vertices.resize(vertices.size());
+      transform_points(T, vertices, cache.vertices);
+      cache.normals.resize(normals.size());
+      transform_vectors(T, normals, cache.normals);
+    }
+
+    // faces as triangles (SuperTriangle3D), gathered from the vertices and normals transformed into the cache
+    auto triangles(const VertexCache& cache) const
+    {
+      const auto to_super_triangle = [&cache](const TFace& t){
+        return SuperTriangle3D{
+          {{cache.vertices[t.a], cache.vertices[t.b], cache.vertices[t.c]}},
+          {{cache.normals[t.na], cache.normals[t.nb], cache.normals[t.nc]}},
+          t.col
+        };
+      };
+      return faces | std::ranges::views::transform(to_super_triangle);
+    }
   };
 
   inline MultiNormalMesh solid_cube()
@@ -200,6 +393,50 @@ namespace cgfs
 }
 
 
+  // The icosahedron with each face divided into 4^subdivisions faces, its vertices pushed out onto its circumscribed sphere,
+  // with the normals of the sphere at them. The faces keep the colors of the faces of the icosahedron they are a part of.
+  inline MultiNormalMesh solid_sphere(int subdivisions)
+  {
+    auto sphere = solid_icosahedron();
+    const auto radius = std::sqrt(sp3::dot(sphere.vertices.front() - Position3D{0, 0, 0}, sphere.vertices.front() - Position3D{0, 0, 0}));
+    for (int i = 0; i < subdivisions; ++i)
+    {
+      // the vertex at the middle of each edge, shared by the faces on both sides of it
+      auto midpoints = std::map<std::pair<size_t, size_t>, size_t>{};
+      const auto midpoint = [&](size_t a, size_t b){
+        const auto [it, inserted] = midpoints.try_emplace(std::minmax(a, b), sphere.vertices.size());
+        if (inserted)
+        {
+          const auto v = (sphere.vertices[a] + sphere.vertices[b]) / 2 - Position3D{0, 0, 0};
+          sphere.vertices.push_back(Position3D{0, 0, 0} + v / (std::sqrt(sp3::dot(v, v)) / radius));
+        }
+        return it->second;
+      };
+
+      auto faces = std::vector<MultiNormalMesh::TFace>{};
+      faces.reserve(4 * sphere.faces.size());
+      for (const auto& f : sphere.faces)
+      {
+        const auto ab = midpoint(f.a, f.b);
+        const auto bc = midpoint(f.b, f.c);
+        const auto ca = midpoint(f.c, f.a);
+        faces.push_back({f.a, ab, ca, f.col, f.a, ab, ca});
+        faces.push_back({ab, f.b, bc, f.col, ab, f.b, bc});
+        faces.push_back({ca, bc, f.c, f.col, ca, bc, f.c});
+        faces.push_back({ab, bc, ca, f.col, ab, bc, ca});
+      }
+      sphere.faces = std::move(faces);
+    }
+
+    // a normal for each vertex, with the same index (as the faces have it already)
+    sphere.normals.clear();
+    for (const auto& v : sphere.vertices)
+      sphere.normals.push_back(v - Position3D{0, 0, 0});
+    sphere.update();
+    sphere.build_meshlets();
+    return sphere;
+  }
+
   inline Mesh wireframe_cube()
   {
     return {std::vector<Position3D> {
@@ -402,6 +639,22 @@ namespace cgfs
       return m_mesh.faces;
     }
 
+    const std::vector<MeshEdge>& edges() const
+    {
+      return m_mesh.edges;
+    }
+
+    // the mesh of the cube, and the transform that places it (see render_instance() in render.h)
+    const Mesh& mesh() const
+    {
+      return m_mesh;
+    }
+
+    sp3::transform transform() const
+    {
+      return sp3::transform{m_pos};
+    }
+
   private:
     Vector3D m_pos = {0, 0, 0};
     Mesh m_mesh = wireframe_cube();
@@ -0,0 +1,148 @@
+#include "meshlet.h"
+
+#include <limits>
+#include <tuple>
+#include <utility>
+
+namespace cgfs
+{
+  namespace
+  {
+    constexpr auto none = std::numeric_limits<std::uint32_t>::max();
+
+    Vector3D unit(const Vector3D& v)
+    {
+      return (1 / std::sqrt(sp3::dot(v, v))) * v;
+    }
+
+    // of the normals of the faces, or none (the default NormalCone) if they point every which way, or one of them is 0
+    NormalCone normal_cone(std::span<const std::uint32_t> faces, std::span<const Vector3D> face_normals)
+    {
+      auto sum = Vector3D{0, 0, 0};
+      for (const auto f : faces)
+      {
+        if (sp3::dot(face_normals[f], face_normals[f]) == 0)
+          return {};
+        sum = sum + unit(face_normals[f]);
+      }
+      if (sp3::dot(sum, sum) == 0)
+        return {};
+
+      const auto axis = unit(sum);
+      auto cos_angle = 1.f;
+      for (const auto f : faces)
+        cos_angle = std::min(cos_angle, sp3::dot(axis, unit(face_normals[f])));
+      // a little wider, so that no normal is outside because of rounding
+      cos_angle -= 1e-4f;
+      if (cos_angle <= 0)
+        return {};
+      return {axis, cos_angle, std::sqrt(1 - cos_angle * cos_angle)};
+    }
+  }
+
+  std::vector<Meshlet> make_meshlets(std::span<const Position3D> vertices, std::span<const std::array<size_t, 3>> faces, std::span<const Vector3D> face_normals, const MeshletLimits& limits)
+  {
+    const auto max_faces = std::max(limits.max_faces, size_t{1});
+    const auto max_vertices = std::max(limits.max_vertices, size_t{3});
+
+    auto vertex_faces = std::vector<std::vector<std::uint32_t>>(vertices.size());
+    for (size_t f = 0; f < faces.size(); ++f)
+      for (const auto v : faces[f])
+        vertex_faces[v].push_back(static_cast<std::uint32_t>(f));
+
+    const auto center = [&](size_t f){
+      const auto& [a, b, c] = faces[f];
+      return (vertices[a] + vertices[b] + vertices[c]) / 3;
+    };
+
+    // the faces around each vertex that are in no meshlet yet
+    auto faces_left = std::vector<std::uint32_t>(vertices.size());
+    for (size_t v = 0; v < vertices.size(); ++v)
+      faces_left[v] = static_cast<std::uint32_t>(vertex_faces[v].size());
+
+    auto meshlets = std::vector<Meshlet>{};
+    auto assigned = std::vector<unsigned char>(faces.size(), 0);
+    auto in_meshlet = std::vector<unsigned char>(vertices.size(), 0); // the vertices of the meshlet being grown
+    auto candidates = std::vector<std::uint32_t>{};                   // the faces next to it (some of them more than once)
+    auto first_left = size_t{0};
+    while (true)
+    {
+      // next to the last meshlet if it can be
+      std::erase_if(candidates, [&](std::uint32_t f){ return assigned[f]; });
+      while (first_left < faces.size() && assigned[first_left])
+        ++first_left;
+      if (first_left == faces.size())
+        break;
+      const auto seed = candidates.empty() ? first_left : size_t{candidates.front()};
+
+      auto meshlet = Meshlet{};
+      auto sum = Vector3D{0, 0, 0}; // of the centers of its faces
+      candidates.clear();
+
+      // the vertices of the face that the meshlet doesn't have yet
+      const auto new_vertices = [&](size_t f){
+        const auto& [a, b, c] = faces[f];
+        return size_t{!in_meshlet[a]} + (b != a && !in_meshlet[b]) + (c != a && c != b && !in_meshlet[c]);
+      };
+      const auto add = [&](size_t f){
+        assigned[f] = 1;
+        meshlet.faces.push_back(static_cast<std::uint32_t>(f));
+        for (const auto v : faces[f])
+          --faces_left[v];
+        sum = sum + (center(f) - Position3D{0, 0, 0});
+        for (const auto v : faces[f])
+        {
+          if (in_meshlet[v])
+            continue;
+
+          in_meshlet[v] = 1;
+          meshlet.vertices.push_back(static_cast<std::uint32_t>(v));
+          for (const auto g : vertex_faces[v])
+            if (!assigned[g])
+              candidates.push_back(g);
+        }
+      };
+
+      add(seed);
+      while (meshlet.faces.size() < max_faces)
+      {
+        std::erase_if(candidates, [&](std::uint32_t f){ return assigned[f]; });
+        const auto meshlet_center = Position3D{0, 0, 0} + (1.f / meshlet.faces.size()) * sum;
+        auto best = none;
+        auto best_score = std::tuple{size_t{4}, std::uint32_t{0}, std::numeric_limits<float>::max()};
+        for (const auto f : candidates)
+        {
+          const auto n = new_vertices(f);
+          if (meshlet.vertices.size() + n > max_vertices)
+            continue;
+
+          const auto& [a, b, c] = faces[f];
+          const auto d = center(f) - meshlet_center;
+          const auto score = std::tuple{n, faces_left[a] + faces_left[b] + faces_left[c], sp3::dot(d, d)};
+          if (score < best_score)
+          {
+            best = f;
+            best_score = score;
+          }
+        }
+        if (best == none)
+          break;
+
+        add(best);
+      }
+
+      for (const auto v : meshlet.vertices)
+        in_meshlet[v] = 0;
+
+      std::ranges::sort(meshlet.faces);
+      auto points = std::vector<Position3D>{};
+      points.reserve(meshlet.vertices.size());
+      for (const auto v : meshlet.vertices)
+        points.push_back(vertices[v]);
+      meshlet.bounds = bounding_sphere(points);
+      meshlet.cone = normal_cone(meshlet.faces, face_normals);
+      meshlets.push_back(std::move(meshlet));
+    }
+    return meshlets;
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "bounding_sphere.h"
+#include "position.h"
+
+#include "sp3/transform.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace cgfs
+{
+  // The directions of the normals of a set of faces: all of them are within an angle of the axis
+  struct NormalCone
+  {
+    Vector3D axis = {0, 0, 1}; // unit length
+    float cos_angle = -1;      // the cone is of no use when the angle is a right angle or more, see back_facing()
+    float sin_angle = 0;
+
+    // Is every face turned away from a camera at eye (see FaceNormal::back_facing() in mesh.h), given that the faces, and the
+    // points of them that are tested, are in the sphere?
+    // The normal n of a face is within the angle a of the axis, and the direction from the eye to the center of the sphere
+    // is at an angle t from it, so n is at an angle of at most t + a from that direction; the face is turned away if the
+    // distance from the eye to the center, along n, is more than the radius.
+    bool back_facing(const BoundingSphere& sphere, const Position3D& eye) const
+    {
+      if (cos_angle <= 0)
+        return false;
+
+      const auto v = sphere.center - eye;
+      const auto along = sp3::dot(axis, v);
+      const auto across = std::sqrt(std::max(sp3::dot(v, v) - along * along, 0.f));
+      return along * cos_angle - across * sin_angle > sphere.radius;
+    }
+  };
+
+  // A cluster of neighbouring faces of a model, to be culled as a whole
+  struct Meshlet
+  {
+    std::vector<std::uint32_t> faces;    // by index into the faces of the model, in increasing order
+    std::vector<std::uint32_t> vertices; // the vertices of the faces, once each (by index into the vertices of the model)
+    BoundingSphere bounds = {};          // of the vertices
+    NormalCone cone = {};                // of the normals of the faces
+  };
+
+  struct MeshletLimits
+  {
+    size_t max_faces = 128;
+    size_t max_vertices = 64;
+  };
+
+  // Partition the faces (by the indices of their vertices) into meshlets, growing each one from a face next to the last one, by
+  // adding the neighbouring face (one that shares a vertex with it) that adds the fewest vertices to it, then the one with the
+  // fewest other faces left around its vertices (so that no face is left stranded between meshlets), then the one nearest to
+  // its center, until it reaches one of the limits or has no neighbour left.
+  // The cone of each meshlet is that of the normals of its faces (which need not be the normals of their planes, nor of unit
+  // length): they are the ones that its faces are culled by.
+  std::vector<Meshlet> make_meshlets(std::span<const Position3D> vertices, std::span<const std::array<size_t, 3>> faces, std::span<const Vector3D> face_normals, const MeshletLimits& limits = {});
+}
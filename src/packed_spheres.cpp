@@ -0,0 +1,349 @@
+#include "packed_spheres.h"
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <optional>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CGFS_PACKED_SPHERES_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CGFS_PACKED_SPHERES_SSE2
+#endif
+
+namespace cgfs
+{
+  namespace
+  {
+    // widest SIMD register in floats, the arrays are padded to a multiple of it
+    constexpr size_t PADDING = 8;
+
+    constexpr float INF = std::numeric_limits<float>::infinity();
+
+    struct RayConstants
+    {
+      float ox, oy, oz;
+      float dx, dy, dz;
+      float four_k1; // 4 * dot(D, D)
+      float two_k1;  // 2 * dot(D, D)
+      float t_min;
+      float t_max;
+    };
+
+    RayConstants make_constants(const Position3D& O, const Vector3D& D, float t_min, float t_max)
+    {
+      const auto k1 = dot(D, D);
+      return {O.x, O.y, O.z, D.x, D.y, D.z, 4 * k1, 2 * k1, t_min, t_max};
+    }
+
+    // Each kernel tests the ray against WIDTH consecutive spheres and returns, per lane, the distance to
+    // the nearest of the two intersections in (t_min, t_max), or infinity. Lanes at or past 'count' are
+    // always infinity. A Block of spheres can be loaded once and tested against several rays.
+#if defined(CGFS_PACKED_SPHERES_AVX2)
+    struct Kernel
+    {
+      static constexpr std::uint32_t WIDTH = 8;
+      using Lanes = __m256;
+
+      explicit Kernel(const RayConstants& r)
+      : ox{_mm256_set1_ps(r.ox)}, oy{_mm256_set1_ps(r.oy)}, oz{_mm256_set1_ps(r.oz)}
+      , dx{_mm256_set1_ps(r.dx)}, dy{_mm256_set1_ps(r.dy)}, dz{_mm256_set1_ps(r.dz)}
+      , four_k1{_mm256_set1_ps(r.four_k1)}, two_k1{_mm256_set1_ps(r.two_k1)}
+      , lo{_mm256_set1_ps(r.t_min)}, hi{_mm256_set1_ps(r.t_max)}
+      {}
+
+      struct Block
+      {
+        Lanes x, y, z, r2, in_range;
+      };
+
+      static Block load(const float* x, const float* y, const float* z, const float* r2, std::uint32_t count)
+      {
+        const auto in_range = _mm256_cmp_ps(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps(static_cast<float>(count)), _CMP_LT_OQ);
+        return {_mm256_loadu_ps(x), _mm256_loadu_ps(y), _mm256_loadu_ps(z), _mm256_loadu_ps(r2), in_range};
+      }
+
+      Lanes nearest(const float* x, const float* y, const float* z, const float* r2, std::uint32_t count) const
+      {
+        return nearest(load(x, y, z, r2, count));
+      }
+
+      Lanes nearest(const Block& spheres) const
+      {
+        const auto ocx = _mm256_sub_ps(ox, spheres.x);
+        const auto ocy = _mm256_sub_ps(oy, spheres.y);
+        const auto ocz = _mm256_sub_ps(oz, spheres.z);
+        const auto oc_d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+        const auto oc_oc = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz));
+        const auto k2 = _mm256_mul_ps(_mm256_set1_ps(2), oc_d);
+        const auto k3 = _mm256_sub_ps(oc_oc, spheres.r2);
+        const auto discriminant = _mm256_sub_ps(_mm256_mul_ps(k2, k2), _mm256_mul_ps(four_k1, k3));
+        const auto root = _mm256_sqrt_ps(discriminant); // NaN where there is no intersection, which fails every comparison below
+        const auto minus_k2 = _mm256_sub_ps(_mm256_setzero_ps(), k2);
+        const auto t1 = _mm256_div_ps(_mm256_add_ps(minus_k2, root), two_k1);
+        const auto t2 = _mm256_div_ps(_mm256_sub_ps(minus_k2, root), two_k1);
+
+        const auto valid1 = _mm256_and_ps(spheres.in_range, _mm256_and_ps(_mm256_cmp_ps(lo, t1, _CMP_LT_OQ), _mm256_cmp_ps(t1, hi, _CMP_LT_OQ)));
+        const auto valid2 = _mm256_and_ps(spheres.in_range, _mm256_and_ps(_mm256_cmp_ps(lo, t2, _CMP_LT_OQ), _mm256_cmp_ps(t2, hi, _CMP_LT_OQ)));
+        const auto inf = _mm256_set1_ps(INF);
+        return _mm256_min_ps(_mm256_blendv_ps(inf, t1, valid1), _mm256_blendv_ps(inf, t2, valid2));
+      }
+
+      // smallest value and the first lane that holds it
+      static float min_lane(Lanes t, std::uint32_t& lane)
+      {
+        auto m = _mm256_min_ps(t, _mm256_permute2f128_ps(t, t, 1));
+        m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        lane = std::countr_zero(static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(t, m, _CMP_EQ_OQ))));
+        return _mm256_cvtss_f32(m);
+      }
+
+      static bool any(Lanes t)
+      {
+        return _mm256_movemask_ps(_mm256_cmp_ps(t, _mm256_set1_ps(INF), _CMP_LT_OQ)) != 0;
+      }
+
+      Lanes ox, oy, oz, dx, dy, dz, four_k1, two_k1, lo, hi;
+    };
+#elif defined(CGFS_PACKED_SPHERES_SSE2)
+    struct Kernel
+    {
+      static constexpr std::uint32_t WIDTH = 4;
+      using Lanes = __m128;
+
+      explicit Kernel(const RayConstants& r)
+      : ox{_mm_set1_ps(r.ox)}, oy{_mm_set1_ps(r.oy)}, oz{_mm_set1_ps(r.oz)}
+      , dx{_mm_set1_ps(r.dx)}, dy{_mm_set1_ps(r.dy)}, dz{_mm_set1_ps(r.dz)}
+      , four_k1{_mm_set1_ps(r.four_k1)}, two_k1{_mm_set1_ps(r.two_k1)}
+      , lo{_mm_set1_ps(r.t_min)}, hi{_mm_set1_ps(r.t_max)}
+      {}
+
+      struct Block
+      {
+        Lanes x, y, z, r2, in_range;
+      };
+
+      static Block load(const float* x, const float* y, const float* z, const float* r2, std::uint32_t count)
+      {
+        const auto in_range = _mm_cmplt_ps(_mm_setr_ps(0, 1, 2, 3), _mm_set1_ps(static_cast<float>(count)));
+        return {_mm_loadu_ps(x), _mm_loadu_ps(y), _mm_loadu_ps(z), _mm_loadu_ps(r2), in_range};
+      }
+
+      Lanes nearest(const float* x, const float* y, const float* z, const float* r2, std::uint32_t count) const
+      {
+        return nearest(load(x, y, z, r2, count));
+      }
+
+      Lanes nearest(const Block& spheres) const
+      {
+        const auto ocx = _mm_sub_ps(ox, spheres.x);
+        const auto ocy = _mm_sub_ps(oy, spheres.y);
+        const auto ocz = _mm_sub_ps(oz, spheres.z);
+        const auto oc_d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+        const auto oc_oc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz));
+        const auto k2 = _mm_mul_ps(_mm_set1_ps(2), oc_d);
+        const auto k3 = _mm_sub_ps(oc_oc, spheres.r2);
+        const auto discriminant = _mm_sub_ps(_mm_mul_ps(k2, k2), _mm_mul_ps(four_k1, k3));
+        const auto root = _mm_sqrt_ps(discriminant); // NaN where there is no intersection, which fails every comparison below
+        const auto minus_k2 = _mm_sub_ps(_mm_setzero_ps(), k2);
+        const auto t1 = _mm_div_ps(_mm_add_ps(minus_k2, root), two_k1);
+        const auto t2 = _mm_div_ps(_mm_sub_ps(minus_k2, root), two_k1);
+
+        const auto valid1 = _mm_and_ps(spheres.in_range, _mm_and_ps(_mm_cmplt_ps(lo, t1), _mm_cmplt_ps(t1, hi)));
+        const auto valid2 = _mm_and_ps(spheres.in_range, _mm_and_ps(_mm_cmplt_ps(lo, t2), _mm_cmplt_ps(t2, hi)));
+        return _mm_min_ps(select(valid1, t1), select(valid2, t2));
+      }
+
+      // smallest value and the first lane that holds it
+      static float min_lane(Lanes t, std::uint32_t& lane)
+      {
+        auto m = _mm_min_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        lane = std::countr_zero(static_cast<unsigned>(_mm_movemask_ps(_mm_cmpeq_ps(t, m))));
+        return _mm_cvtss_f32(m);
+      }
+
+      static bool any(Lanes t)
+      {
+        return _mm_movemask_ps(_mm_cmplt_ps(t, _mm_set1_ps(INF))) != 0;
+      }
+
+      // t where mask is set and infinity elsewhere
+      static Lanes select(Lanes mask, Lanes t)
+      {
+        return _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, _mm_set1_ps(INF)));
+      }
+
+      Lanes ox, oy, oz, dx, dy, dz, four_k1, two_k1, lo, hi;
+    };
+#else
+    struct Kernel
+    {
+      static constexpr std::uint32_t WIDTH = 1;
+      using Lanes = float;
+
+      explicit Kernel(const RayConstants& r) : r{r} {}
+
+      struct Block
+      {
+        float x, y, z, r2;
+        bool in_range;
+      };
+
+      static Block load(const float* x, const float* y, const float* z, const float* r2, std::uint32_t count)
+      {
+        return {*x, *y, *z, *r2, count != 0};
+      }
+
+      Lanes nearest(const float* x, const float* y, const float* z, const float* r2, std::uint32_t count) const
+      {
+        return nearest(load(x, y, z, r2, count));
+      }
+
+      Lanes nearest(const Block& sphere) const
+      {
+        if (!sphere.in_range)
+          return INF;
+
+        const auto ocx = r.ox - sphere.x;
+        const auto ocy = r.oy - sphere.y;
+        const auto ocz = r.oz - sphere.z;
+        const auto k2 = 2 * (ocx * r.dx + ocy * r.dy + ocz * r.dz);
+        const auto k3 = (ocx * ocx + ocy * ocy + ocz * ocz) - sphere.r2;
+        const auto discriminant = k2 * k2 - r.four_k1 * k3;
+        if (discriminant < 0)
+          return INF;
+
+        const auto t1 = (-k2 + std::sqrt(discriminant)) / r.two_k1;
+        const auto t2 = (-k2 - std::sqrt(discriminant)) / r.two_k1;
+        auto t = INF;
+        if (r.t_min < t1 && t1 < r.t_max)
+          t = t1;
+        if (r.t_min < t2 && t2 < r.t_max && t2 < t)
+          t = t2;
+        return t;
+      }
+
+      static float min_lane(Lanes t, std::uint32_t& lane)
+      {
+        lane = 0;
+        return t;
+      }
+
+      static bool any(Lanes t)
+      {
+        return t < INF;
+      }
+
+      RayConstants r;
+    };
+#endif
+  }
+
+  PackedSpheres::PackedSpheres(const std::vector<Sphere>& spheres, const std::vector<std::uint32_t>& order)
+  : m_size{order.size()}
+  {
+    const auto padded = (m_size + PADDING - 1) / PADDING * PADDING + PADDING;
+    m_x.assign(padded, 0);
+    m_y.assign(padded, 0);
+    m_z.assign(padded, 0);
+    m_r2.assign(padded, -1); // padding, masked out by the kernels
+
+    for (size_t i = 0; i < m_size; ++i)
+    {
+      const auto& sphere = spheres[order[i]];
+      m_x[i] = sphere.center.x;
+      m_y[i] = sphere.center.y;
+      m_z[i] = sphere.center.z;
+      m_r2[i] = sphere.radius * sphere.radius;
+    }
+  }
+
+  bool PackedSpheres::nearest_hit(const Position3D& O, const Vector3D& D, std::uint32_t first, std::uint32_t last, float t_min, float t_max, SphereHit& hit) const
+  {
+    const auto kernel = Kernel{make_constants(O, D, t_min, t_max)};
+    auto best_t = INF;
+    auto best = last;
+
+    for (auto i = first; i < last; i += Kernel::WIDTH)
+    {
+      const auto t = kernel.nearest(&m_x[i], &m_y[i], &m_z[i], &m_r2[i], last - i);
+      auto lane = std::uint32_t{0};
+      const auto t_lane = Kernel::min_lane(t, lane);
+      if (t_lane < best_t)
+      {
+        best_t = t_lane;
+        best = i + lane;
+      }
+    }
+
+    if (best == last)
+      return false;
+
+    hit = {best, best_t};
+    return true;
+  }
+
+  bool PackedSpheres::any_hit(const Position3D& O, const Vector3D& D, std::uint32_t first, std::uint32_t last, float t_min, float t_max) const
+  {
+    const auto kernel = Kernel{make_constants(O, D, t_min, t_max)};
+    for (auto i = first; i < last; i += Kernel::WIDTH)
+      if (Kernel::any(kernel.nearest(&m_x[i], &m_y[i], &m_z[i], &m_r2[i], last - i)))
+        return true;
+
+    return false;
+  }
+
+  std::uint32_t PackedSpheres::nearest_hits(std::span<const Ray3D> rays, std::uint32_t active, std::uint32_t first, std::uint32_t last, std::span<float> t_max, std::span<SphereHit> hits) const
+  {
+    struct Lane
+    {
+      std::uint32_t ray;
+      float best_t;
+      std::uint32_t best;
+    };
+
+    auto kernels = std::array<std::optional<Kernel>, max_packet_size>{};
+    auto lanes = std::array<Lane, max_packet_size>{};
+    auto num_lanes = size_t{0};
+    for (auto mask = active; mask != 0; mask &= mask - 1)
+    {
+      const auto i = static_cast<std::uint32_t>(std::countr_zero(mask));
+      const auto& ray = rays[i];
+      kernels[num_lanes].emplace(make_constants(ray.origin, ray.direction, ray.t_min, t_max[i]));
+      lanes[num_lanes++] = {i, INF, last};
+    }
+
+    // the same reduction as nearest_hit(), but each block of spheres is loaded once for the whole packet
+    for (auto i = first; i < last; i += Kernel::WIDTH)
+    {
+      const auto spheres = Kernel::load(&m_x[i], &m_y[i], &m_z[i], &m_r2[i], last - i);
+      for (size_t k = 0; k < num_lanes; ++k)
+      {
+        auto lane = std::uint32_t{0};
+        const auto t_lane = Kernel::min_lane(kernels[k]->nearest(spheres), lane);
+        if (t_lane < lanes[k].best_t)
+        {
+          lanes[k].best_t = t_lane;
+          lanes[k].best = i + lane;
+        }
+      }
+    }
+
+    auto found = std::uint32_t{0};
+    for (size_t k = 0; k < num_lanes; ++k)
+    {
+      if (lanes[k].best == last)
+        continue;
+      const auto i = lanes[k].ray;
+      hits[i] = {lanes[k].best, lanes[k].best_t};
+      t_max[i] = lanes[k].best_t;
+      found |= std::uint32_t{1} << i;
+    }
+    return found;
+  }
+}
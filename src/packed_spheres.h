@@ -0,0 +1,58 @@
+#pragma once
+
+#include "position.h"
+#include "ray.h"
+#include "sphere.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace cgfs
+{
+  struct SphereHit
+  {
+    std::uint32_t position = 0; // position of the sphere in the PackedSpheres
+    float t = 0;
+  };
+
+  // The geometry of a list of spheres, stored as a structure of arrays (center x, y, z and radius squared).
+  //
+  // Keeping the color, specularity and reflectivity of the spheres out of the way means that the cache lines
+  // touched while searching for the nearest hit hold only the data needed for the intersection test, and lets
+  // nearest_hit() test one ray against 8 (AVX2) or 4 (SSE2) spheres per instruction.
+  class PackedSpheres
+  {
+  public:
+    static constexpr size_t max_packet_size = 16;
+
+    PackedSpheres() = default;
+
+    // pack spheres[order[0]], spheres[order[1]], ...
+    PackedSpheres(const std::vector<Sphere>& spheres, const std::vector<std::uint32_t>& order);
+
+    size_t size() const { return m_size; }
+
+    // Find the nearest sphere at positions [first, last) hit by the ray O + tD with t_min < t < t_max.
+    // The SIMD kernels perform the same operations in the same order as the scalar fallback, so all builds agree bit for bit.
+    // Returns false if none of the spheres are hit in that interval.
+    bool nearest_hit(const Position3D& O, const Vector3D& D, std::uint32_t first, std::uint32_t last, float t_min, float t_max, SphereHit& hit) const;
+
+    // Is any of the spheres at positions [first, last) hit by the ray O + tD with t_min < t < t_max?
+    bool any_hit(const Position3D& O, const Vector3D& D, std::uint32_t first, std::uint32_t last, float t_min, float t_max) const;
+
+    // nearest_hit() for a packet of (at most max_packet_size) rays, sharing the sphere loads between them.
+    // Only the rays whose bit is set in active are tested, against (rays[i].t_min, t_max[i]).
+    // A ray that hits a sphere gets hits[i] set and t_max[i] reduced to the hit. Returns the mask of those rays.
+    std::uint32_t nearest_hits(std::span<const Ray3D> rays, std::uint32_t active, std::uint32_t first, std::uint32_t last, std::span<float> t_max, std::span<SphereHit> hits) const;
+
+  private:
+    size_t m_size = 0;
+
+    // padded to a multiple of the SIMD width past m_size so that the kernels can always load full registers
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<float> m_z;
+    std::vector<float> m_r2;
+  };
+}
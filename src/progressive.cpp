@@ -0,0 +1,64 @@
+#include "progressive.h"
+
+#include "render.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+namespace cgfs
+{
+  ProgressiveRenderer::ProgressiveRenderer(const Scene& scene, Canvas& canvas, const Extent2D& viewport, int coarsest_step)
+  : m_scene{scene}
+  , m_canvas{canvas}
+  , m_viewport{viewport}
+  , m_area{detail::render_area(canvas.extent())}
+  , m_coarsest_step{static_cast<int>(std::bit_floor(static_cast<unsigned>(std::max(coarsest_step, 1))))}
+  , m_step{m_coarsest_step}
+  , m_total{static_cast<size_t>(m_area.width) * m_area.height}
+  {}
+
+  float ProgressiveRenderer::refine(std::chrono::steady_clock::duration budget)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + budget;
+    const auto O = Position3D{0, 0, 0};
+    const auto [Cw, Ch] = m_canvas.extent();
+
+    while (!done() && std::chrono::steady_clock::now() < deadline)
+    {
+      // the pass traces the pixels on a grid of step x step blocks, skipping those traced by the previous passes
+      const auto columns = static_cast<size_t>((m_area.width + m_step - 1) / m_step);
+      const auto rows = static_cast<size_t>((m_area.height + m_step - 1) / m_step);
+      if (m_next == columns * rows)
+      {
+        m_step /= 2;
+        m_next = 0;
+        continue;
+      }
+
+      const auto Sx = static_cast<int>(m_next % columns) * m_step;
+      const auto Sy = static_cast<int>(m_next / columns) * m_step;
+      ++m_next;
+      const auto coarser = 2 * m_step;
+      if (m_step != m_coarsest_step && Sx % coarser == 0 && Sy % coarser == 0)
+        continue;
+
+      const auto C_xy = Index2D{Sx - Cw/2, Ch/2 - Sy};
+      const auto V_xyz = detail::canvas_to_viewport(C_xy, m_canvas.extent(), m_viewport);
+      const auto color = m_scene.trace_ray({O, V_xyz - O, 1, std::numeric_limits<float>::infinity()});
+      ++m_traced;
+
+      // paint the block of the pixel until a later pass refines it
+      for (int y = Sy; y < std::min(Sy + m_step, m_area.height); ++y)
+        for (int x = Sx; x < std::min(Sx + m_step, m_area.width); ++x)
+          m_canvas.putPixel({x - Cw/2, Ch/2 - y}, color);
+    }
+
+    return progress();
+  }
+
+  float ProgressiveRenderer::progress() const
+  {
+    return m_total == 0 ? 1.0f : static_cast<float>(m_traced) / static_cast<float>(m_total);
+  }
+}
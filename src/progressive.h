@@ -0,0 +1,49 @@
+#pragma once
+
+#include "canvas.h"
+#include "extent.h"
+#include "scene.h"
+
+#include <chrono>
+#include <cstddef>
+
+namespace cgfs
+{
+  // Ray traces a scene coarse to fine, for as long as the caller can afford, e.g. for an interactive preview.
+  //
+  // The first pass traces one pixel in every coarsest_step x coarsest_step block and paints the whole block its color.
+  // Each following pass halves the step, tracing only the pixels that haven't been traced yet, until every pixel
+  // has been traced once. The canvas holds the best image so far at any point, and once done it is identical
+  // to render().
+  class ProgressiveRenderer
+  {
+  public:
+    // coarsest_step is rounded down to a power of two
+    ProgressiveRenderer(const Scene& scene, Canvas& canvas, const Extent2D& viewport, int coarsest_step = 8);
+
+    // Trace pixels until the budget is spent or the image is complete.
+    // Returns the fraction of the pixels traced so far, in [0, 1].
+    float refine(std::chrono::steady_clock::duration budget);
+
+    float progress() const;
+    bool done() const { return m_traced == m_total; }
+
+  private:
+    const Scene& m_scene;
+    Canvas& m_canvas;
+    Extent2D m_viewport;
+    Extent2D m_area;     // the pixels painted, see detail::render_area()
+    int m_coarsest_step; // a power of two
+
+    int m_step;           // of the current pass
+    size_t m_next = 0;    // the next position on the grid of the current pass
+    size_t m_traced = 0;
+    size_t m_total = 0;
+  };
+
+  // Render as much of the scene as the budget allows, coarse to fine. Returns the fraction of the pixels traced.
+  inline float render_progressive(const Scene& scene, Canvas& canvas, const Extent2D& viewport, std::chrono::steady_clock::duration budget)
+  {
+    return ProgressiveRenderer{scene, canvas, viewport}.refine(budget);
+  }
+}
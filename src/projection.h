@@ -36,6 +36,8 @@ namespace cgfs
 
     const Viewport& viewport() const { return m_viewport; }
 
+    const Extent2D& canvas_dimensions() const { return m_canvas_dimensions; }
+
   private:
     Extent2D m_canvas_dimensions = {0, 0};
     Viewport m_viewport = {{1, 1}, 1};
@@ -2,6 +2,9 @@
 
 #include "position.h"
 
+#include <cstdint>
+#include <limits>
+
 namespace cgfs
 {
   struct Ray3D
@@ -18,4 +21,15 @@ namespace cgfs
   {
       return lhs.origin == rhs.origin && lhs.direction == rhs.direction && lhs.t_min == rhs.t_min && lhs.t_max == rhs.t_max;
   }
-}
\ No newline at end of file
+
+  // The result of intersecting a ray with the primitives of a scene
+  struct HitRecord
+  {
+    static constexpr std::uint32_t no_primitive = std::numeric_limits<std::uint32_t>::max();
+
+    std::uint32_t primitive = no_primitive;           // index of the primitive hit by the ray
+    float t = std::numeric_limits<float>::infinity(); // the hit point is origin + t * direction
+
+    explicit operator bool() const { return primitive != no_primitive; }
+  };
+}
@@ -5,15 +5,33 @@
 #include "color.h"
 #include "draw.h"
 #include "extent.h"
+#include "frustum.h"
+#include "gbuffer.h"
+#include "halfspace.h"
 #include "index.h"
+#include "instance.h"
+#include "lod.h"
 #include "cgfs_math.h"
 #include "mesh.h"
 #include "position.h"
 #include "scene.h"
+#include "thread_pool.h"
+#include "tile.h"
+#include "vertex_transform.h"
 
 // #include <ranges>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
 #include <numeric>
+#include <span>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace cgfs
 {
@@ -44,6 +62,15 @@ namespace cgfs
       return {Cx * float(Vw)/Cw, Cy * float(Vh)/Ch, d};
     }
 
+    // canvas_to_viewport() for a point anywhere in a pixel, e.g. a sub-pixel sample
+    inline cgfs::Position3D subpixel_to_viewport(const cgfs::Position2D& C_xy, cgfs::Extent2D C_wh, cgfs::Extent2D V_wh)
+    {
+      const float d = 1;
+      auto& [Cw, Ch] = C_wh;
+      auto& [Vw, Vh] = V_wh;
+      return {C_xy.x * float(Vw)/Cw, C_xy.y * float(Vh)/Ch, d};
+    }
+
     inline Index2D viewport_to_canvas(const Position2D& V_xy, const Extent2D& V_wh, const Extent2D& C_wh)
     {
       return {cgfs::ftoi(V_xy.x * (C_wh.width/V_wh.width)), cgfs::ftoi(V_xy.y * (C_wh.height/V_wh.height))};
@@ -75,6 +102,62 @@ namespace cgfs
       const auto V = p - Position3D{0, 0, 0};
       return is_back_facing(N, V);
     }
+
+    // Ray trace the pixels of the tile (in screen coordinates)
+    inline void render_tile(const cgfs::Scene& scene, cgfs::Canvas& canvas, const cgfs::Extent2D& viewport, const Tile& tile)
+    {
+      const auto O = Position3D{0, 0, 0};
+      const auto [Cw, Ch] = canvas.extent();
+      for (int Sy = tile.y0; Sy < tile.y1; ++Sy)
+        for (int Sx = tile.x0; Sx < tile.x1; ++Sx)
+        {
+          const auto C_xy = Index2D{Sx - Cw/2, Ch/2 - Sy};
+          const auto V_xyz = detail::canvas_to_viewport(C_xy, canvas.extent(), viewport);
+          const auto color = scene.trace_ray({O, V_xyz - O, 1, std::numeric_limits<float>::infinity()});
+          canvas.putPixel(C_xy, color);
+        }
+    }
+
+    // Ray trace the pixels of the tile in packets of (at most) packet_size coherent primary rays.
+    // A packet covers a block of 4 x packet_size/4 pixels (or a row of packet_size pixels if it is smaller than 4).
+    inline void render_tile(const cgfs::Scene& scene, cgfs::Canvas& canvas, const cgfs::Extent2D& viewport, const Tile& tile, int packet_size)
+    {
+      if (packet_size <= 1)
+        return render_tile(scene, canvas, viewport, tile);
+
+      const auto O = Position3D{0, 0, 0};
+      const auto [Cw, Ch] = canvas.extent();
+      packet_size = std::min(packet_size, static_cast<int>(Scene::max_packet_size));
+      const auto packet_w = std::min(packet_size, 4);
+      const auto packet_h = std::max(packet_size / packet_w, 1);
+
+      auto pixels = std::array<Index2D, Scene::max_packet_size>{};
+      auto rays = std::array<Ray3D, Scene::max_packet_size>{};
+      auto colors = std::array<Color, Scene::max_packet_size>{};
+      for (int y0 = tile.y0; y0 < tile.y1; y0 += packet_h)
+        for (int x0 = tile.x0; x0 < tile.x1; x0 += packet_w)
+        {
+          auto count = size_t{0};
+          for (int Sy = y0; Sy < std::min(y0 + packet_h, tile.y1); ++Sy)
+            for (int Sx = x0; Sx < std::min(x0 + packet_w, tile.x1); ++Sx)
+            {
+              const auto C_xy = Index2D{Sx - Cw/2, Ch/2 - Sy};
+              const auto V_xyz = detail::canvas_to_viewport(C_xy, canvas.extent(), viewport);
+              pixels[count] = C_xy;
+              rays[count++] = {O, V_xyz - O, 1, std::numeric_limits<float>::infinity()};
+            }
+
+          scene.trace_rays(std::span{rays}.first(count), std::span{colors}.first(count));
+          for (size_t i = 0; i < count; ++i)
+            canvas.putPixel(pixels[i], colors[i]);
+        }
+    }
+
+    // The pixels (in screen coordinates) painted by render(): canvas x in [-Cw/2, Cw/2), y in (-Ch/2, Ch/2]
+    inline Extent2D render_area(const Extent2D& C_wh)
+    {
+      return {C_wh.width / 2 * 2, C_wh.height / 2 * 2};
+    }
   }
 }
 
@@ -103,6 +186,29 @@ namespace cgfs
       }
   }
 
+  struct RenderOptions
+  {
+    unsigned num_threads = 0; // 0: one thread per hardware thread
+    int tile_size = 32;       // the canvas is split into tiles of tile_size x tile_size pixels
+    int packet_size = 1;      // primary rays traced together: 1 (no packets), 4, 8 or 16
+  };
+
+  // Render the scene in tiles on the threads of the pool.
+  // The scene is shared read-only between the threads and each pixel belongs to exactly one tile,
+  // so the output is identical to the serial render().
+  // Tracing the primary rays in packets doesn't change the output either.
+  inline void render(const cgfs::Scene& scene, cgfs::Canvas& canvas, const cgfs::Extent2D& viewport, WorkStealingPool& pool, int tile_size = RenderOptions{}.tile_size, int packet_size = RenderOptions{}.packet_size)
+  {
+    const auto tiles = make_tiles(detail::render_area(canvas.extent()), tile_size);
+    pool.parallel_for(tiles.size(), [&](size_t i){ detail::render_tile(scene, canvas, viewport, tiles[i], packet_size); });
+  }
+
+  inline void render(const cgfs::Scene& scene, cgfs::Canvas& canvas, const cgfs::Extent2D& viewport, const RenderOptions& options)
+  {
+    auto pool = WorkStealingPool{options.num_threads};
+    render(scene, canvas, viewport, pool, options.tile_size, options.packet_size);
+  }
+
   inline void render_triangle(Canvas& canvas, const Mesh::TFace& triangle, std::ranges::random_access_range auto&& projected)
   requires std::same_as<std::ranges::range_value_t<decltype(projected)>, Index2D>
   {
@@ -115,34 +221,264 @@ namespace cgfs
     draw_filled_triangle(canvas, projected[triangle.a], projected[triangle.b], projected[triangle.c], triangle.col);
   }
 
+  // The wireframe of a model from its unique edges (see Mesh::edges), each drawn once
+  inline void render_edges(Canvas& canvas, const std::vector<MeshEdge>& edges, std::ranges::random_access_range auto&& projected)
+  requires std::same_as<std::ranges::range_value_t<decltype(projected)>, Index2D>
+  {
+    for (const auto& e : edges)
+      draw_line(canvas, projected[e.a], projected[e.b], e.col);
+  }
+
   inline void render_object(Canvas& canvas, const Mesh& object, const Extent2D& V_wh, float d)
   {
-    const auto project = [&](const Position3D& v){ return detail::project_vertex(v, d, V_wh, canvas.extent());};
+    auto projected = std::vector<Index2D>(object.vertices.size());
+    std::ranges::transform(object.vertices, projected.begin(), [&](const Position3D& v){ return detail::project_vertex(v, d, V_wh, canvas.extent()); });
+    render_edges(canvas, object.edges, projected);
+  }
+
+  // The wireframe of a mesh, M being the transformation from model to camera coordinates (e.g. the camera matrix times the
+  // transform of an instance of it), which is applied to the vertices as a batch (see transform_points())
+  inline void render_instance(Canvas& canvas, const Mesh& model, const sp3::transform& M, const Extent2D& V_wh, float d)
+  {
+    auto vertices = std::vector<Position3D>(model.vertices.size());
+    transform_points(M, model.vertices, vertices);
 
-    for (const auto& t : object.faces)
-      render_triangle(canvas, t, object.vertices | std::views::transform(project));
+    auto projected = std::vector<Index2D>(vertices.size());
+    std::ranges::transform(vertices, projected.begin(), [&](const Position3D& v){ return detail::project_vertex(v, d, V_wh, canvas.extent()); });
+    render_edges(canvas, model.edges, projected);
   }
 
-  // an 'instance' is anything with vertices() and faces() methods
+  // an 'instance' is anything with vertices() and faces() methods, and an edges() method if it has a list of its unique edges,
+  // or with a mesh() placed by a transform(), which is drawn by the render_instance() above
   inline void render_instance(Canvas& canvas, auto&& instance, const Extent2D& V_wh, float d)
   {
-    const auto project = [&](const Position3D& v){ return detail::project_vertex(v, d, V_wh, canvas.extent());};
+    if constexpr (requires { instance.mesh(); instance.transform(); })
+      render_instance(canvas, instance.mesh(), instance.transform(), V_wh, d);
+    else
+    {
+      const auto project = [&](const Position3D& v){ return detail::project_vertex(v, d, V_wh, canvas.extent());};
 
-    for (const auto& t : instance.faces())
-      render_triangle(canvas, t, instance.vertices() | std::views::transform(project));
+      // each vertex is projected once, not once for each face that shares it
+      auto projected = std::vector<Index2D>{};
+      std::ranges::transform(instance.vertices(), std::back_inserter(projected), project);
+      if constexpr (requires { instance.edges(); })
+        render_edges(canvas, instance.edges(), projected);
+      else
+        for (const auto& t : instance.faces())
+          render_triangle(canvas, t, projected);
+    }
+  }
+
+  enum class Rasterizer
+  {
+    scanline,   // draw_filled_triangle(), one row of pixels at a time
+    half_space, // draw_filled_triangle_halfspace(), 8x8 blocks of pixels at a time
+  };
+
+  enum class Shading
+  {
+    forward,  // each pixel is shaded whenever a triangle passes the depth test in it
+    deferred, // the triangles are drawn into a GBuffer first, then each pixel is shaded once, by its visible triangle
+  };
+
+  struct RasterOptions
+  {
+    Rasterizer rasterizer = Rasterizer::scanline;
+    int band_height = 16; // the render_scene() on a pool bins the triangles into bands of band_height rows of the canvas (rounded up to whole depth tiles)
+    DepthTest depth_test = DepthTest::hierarchical;
+    Shading shading = Shading::forward;
+    bool frustum_culling = true; // skip the instances whose bounding spheres are entirely outside the view Frustum
+    float lod_error = 1;         // in pixels: the coarsest level of detail of a LodChain that is at most this far from the model is drawn
+  };
+
+  // What render_scene() did with the scene
+  struct RasterStats
+  {
+    size_t instances = 0;        // in the scene
+    size_t culled_instances = 0; // outside the view frustum, not drawn
+    // of the models (or levels of detail) of the other instances, if they have any (see detail::front_faces())
+    size_t meshlets = 0;
+    size_t culled_meshlets = 0;      // outside the view frustum, not drawn
+    size_t back_facing_meshlets = 0; // with every face turned away from the camera, not drawn
+  };
+
+  namespace detail
+  {
+    // draw the pixels of the triangle that are in the clip tile, with the rasterizer of the options
+    // p are the projections of its vertices, from the VertexCache (see face_projections())
+    inline void draw_triangle(Canvas& canvas, const auto& t, const std::array<Index2D, 3>& p, const Projection& P, const LightSet& lights, const RasterOptions& options, const Tile& clip)
+    {
+      if (options.rasterizer == Rasterizer::half_space)
+        draw_filled_triangle_halfspace(canvas, t, P, lights, clip, options.depth_test, &p);
+      else
+        draw_filled_triangle(canvas, t, P, lights, clip, options.depth_test, &p);
+    }
+
+    // the geometry pass of draw_triangle(), for deferred shading
+    inline void draw_triangle(Canvas& canvas, GBuffer& gbuffer, const Triangle3D& t, const std::array<Index2D, 3>& p, const Projection& P, const LightSet& lights, const RasterOptions& options, const Tile& clip)
+    {
+      if (options.rasterizer == Rasterizer::half_space)
+        draw_filled_triangle_halfspace(canvas, gbuffer, t, P, lights, clip, options.depth_test, &p);
+      else
+        draw_filled_triangle(canvas, gbuffer, t, P, lights, clip, options.depth_test, &p);
+    }
+
+    inline void draw_triangle(Canvas& canvas, GBuffer& gbuffer, const SuperTriangle3D& t, const std::array<Index2D, 3>& p, const Projection& P, const LightSet&, const RasterOptions& options, const Tile& clip)
+    {
+      if (options.rasterizer == Rasterizer::half_space)
+        draw_filled_triangle_halfspace(canvas, gbuffer, t, P, clip, options.depth_test, &p);
+      else
+        draw_filled_triangle(canvas, gbuffer, t, P, clip, options.depth_test, &p);
+    }
+
+    // project the vertices in the cache, once each
+    // Those behind the near plane, whose projections would overflow (or divide by 0), get (0, 0) instead: only the
+    // triangles that are clipped have them, and those are drawn from the projections of their pieces (see fill_triangle()).
+    inline void project_vertices(VertexCache& cache, const Projection& P)
+    {
+      cache.projected.resize(cache.vertices.size());
+      std::ranges::transform(cache.vertices, cache.projected.begin(), [&](const Position3D& v){ return v.z >= near_plane ? P(v) : Index2D{0, 0}; });
+    }
+
+    // the projections of the vertices of a face, from the cache
+    inline std::array<Index2D, 3> face_projections(const VertexCache& cache, const auto& face)
+    {
+      return {cache.projected[face.a], cache.projected[face.b], cache.projected[face.c]};
+    }
+
+    // is the model, transformed to camera coordinates by M, entirely outside the frustum?
+    inline bool outside(const Frustum& frustum, const auto& model, const sp3::transform& M)
+    {
+      return frustum.outside(transform_sphere(M, model.bounds));
+    }
+
+    // the model to draw with the transformation M to camera coordinates: a level of detail of a LodChain, chosen for its size
+    // on the canvas (see LodChain::select()), or any other model itself
+    template<typename TModel>
+    const auto& level_of_detail(const TModel& model, const Projection& P, const sp3::transform& M, const RasterOptions& options)
+    {
+      if constexpr (requires { model.levels; })
+        return model.select(P, M, options.lod_error);
+      else
+        return model;
+    }
+
+    // the camera (the origin of camera coordinates) in the coordinates of a model, given the transformation M from them
+    inline Position3D model_eye(const sp3::transform& M)
+    {
+      return transform_point(inverse(affine_transform(M)), {0, 0, 0});
+    }
+
+    // list the faces of the model that face the camera in the cache, from their precomputed FaceNormals, M being the
+    // transformation from model to camera coordinates
+    // The meshlets of a model that has them (see MultiNormalMesh::build_meshlets()) are culled first, as a whole, before any
+    // of their faces are tested: those outside the frustum (unless it is null) and those whose faces all face away from the
+    // camera. The faces of the others are listed in the order of the model's faces all the same (through a bit per face), so
+    // that they are drawn in the same order as without meshlets. The faces of the other models (a Mesh, or a MultiNormalMesh
+    // without meshlets) are tested one by one.
+    inline void front_faces(const auto& model, const sp3::transform& M, const Frustum* frustum, VertexCache& cache, RasterStats& stats)
+    {
+      assert(model.face_normals.size() == model.faces.size() && "the face normals are out of date: call update() on the model");
+      const auto eye = model_eye(M);
+      auto& faces = cache.faces;
+      faces.clear();
+      if constexpr (requires { model.meshlets; })
+        if (!model.meshlets.empty())
+        {
+          const auto scale = transform_sphere(M, {{0, 0, 0}, 1}).radius;
+          auto& bits = cache.face_bits;
+          bits.assign((model.faces.size() + 63) / 64, 0);
+          for (const auto& meshlet : model.meshlets)
+          {
+            if (frustum && frustum->outside({M(meshlet.bounds.center), meshlet.bounds.radius * scale}))
+            {
+              ++stats.culled_meshlets;
+              continue;
+            }
+            if (meshlet.cone.back_facing(meshlet.bounds, eye))
+            {
+              ++stats.back_facing_meshlets;
+              continue;
+            }
+
+            for (const auto i : meshlet.faces)
+              if (!model.face_normals[i].back_facing(eye))
+                bits[i / 64] |= std::uint64_t{1} << (i % 64);
+          }
+          stats.meshlets += model.meshlets.size();
+
+          for (size_t w = 0; w < bits.size(); ++w)
+            for (auto b = bits[w]; b != 0; b &= b - 1)
+              faces.push_back(static_cast<std::uint32_t>(64 * w + std::countr_zero(b)));
+          return;
+        }
+
+      for (size_t i = 0; i < model.face_normals.size(); ++i)
+        if (!model.face_normals[i].back_facing(eye))
+          faces.push_back(static_cast<std::uint32_t>(i));
+    }
+
+    // draw the front facing triangles of the model, gathered from its vertices transformed and projected into the cache
+    // The back faces (and the meshlets outside the frustum, with options.frustum_culling) are culled in model coordinates
+    // first, so they are never assembled, and if there is no front face nothing is transformed.
+    void render_model(Canvas& canvas, VertexCache& cache, auto&& model, const Projection& P, const sp3::transform& M, const LightSet& lights, const RasterOptions& options, const Frustum& frustum, RasterStats& stats)
+    {
+      front_faces(model, M, options.frustum_culling ? &frustum : nullptr, cache, stats);
+      if (cache.faces.empty())
+        return;
+
+      model.transform(cache, M);
+      project_vertices(cache, P);
+      const auto clip = whole_canvas(canvas.extent());
+      const auto triangles = model.triangles(cache);
+      for (const auto i : cache.faces)
+        draw_triangle(canvas, triangles[i], face_projections(cache, model.faces[i]), P, lights, options, clip);
+    }
+
+    // the geometry pass of render_model()
+    void render_model(Canvas& canvas, GBuffer& gbuffer, VertexCache& cache, auto&& model, const Projection& P, const sp3::transform& M, const LightSet& lights, const RasterOptions& options, const Frustum& frustum, RasterStats& stats)
+    {
+      front_faces(model, M, options.frustum_culling ? &frustum : nullptr, cache, stats);
+      if (cache.faces.empty())
+        return;
+
+      model.transform(cache, M);
+      project_vertices(cache, P);
+      const auto clip = whole_canvas(canvas.extent());
+      const auto triangles = model.triangles(cache);
+      for (const auto i : cache.faces)
+        draw_triangle(canvas, gbuffer, triangles[i], face_projections(cache, model.faces[i]), P, lights, options, clip);
+    }
   }
 
   // P is the projection operator from camera to canvas coordinates
   // M is the transformation from model to camera coordinates
-  void render_model(cgfs::Canvas& canvas, auto&& model, const cgfs::Projection& P, const sp3::transform& M, const std::vector<Light>& lights = {})
+  void render_model(cgfs::Canvas& canvas, auto&& model, const cgfs::Projection& P, const sp3::transform& M, const LightSet& lights = {}, const RasterOptions& options = {})
   {
-    const auto front_facing = [](const auto& t){ return !detail::is_back_facing(t); };
+    auto cache = VertexCache{};
+    const auto frustum = Frustum{P, detail::near_plane};
+    auto stats = RasterStats{1};
+    if (options.shading == Shading::deferred)
+    {
+      auto gbuffer = GBuffer{canvas.extent()};
+      detail::render_model(canvas, gbuffer, cache, detail::level_of_detail(model, P, M, options), P, M, lights, options, frustum, stats);
+      shade_deferred(canvas, gbuffer, P.viewport().distance, lights, detail::whole_canvas(canvas.extent()));
+      return;
+    }
 
-    for (const auto& t : model.triangles(M) | std::views::filter(front_facing))
-      draw_filled_triangle(canvas, t, P, lights);
+    detail::render_model(canvas, cache, detail::level_of_detail(model, P, M, options), P, M, lights, options, frustum, stats);
   }
 
-  void render_scene(cgfs::Canvas& canvas, auto&& scene, const cgfs::Camera& camera)
+  // (with the lights as a scene lists them: prefer making their LightSet once, for all the models)
+  void render_model(cgfs::Canvas& canvas, auto&& model, const cgfs::Projection& P, const sp3::transform& M, const std::vector<Light>& lights, const RasterOptions& options = {})
+  {
+    render_model(canvas, model, P, M, LightSet{lights}, options);
+  }
+
+  // With options.frustum_culling, the instances whose bounding spheres are entirely outside the view frustum are skipped
+  // before any of their vertices are transformed, and so are the meshlets of the others (see detail::front_faces()).
+  // The instances of a LodChain are drawn with the level of detail that their size on the canvas calls for.
+  RasterStats render_scene(cgfs::Canvas& canvas, auto&& scene, const cgfs::Camera& camera, const RasterOptions& options = {})
   {
     // M_camera is the transformation from world to camera coordinates
     const auto M_camera = cgfs::make_camera_matrix(camera.pose());
@@ -150,8 +486,168 @@ namespace cgfs
     // P is the projection operator from camera to canvas coordinates
     const auto P = camera.projection(canvas.extent());
 
+    const auto lights = LightSet{scene.lights};
+
+    // nothing behind the near plane is drawn (see draw_filled_triangle())
+    const auto frustum = Frustum{P, detail::near_plane};
+    auto stats = RasterStats{scene.instances.size()};
+    const auto culled = [&](const auto& model, const sp3::transform& M){
+      const auto outside = options.frustum_culling && detail::outside(frustum, model, M);
+      stats.culled_instances += outside;
+      return outside;
+    };
+
+    // the buffers of one instance are reused for the next
+    auto cache = VertexCache{};
+
+    if (options.shading == Shading::deferred)
+    {
+      // one G-buffer for all the instances, so that each pixel is shaded only once
+      auto gbuffer = GBuffer{canvas.extent()};
+      for (const auto& I : scene.instances)
+      {
+        const auto M = M_camera * I.transform;
+        if (!culled(*I.model, M))
+          detail::render_model(canvas, gbuffer, cache, detail::level_of_detail(*I.model, P, M, options), P, M, lights, options, frustum, stats);
+      }
+      shade_deferred(canvas, gbuffer, P.viewport().distance, lights, detail::whole_canvas(canvas.extent()));
+      return stats;
+    }
+
     // I.transform is the transformation from model to world coordinates
     for (const auto& I : scene.instances)
-      render_model(canvas, I.model, P, M_camera * I.transform, scene.lights);
+    {
+      const auto M = M_camera * I.transform;
+      if (!culled(*I.model, M))
+        detail::render_model(canvas, cache, detail::level_of_detail(*I.model, P, M, options), P, M, lights, options, frustum, stats);
+    }
+    return stats;
+  }
+
+  // Render the scene on the threads of the pool, in two parallel passes (sort-middle):
+  //  1. The instances outside the view frustum are culled (see the serial render_scene()), and so are the meshlets and the
+  //     back faces of the others (or of their levels of detail), in model coordinates. Their vertices are transformed to camera coordinates and projected, once each, and their
+  //     front facing triangles, gathered from them, are binned in batches of consecutive triangles: each batch sorts the
+  //     triangles into bins, one per band of the canvas they overlap.
+  //  2. The bands are drawn, each one drawing the triangles in its bins, batch by batch, clipped to its rows.
+  // Each band owns its rows of the color, depth and G-buffers, so the threads need no locks, and the triangles that
+  // cover a pixel are depth tested in the same order as by the serial render_scene(), so the output is identical to it.
+  RasterStats render_scene(cgfs::Canvas& canvas, auto&& scene, const cgfs::Camera& camera, WorkStealingPool& pool, const RasterOptions& options = {})
+  {
+    const auto M_camera = cgfs::make_camera_matrix(camera.pose());
+    const auto P = camera.projection(canvas.extent());
+    const auto lights = LightSet{scene.lights};
+
+    const auto Cw = canvas.extent().width;
+    const auto Ch = canvas.extent().height;
+    // whole depth tiles, so that no two threads update the same one
+    constexpr auto T = Canvas::depth_tile_size;
+    const auto band_height = (std::max(options.band_height, 1) + T - 1) / T * T;
+    const auto num_bands = static_cast<size_t>((Ch + band_height - 1) / band_height);
+
+    // the model (or level of detail) drawn for each visible instance, its front faces, and its vertices in camera coordinates
+    // and projected
+    const auto frustum = Frustum{P, detail::near_plane};
+    using Model = std::remove_cvref_t<decltype(detail::level_of_detail(*scene.instances.front().model, P, M_camera, options))>;
+    auto models = std::vector<const Model*>(scene.instances.size(), nullptr);
+    auto caches = std::vector<VertexCache>(scene.instances.size());
+    auto meshlet_stats = std::vector<RasterStats>(scene.instances.size());
+    pool.parallel_for(scene.instances.size(), [&](size_t i){
+      const auto& I = scene.instances[i];
+      const auto M = M_camera * I.transform;
+      if (options.frustum_culling && detail::outside(frustum, *I.model, M))
+        return;
+
+      const auto& model = detail::level_of_detail(*I.model, P, M, options);
+      models[i] = &model;
+      detail::front_faces(model, M, options.frustum_culling ? &frustum : nullptr, caches[i], meshlet_stats[i]);
+      if (caches[i].faces.empty())
+        return;
+
+      model.transform(caches[i], M);
+      detail::project_vertices(caches[i], P);
+    });
+
+    using Triangle = std::ranges::range_value_t<decltype(std::declval<const Model&>().triangles(caches.front()))>;
+    struct Batch
+    {
+      size_t instance = 0;
+      size_t first = 0; // the front faces [first, last) of the instance's model (in the faces of its cache)
+      size_t last = 0;
+      std::vector<Triangle> triangles = {};              // the ones on the canvas, in camera coordinates
+      std::vector<std::array<Index2D, 3>> projected = {}; // the projections of their vertices
+      std::vector<std::vector<std::uint32_t>> bins = {}; // for each band, the positions in triangles of those that overlap it
+    };
+
+    // in the order the serial render_scene() draws the triangles
+    constexpr size_t BATCH_SIZE = 1024;
+    auto batches = std::vector<Batch>{};
+    for (size_t i = 0; i < scene.instances.size(); ++i)
+    {
+      if (!models[i])
+        continue;
+
+      const auto num_faces = caches[i].faces.size();
+      for (size_t first = 0; first < num_faces; first += BATCH_SIZE)
+        batches.push_back({i, first, std::min(first + BATCH_SIZE, num_faces)});
+    }
+
+    pool.parallel_for(batches.size(), [&](size_t b){
+      auto& batch = batches[b];
+      const auto& model = *models[batch.instance];
+      const auto& cache = caches[batch.instance];
+      const auto triangles = model.triangles(cache);
+      batch.bins.resize(num_bands);
+      for (auto k = batch.first; k < batch.last; ++k)
+      {
+        const auto i = cache.faces[k];
+
+        // the rows of the canvas that the triangle overlaps, in screen coordinates
+        // (all of them for a triangle that crosses the near plane, whose projection is clipped as it is drawn)
+        const auto& face = model.faces[i];
+        const auto crosses_near = std::ranges::any_of(std::array{face.a, face.b, face.c}, [&](size_t v){ return cache.vertices[v].z < detail::near_plane; });
+        const auto p = detail::face_projections(cache, face);
+        const auto y_min = std::min({p[0].y, p[1].y, p[2].y});
+        const auto y_max = std::max({p[0].y, p[1].y, p[2].y});
+        const auto Sy_first = crosses_near ? 0 : std::max(Ch/2 - y_max, 0);
+        const auto Sy_last = crosses_near ? Ch - 1 : std::min(Ch/2 - y_min, Ch - 1);
+        if (Sy_last < Sy_first)
+          continue;
+
+        const auto position = static_cast<std::uint32_t>(batch.triangles.size());
+        batch.triangles.push_back(triangles[i]);
+        batch.projected.push_back(p);
+        for (auto band = Sy_first / band_height; band <= Sy_last / band_height; ++band)
+          batch.bins[band].push_back(position);
+      }
+    });
+
+    // with deferred shading, each band is shaded once all the triangles in it are drawn
+    auto gbuffer = options.shading == Shading::deferred ? GBuffer{canvas.extent()} : GBuffer{{0, 0}};
+    pool.parallel_for(num_bands, [&](size_t band){
+      const auto Sy = static_cast<int>(band) * band_height;
+      const auto clip = Tile{0, Sy, Cw, std::min(Sy + band_height, Ch)};
+      if (options.shading == Shading::deferred)
+      {
+        for (const auto& batch : batches)
+          for (const auto position : batch.bins[band])
+            detail::draw_triangle(canvas, gbuffer, batch.triangles[position], batch.projected[position], P, lights, options, clip);
+        shade_deferred(canvas, gbuffer, P.viewport().distance, lights, clip);
+        return;
+      }
+
+      for (const auto& batch : batches)
+        for (const auto position : batch.bins[band])
+          detail::draw_triangle(canvas, batch.triangles[position], batch.projected[position], P, lights, options, clip);
+    });
+
+    auto stats = RasterStats{scene.instances.size(), static_cast<size_t>(std::ranges::count(models, nullptr))};
+    for (const auto& s : meshlet_stats)
+    {
+      stats.meshlets += s.meshlets;
+      stats.culled_meshlets += s.culled_meshlets;
+      stats.back_facing_meshlets += s.back_facing_meshlets;
+    }
+    return stats;
   }
 }
@@ -1,73 +1,33 @@
 #include "scene.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cmath>
+#include <cstdint>
 #include <limits>
+#include <span>
 #include <utility>
+#include <vector>
 
 namespace cgfs
 {
-  namespace
-  {
-    constexpr cgfs::Color BACKGROUND_COLOR = Palette1::DarkGray;
-
-    std::pair<float, float> intersect_ray_sphere(Position3D O, Vector3D D, const Sphere& sphere)
-    {
-      const auto OC = O - sphere.center;
-      const auto k1 = dot(D, D);
-      const auto k2 = 2 * dot(OC, D);
-      const auto k3 = dot(OC, OC) - sphere.radius * sphere.radius;
-      const auto discriminant = k2 * k2 - 4 * k1 * k3;
-      if(discriminant < 0) return {std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
-      const auto t1 = (-k2 + std::sqrt(discriminant)) / (2 * k1);
-      const auto t2 = (-k2 - std::sqrt(discriminant)) / (2 * k1);
-      return {t1, t2};
-    }
-    
-    // Returns the sphere closest to the origin of the ray and the value of t at the point of intersection.
-    // If no sphere is intersected, the first element of the pair is cgfs::null_sphere.
-    std::pair<Sphere, float> closest_intersection(const Ray3D& ray, const std::vector<Sphere>& spheres)
-    {
-      auto closest_t = std::numeric_limits<float>::infinity();
-      auto closest_sphere = cgfs::Sphere{};
-      const auto& t_min = ray.t_min;
-      const auto& t_max = ray.t_max;
-      for(const auto& sphere : spheres)
-      {
-        const auto [t1, t2] = intersect_ray_sphere(ray.origin, ray.direction, sphere);
-        if(t_min < t1 && t1 < t_max && t1 < closest_t)
-        {
-          closest_t = t1;
-          closest_sphere = sphere;
-        }
-        if(t_min < t2 && t2 < t_max && t2 < closest_t)
-        {
-          closest_t = t2;
-          closest_sphere = sphere;
-        }
-      }
-
-      return {closest_sphere, closest_t};
-    }
-  }
-
-
   // sp point on the surface
   // V is the "view vector" (the direction from the surface point to the camera)
-  inline float compute_lighting(const SurfacePoint& sp, const Vector3D& V, const std::vector<Light>& lights, const std::vector<Sphere>& obstacles)
+  inline float compute_lighting(const SurfacePoint& sp, const Vector3D& V, const LightSet& lights, const Scene& scene)
   {
-    auto blocked = [&](const Light& light) -> bool
+    // which lights are blocked, on the stack for up to 16 of them
+    auto few = std::array<unsigned char, 16>{};
+    auto many = std::vector<unsigned char>{};
+    if (lights.num_blockable() > few.size())
+      many.resize(lights.num_blockable());
+    const auto blocked = many.empty() ? std::span{few}.first(lights.num_blockable()) : std::span{many};
+    lights.for_each_back_ray(sp.pos, [&](size_t k, const Ray3D& back_ray)
     {
-      auto ray = light.back_ray(sp.pos);
-      if (ray == cgfs::null_ray3d)
-        return false;
-      ray.t_min = 0.001f;
-      const auto [shadow_sphere, shadow_t] = closest_intersection(ray, obstacles);
-      return shadow_sphere != cgfs::null_sphere;
-    };
-
-    return std::accumulate(lights.begin(), lights.end(), 0.0f, [&](float acc, const Light& light) {
-        return blocked(light) ? acc : acc + light.intensity(sp, V);
+      const auto ray = Scene::shadow_ray(back_ray);
+      blocked[k] = ray != cgfs::null_ray3d && scene.occluded(ray);
     });
+    return lights.intensity(sp, V, blocked);
   }
 
   // Reflect the vector R around the normal N
@@ -81,26 +41,114 @@ namespace cgfs
 {
   Color Scene::trace_ray(const Ray3D& ray, size_t recursion_depth) const
   {
-    const auto [closest_sphere, closest_t] = closest_intersection(ray, m_spheres);
+    return shade(ray, intersect(ray), recursion_depth);
+  }
+
+  HitRecord Scene::intersect(const Ray3D& ray) const
+  {
+    auto hit = HitRecord{};
+    auto t_max = ray.t_max;
+    m_bvh.traverse(ray, t_max, [&](std::uint32_t first, std::uint32_t last)
+    {
+      auto leaf_hit = SphereHit{};
+      if (m_packed.nearest_hit(ray.origin, ray.direction, first, last, ray.t_min, t_max, leaf_hit))
+      {
+        // nothing beyond the closest hit can be closer
+        hit = {m_bvh.primitives()[leaf_hit.position], leaf_hit.t};
+        t_max = leaf_hit.t;
+      }
+    });
+    return hit;
+  }
 
-    if (closest_sphere == cgfs::null_sphere)
+  void Scene::intersect(std::span<const Ray3D> rays, std::span<HitRecord> hits) const
+  {
+    for (size_t start = 0; start < rays.size(); start += max_packet_size)
     {
-      return BACKGROUND_COLOR;
+      const auto packet = rays.subspan(start, std::min(max_packet_size, rays.size() - start));
+      auto t_max = std::array<float, max_packet_size>{};
+      auto leaf_hits = std::array<SphereHit, max_packet_size>{};
+      for (size_t i = 0; i < packet.size(); ++i)
+      {
+        t_max[i] = packet[i].t_max;
+        hits[start + i] = HitRecord{};
+      }
+
+      m_bvh.traverse(packet, std::span{t_max}.first(packet.size()), [&](std::uint32_t first, std::uint32_t last, std::uint32_t mask)
+      {
+        // nothing beyond the closest hit of a ray can be closer, nearest_hits() reduces t_max accordingly
+        const auto found = m_packed.nearest_hits(packet, mask, first, last, t_max, leaf_hits);
+        for (auto bits = found; bits != 0; bits &= bits - 1)
+        {
+          const auto i = std::countr_zero(bits);
+          hits[start + i] = {m_bvh.primitives()[leaf_hits[i].position], leaf_hits[i].t};
+        }
+      });
+    }
+  }
+
+  void Scene::trace_rays(std::span<const Ray3D> rays, std::span<Color> colors, size_t recursion_depth) const
+  {
+    auto hits = std::array<HitRecord, max_packet_size>{};
+    for (size_t start = 0; start < rays.size(); start += max_packet_size)
+    {
+      const auto packet = rays.subspan(start, std::min(max_packet_size, rays.size() - start));
+      intersect(packet, std::span{hits}.first(packet.size()));
+      for (size_t i = 0; i < packet.size(); ++i)
+        colors[start + i] = shade(packet[i], hits[i], recursion_depth);
     }
+  }
 
-    const auto P = ray.origin + closest_t * ray.direction;
-    const auto sp = SurfacePoint{P, {P - closest_sphere.center}, closest_sphere.specular};
-    const auto local_color = closest_sphere.color * compute_lighting(sp, -ray.direction, m_lights, m_spheres);
+  Color Scene::shade(const Ray3D& ray, const HitRecord& hit, size_t recursion_depth) const
+  {
+    if (!hit)
+    {
+      return background_color;
+    }
 
-    const auto r = closest_sphere.reflective;
+    // only the sphere that was hit is looked at for shading
+    const auto& sphere = m_spheres[hit.primitive];
+
+    const auto sp = surface_point(ray, hit);
+    const auto local_color = sphere.color * compute_lighting(sp, -ray.direction, m_light_set, *this);
+
+    const auto r = sphere.reflective;
     if (recursion_depth == 0 || r == 0)
     {
       return local_color;
     }
 
-    const auto reflected_ray = Ray3D{sp.pos, reflect(-ray.direction, sp.normal), 0.001f, std::numeric_limits<float>::infinity()};
-    const auto reflected_color = trace_ray(reflected_ray, recursion_depth - 1);
+    const auto reflected_color = trace_ray(reflected_ray(ray, sp), recursion_depth - 1);
 
     return (1 - r) * local_color + r * reflected_color;
   }
-}
\ No newline at end of file
+
+  SurfacePoint Scene::surface_point(const Ray3D& ray, const HitRecord& hit) const
+  {
+    const auto& sphere = m_spheres[hit.primitive];
+    const auto P = ray.origin + hit.t * ray.direction;
+    return {P, {P - sphere.center}, sphere.specular};
+  }
+
+  Ray3D Scene::shadow_ray(const Ray3D& back_ray)
+  {
+    if (back_ray == cgfs::null_ray3d)
+      return back_ray;
+    auto ray = back_ray;
+    ray.t_min = 0.001f;
+    return ray;
+  }
+
+  Ray3D Scene::reflected_ray(const Ray3D& ray, const SurfacePoint& sp)
+  {
+    return {sp.pos, reflect(-ray.direction, sp.normal), 0.001f, std::numeric_limits<float>::infinity()};
+  }
+
+  bool Scene::occluded(const Ray3D& ray) const
+  {
+    return m_bvh.any(ray, [&](std::uint32_t first, std::uint32_t last)
+    {
+      return m_packed.any_hit(ray.origin, ray.direction, first, last, ray.t_min, ray.t_max);
+    });
+  }
+}
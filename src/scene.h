@@ -1,11 +1,14 @@
 #pragma once
 
+#include "bvh.h"
 #include "color.h"
 #include "instance.h"
 #include "light.h"
+#include "packed_spheres.h"
 #include "position.h"
 #include "sphere.h"
 
+#include <span>
 #include <vector>
 
 namespace cgfs
@@ -13,10 +16,15 @@ namespace cgfs
   class Scene
   {
   public:
+    static constexpr size_t max_packet_size = PackedSpheres::max_packet_size;
+
     explicit Scene(std::vector<Sphere> spheres, std::vector<Light> lights = {})
     : m_spheres{std::move(spheres)}
+    , m_bvh{m_spheres}
+    , m_packed{m_spheres, m_bvh.primitives()}
     {
       m_lights = std::move(lights);
+      m_light_set = LightSet{m_lights};
     }
 
     /*
@@ -25,9 +33,58 @@ namespace cgfs
     */
     Color trace_ray(const Ray3D& ray, size_t recursion_depth = 3) const;
 
+    /*
+    *   Find the object closest to the origin of the ray with ray.t_min < t < ray.t_max.
+    *   The primitive of the hit record is an index into spheres().
+    */
+    HitRecord intersect(const Ray3D& ray) const;
+
+    /*
+    *   intersect() for a packet of rays, e.g. the primary rays of neighbouring pixels, which are coherent.
+    *   The rays are traced through the scene together, max_packet_size at a time, sharing the memory accesses.
+    */
+    void intersect(std::span<const Ray3D> rays, std::span<HitRecord> hits) const;
+
+    /*
+    *   trace_ray() for a packet of rays. The rays are traced together up to the first hit; the reflected
+    *   and shadow rays, which diverge, are traced one at a time.
+    */
+    void trace_rays(std::span<const Ray3D> rays, std::span<Color> colors, size_t recursion_depth = 3) const;
+
+    /*
+    *   Is any object hit by the ray with ray.t_min < t < ray.t_max?
+    *   Stops at the first hit found, which makes it cheaper than finding the closest one (e.g. for shadow rays).
+    */
+    bool occluded(const Ray3D& ray) const;
+
+    /*
+    *   The steps of trace_ray(), for renderers that schedule the work themselves (e.g. the WavefrontRenderer).
+    */
+    static constexpr Color background_color = Palette1::DarkGray;
+
+    // the color seen along the ray, given its closest hit: trace_ray(ray, depth) == shade(ray, intersect(ray), depth)
+    Color shade(const Ray3D& ray, const HitRecord& hit, size_t recursion_depth = 3) const;
+
+    // the point on spheres()[hit.primitive] where the ray hit it
+    SurfacePoint surface_point(const Ray3D& ray, const HitRecord& hit) const;
+
+    // the ray traced to find out whether something blocks a light, given its back_ray() from a surface point
+    // (null_ray3d if the back ray is)
+    static Ray3D shadow_ray(const Ray3D& back_ray);
+
+    // the ray reflected at sp
+    static Ray3D reflected_ray(const Ray3D& ray, const SurfacePoint& sp);
+
+    const std::vector<Sphere>& spheres() const { return m_spheres; }
+    const std::vector<Light>& lights() const { return m_lights; }
+    const LightSet& light_set() const { return m_light_set; }
+
   private:
     std::vector<Sphere> m_spheres;
+    SphereBVH m_bvh;
+    PackedSpheres m_packed; // the geometry of m_spheres in the leaf order of m_bvh
     std::vector<Light> m_lights;
+    LightSet m_light_set; // m_lights, sorted by kind
   };
     
 
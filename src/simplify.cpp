@@ -0,0 +1,318 @@
+#include "simplify.h"
+
+#include "sp3/transform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <utility>
+
+namespace cgfs
+{
+  namespace
+  {
+    // The sum of the squared distances of a point to a set of planes (with weights), as the symmetric 4x4 matrix of a
+    // quadratic form, and the sum of the weights
+    struct Quadric
+    {
+      std::array<double, 10> q = {}; // the upper triangle of the matrix, row by row
+      double weight = 0;
+
+      // the squared distance to the plane through p with the normal n, times weight
+      static Quadric plane(const Position3D& p, const Vector3D& n, double weight)
+      {
+        const auto length = std::sqrt(double{sp3::dot(n, n)});
+        if (length == 0)
+          return {};
+
+        const auto a = n.x / length;
+        const auto b = n.y / length;
+        const auto c = n.z / length;
+        const auto d = -(a * p.x + b * p.y + c * p.z);
+        return {{
+          weight * a * a, weight * a * b, weight * a * c, weight * a * d,
+          weight * b * b, weight * b * c, weight * b * d,
+          weight * c * c, weight * c * d,
+          weight * d * d
+        }, weight};
+      }
+
+      Quadric& operator+=(const Quadric& other)
+      {
+        for (size_t i = 0; i < q.size(); ++i)
+          q[i] += other.q[i];
+        weight += other.weight;
+        return *this;
+      }
+
+      // the mean of the squared distances to the planes, by their weights
+      double error(const Position3D& p) const
+      {
+        if (weight == 0)
+          return 0;
+
+        const double x = p.x;
+        const double y = p.y;
+        const double z = p.z;
+        const auto e = q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+                     + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+                     + q[7] * z * z + 2 * q[8] * z
+                     + q[9];
+        return std::max(e / weight, 0.0); // not below 0 by a rounding error
+      }
+    };
+
+    // Moving the vertex 'from' onto the vertex 'to', as long as neither has changed since the cost was computed
+    struct Collapse
+    {
+      double cost = 0;
+      std::uint32_t from = 0;
+      std::uint32_t to = 0;
+      std::uint32_t from_version = 0;
+      std::uint32_t to_version = 0;
+
+      bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    class Simplifier
+    {
+    public:
+      Simplifier(std::span<const Position3D> vertices, std::span<const std::array<size_t, 3>> faces)
+      : m_vertices{vertices}
+      , m_faces(faces.size())
+      , m_sources(faces.size())
+      , m_alive(faces.size(), 0)
+      , m_normals(faces.size())
+      , m_vertex_faces(vertices.size())
+      , m_quadrics(vertices.size())
+      , m_versions(vertices.size(), 0)
+      , m_removed(vertices.size(), 0)
+      {
+        // the faces of each edge, to find the ones on the border
+        auto edge_faces = std::map<std::pair<std::uint32_t, std::uint32_t>, std::vector<std::uint32_t>>{};
+        for (size_t f = 0; f < faces.size(); ++f)
+        {
+          auto& face = m_faces[f];
+          for (size_t k = 0; k < 3; ++k)
+          {
+            face[k] = static_cast<std::uint32_t>(faces[f][k]);
+            m_sources[f][k] = static_cast<std::uint32_t>(3 * f + k);
+          }
+          if (face[0] == face[1] || face[1] == face[2] || face[2] == face[0])
+            continue;
+
+          m_alive[f] = 1;
+          ++m_faces_left;
+          // weighted by its area
+          const auto n = normal(face);
+          m_normals[f] = n;
+          const auto plane = Quadric::plane(m_vertices[face[0]], n, std::sqrt(sp3::dot(n, n)) / 2);
+          for (const auto v : face)
+          {
+            m_vertex_faces[v].push_back(static_cast<std::uint32_t>(f));
+            m_quadrics[v] += plane;
+          }
+          for (size_t k = 0; k < 3; ++k)
+            edge_faces[std::minmax(face[k], face[(k + 1) % 3])].push_back(static_cast<std::uint32_t>(f));
+        }
+
+        for (const auto& [edge, edge_face] : edge_faces)
+        {
+          if (edge_face.size() != 1)
+            continue;
+
+          // weighted by the square of its length, like the area of a face
+          const auto& [u, v] = edge;
+          const auto e = m_vertices[v] - m_vertices[u];
+          const auto border = Quadric::plane(m_vertices[u], sp3::cross(e, normal(m_faces[edge_face.front()])), sp3::dot(e, e));
+          m_quadrics[u] += border;
+          m_quadrics[v] += border;
+        }
+
+        for (const auto& [edge, edge_face] : edge_faces)
+          push_collapses(edge.first, edge.second);
+      }
+
+      // collapse edges, the cheapest first, until at most target faces are left or no edge can be collapsed
+      void collapse_until(size_t target)
+      {
+        while (m_faces_left > target && !m_queue.empty())
+        {
+          const auto c = m_queue.top();
+          m_queue.pop();
+          if (m_removed[c.from] || m_removed[c.to] || c.from_version != m_versions[c.from] || c.to_version != m_versions[c.to])
+            continue;
+          if (can_collapse(c.from, c.to))
+            collapse(c);
+        }
+      }
+
+      SimplifiedFaces result() const
+      {
+        auto result = SimplifiedFaces{};
+        result.faces.reserve(m_faces_left);
+        result.corners.reserve(m_faces_left);
+        result.sources.reserve(m_faces_left);
+        for (size_t f = 0; f < m_faces.size(); ++f)
+        {
+          if (!m_alive[f])
+            continue;
+
+          const auto& [a, b, c] = m_faces[f];
+          const auto& [sa, sb, sc] = m_sources[f];
+          result.faces.push_back(f);
+          result.corners.push_back({a, b, c});
+          result.sources.push_back({sa, sb, sc});
+        }
+        result.error = static_cast<float>(std::sqrt(m_error));
+        return result;
+      }
+
+    private:
+      using Face = std::array<std::uint32_t, 3>;
+
+      // not of unit length
+      Vector3D normal(const Face& face) const
+      {
+        const auto& a = m_vertices[face[0]];
+        return sp3::cross(m_vertices[face[1]] - a, m_vertices[face[2]] - a);
+      }
+
+      // the vertices that share a face with v
+      std::vector<std::uint32_t> neighbours(std::uint32_t v) const
+      {
+        auto result = std::vector<std::uint32_t>{};
+        for (const auto f : m_vertex_faces[v])
+          if (m_alive[f])
+            for (const auto w : m_faces[f])
+              if (w != v)
+                result.push_back(w);
+        std::ranges::sort(result);
+        const auto [first, last] = std::ranges::unique(result);
+        result.erase(first, last);
+        return result;
+      }
+
+      bool can_collapse(std::uint32_t from, std::uint32_t to) const
+      {
+        // the faces of the edge disappear, and with them the vertices they share: if the ends of the edge have any other
+        // neighbour in common, collapsing it would join the mesh to itself there
+        const auto shared = std::ranges::count_if(m_vertex_faces[from], [&](std::uint32_t f){
+          return m_alive[f] && std::ranges::find(m_faces[f], to) != m_faces[f].end();
+        });
+        if (shared == 0)
+          return false; // no longer an edge
+
+        const auto from_neighbours = neighbours(from);
+        const auto to_neighbours = neighbours(to);
+        auto common = std::vector<std::uint32_t>{};
+        std::ranges::set_intersection(from_neighbours, to_neighbours, std::back_inserter(common));
+        if (static_cast<std::ptrdiff_t>(common.size()) != shared)
+          return false;
+
+        // the other faces around 'from' must not turn over, neither from where they are nor from where they started (which
+        // a face could otherwise get to a little at a time), nor turn by more than 60 degrees at once, which keeps them from
+        // being flattened into slivers, whose normals are only rounding errors
+        for (const auto f : m_vertex_faces[from])
+        {
+          if (!m_alive[f] || std::ranges::find(m_faces[f], to) != m_faces[f].end())
+            continue;
+
+          auto moved = m_faces[f];
+          std::ranges::replace(moved, from, to);
+          const auto before = normal(m_faces[f]);
+          const auto after = normal(moved);
+          const auto cosine = double{sp3::dot(before, after)} / std::sqrt(double{sp3::dot(before, before)} * sp3::dot(after, after));
+          if (!(cosine > 0.5) || !(sp3::dot(m_normals[f], after) > 0))
+            return false;
+        }
+        return true;
+      }
+
+      void collapse(const Collapse& c)
+      {
+        // the corners moved onto 'to' take its attributes, from a corner of it on the edge, in a face that disappears
+        auto to_source = std::uint32_t{0};
+        for (const auto f : m_vertex_faces[c.from])
+        {
+          const auto& face = m_faces[f];
+          if (const auto k = std::ranges::find(face, c.to) - face.begin(); m_alive[f] && k < 3)
+          {
+            to_source = m_sources[f][k];
+            break;
+          }
+        }
+
+        for (const auto f : m_vertex_faces[c.from])
+        {
+          if (!m_alive[f])
+            continue;
+
+          auto& face = m_faces[f];
+          if (std::ranges::find(face, c.to) != face.end())
+          {
+            m_alive[f] = 0;
+            --m_faces_left;
+            continue;
+          }
+          for (size_t k = 0; k < 3; ++k)
+            if (face[k] == c.from)
+            {
+              face[k] = c.to;
+              m_sources[f][k] = to_source;
+            }
+          m_vertex_faces[c.to].push_back(f);
+        }
+        m_vertex_faces[c.from].clear();
+        std::erase_if(m_vertex_faces[c.to], [&](std::uint32_t f){ return !m_alive[f]; });
+        m_removed[c.from] = 1;
+        m_quadrics[c.to] += m_quadrics[c.from];
+        ++m_versions[c.to];
+        m_error = std::max(m_error, c.cost);
+
+        // the costs of the edges of 'to' have changed
+        for (const auto w : neighbours(c.to))
+          push_collapses(c.to, w);
+      }
+
+      // the collapses of the edge uv, either way
+      void push_collapses(std::uint32_t u, std::uint32_t v)
+      {
+        auto Q = m_quadrics[u];
+        Q += m_quadrics[v];
+        m_queue.push({Q.error(m_vertices[v]), u, v, m_versions[u], m_versions[v]});
+        m_queue.push({Q.error(m_vertices[u]), v, u, m_versions[v], m_versions[u]});
+      }
+
+      std::span<const Position3D> m_vertices;
+      std::vector<Face> m_faces;
+      std::vector<Face> m_sources; // the corners of the mesh (3 f + k) that the corners of the faces take their attributes from
+      std::vector<unsigned char> m_alive;
+      std::vector<Vector3D> m_normals; // of the faces of the mesh, before it is simplified
+      std::vector<std::vector<std::uint32_t>> m_vertex_faces; // the faces around each vertex (and some that are gone)
+      std::vector<Quadric> m_quadrics;
+      std::vector<std::uint32_t> m_versions; // incremented when the quadric of the vertex changes
+      std::vector<unsigned char> m_removed;
+      std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> m_queue;
+      size_t m_faces_left = 0;
+      double m_error = 0; // the largest cost of a collapse so far
+    };
+  }
+
+  std::vector<SimplifiedFaces> simplify(std::span<const Position3D> vertices, std::span<const std::array<size_t, 3>> faces, std::span<const size_t> face_counts)
+  {
+    auto simplifier = Simplifier{vertices, faces};
+    auto results = std::vector<SimplifiedFaces>{};
+    results.reserve(face_counts.size());
+    for (const auto count : face_counts)
+    {
+      simplifier.collapse_until(count);
+      results.push_back(simplifier.result());
+    }
+    return results;
+  }
+}
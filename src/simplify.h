@@ -0,0 +1,36 @@
+#pragma once
+
+#include "position.h"
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace cgfs
+{
+  // What is left of the faces of a model after it is simplified
+  struct SimplifiedFaces
+  {
+    std::vector<size_t> faces;                  // the faces of the model that are left, by index, in their order in the model
+    std::vector<std::array<size_t, 3>> corners; // the vertices of each of them (by index into the model's vertices), in the same order
+    std::vector<std::array<size_t, 3>> sources; // the corners of the model (3 f + k for corner k of face f) that their corners take
+                                                // their attributes (e.g. normals) from, in the same order
+    float error = 0;                            // how far the simplified surface may be from the model's (see simplify())
+  };
+
+  // Simplify the triangle mesh of the vertices and the faces (by the indices of their vertices) with the quadric error metric
+  // of Garland and Heckbert: edges are collapsed, the cheapest first, by moving one of their vertices onto the other, where the
+  // cost is the mean of the squared distances from where the vertex ends up to the planes of the faces that were around
+  // both vertices, weighted by their areas (and to planes through the edges on the border of the mesh, perpendicular to
+  // their faces, which keep the border in place).
+  // Collapses that would turn a face over or join the mesh to itself are skipped.
+  // As no vertex is moved anywhere but onto another one, the faces that are left keep their vertices and the attributes at their
+  // corners, only the vertices that are collapsed are replaced: a corner moved onto another vertex takes the attributes of that
+  // vertex, from its corner in one of the faces on the collapsed edge (which disappear with it).
+  //
+  // Returns the mesh when it is first simplified down to each of the face counts (in decreasing order), or as far as it can be.
+  // The error is the square root of the largest cost so far: about how far (in the units of the vertices) the simplified
+  // surface is from the surface of the mesh where it is farthest from it.
+  std::vector<SimplifiedFaces> simplify(std::span<const Position3D> vertices, std::span<const std::array<size_t, 3>> faces, std::span<const size_t> face_counts);
+}
@@ -0,0 +1,114 @@
+#include "supersampling.h"
+
+#include "render.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace cgfs
+{
+  namespace
+  {
+    float radical_inverse(std::uint32_t i, std::uint32_t base)
+    {
+      auto f = 1.0f;
+      auto r = 0.0f;
+      for (; i != 0; i /= base)
+      {
+        f /= base;
+        r += f * (i % base);
+      }
+      return r;
+    }
+
+    // The i-th point of the Halton sequence in bases 2 and 3, moved to [-0.5, 0.5)^2.
+    // The first n points are well spread over the pixel for any n.
+    Position2D sample_offset(std::uint32_t i)
+    {
+      return {radical_inverse(i, 2) - 0.5f, radical_inverse(i, 3) - 0.5f};
+    }
+
+    bool differs(const Color& a, const Color& b, int threshold)
+    {
+      return std::abs(a.r - b.r) > threshold || std::abs(a.g - b.g) > threshold || std::abs(a.b - b.b) > threshold;
+    }
+  }
+
+  SupersamplingStats render_supersampled(const Scene& scene, Canvas& canvas, const Extent2D& viewport, WorkStealingPool& pool, const SupersamplingOptions& options)
+  {
+    const auto C_wh = canvas.extent();
+    const auto area = detail::render_area(C_wh);
+    const auto O = Position3D{0, 0, 0};
+    const auto primary_ray = [&](const Position3D& V_xyz){ return Ray3D{O, V_xyz - O, 1, std::numeric_limits<float>::infinity()}; };
+    const auto pixel = [&](int Sx, int Sy){ return Index2D{Sx - C_wh.width/2, C_wh.height/2 - Sy}; };
+    const auto index = [&](int Sx, int Sy){ return static_cast<size_t>(Sy) * area.width + Sx; };
+
+    // 1. One sample through the center of each pixel, keeping the sphere it hit
+    auto colors = std::vector<Color>(static_cast<size_t>(area.width) * area.height);
+    auto hit_ids = std::vector<std::uint32_t>(colors.size());
+    pool.parallel_for(area.height, [&](size_t row)
+    {
+      const auto Sy = static_cast<int>(row);
+      for (int Sx = 0; Sx < area.width; ++Sx)
+      {
+        const auto ray = primary_ray(detail::canvas_to_viewport(pixel(Sx, Sy), C_wh, viewport));
+        const auto hit = scene.intersect(ray);
+        colors[index(Sx, Sy)] = scene.shade(ray, hit);
+        hit_ids[index(Sx, Sy)] = hit.primitive;
+      }
+    });
+
+    // 2. More samples where a pixel differs from one of its neighbours
+    const auto extra_samples = static_cast<std::uint32_t>(std::max(options.max_samples, 1) - 1);
+    const auto edge = [&](int Sx, int Sy, int Nx, int Ny)
+    {
+      if (Nx < 0 || Nx >= area.width || Ny < 0 || Ny >= area.height)
+        return false;
+      const auto i = index(Sx, Sy);
+      const auto n = index(Nx, Ny);
+      return hit_ids[i] != hit_ids[n] || differs(colors[i], colors[n], options.color_threshold);
+    };
+
+    auto refined = std::vector<size_t>(area.height, 0); // per row
+    pool.parallel_for(area.height, [&](size_t row)
+    {
+      const auto Sy = static_cast<int>(row);
+      for (int Sx = 0; Sx < area.width; ++Sx)
+      {
+        const auto C_xy = pixel(Sx, Sy);
+        auto color = colors[index(Sx, Sy)];
+        if (extra_samples != 0 && (edge(Sx, Sy, Sx - 1, Sy) || edge(Sx, Sy, Sx + 1, Sy) || edge(Sx, Sy, Sx, Sy - 1) || edge(Sx, Sy, Sx, Sy + 1)))
+        {
+          auto r = static_cast<float>(color.r);
+          auto g = static_cast<float>(color.g);
+          auto b = static_cast<float>(color.b);
+          for (std::uint32_t s = 1; s <= extra_samples; ++s)
+          {
+            const auto offset = sample_offset(s);
+            const auto sample = Position2D{C_xy.x + offset.x, C_xy.y + offset.y};
+            const auto sample_color = scene.trace_ray(primary_ray(detail::subpixel_to_viewport(sample, C_wh, viewport)));
+            r += sample_color.r;
+            g += sample_color.g;
+            b += sample_color.b;
+          }
+
+          const auto n = static_cast<float>(extra_samples + 1);
+          color = {static_cast<unsigned char>(std::lround(r / n)), static_cast<unsigned char>(std::lround(g / n)), static_cast<unsigned char>(std::lround(b / n))};
+          ++refined[row];
+        }
+        canvas.putPixel(C_xy, color);
+      }
+    });
+
+    auto stats = SupersamplingStats{};
+    stats.pixels = colors.size();
+    stats.refined_pixels = std::accumulate(refined.begin(), refined.end(), size_t{0});
+    stats.extra_rays = stats.refined_pixels * extra_samples;
+    return stats;
+  }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "canvas.h"
+#include "extent.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+
+namespace cgfs
+{
+  struct SupersamplingOptions
+  {
+    int max_samples = 16;     // samples per pixel at most, including the one through the center of the pixel
+    int color_threshold = 16; // a pixel gets more samples if a neighbour's color differs by more than this in any channel
+  };
+
+  struct SupersamplingStats
+  {
+    size_t pixels = 0;         // one sample through the center of each of them
+    size_t refined_pixels = 0; // the pixels that got more samples
+    size_t extra_rays = 0;     // the primary rays of those additional samples
+  };
+
+  // Ray trace the scene with adaptive supersampling, on the threads of the pool.
+  //
+  // Every pixel is sampled through its center first, exactly as render() does. The pixels whose color differs from
+  // a neighbour's by more than options.color_threshold, or whose primary ray hits a different sphere than a neighbour's
+  // (an edge, even between similar colors), are then sampled options.max_samples times in all and painted the average.
+  // Only those pixels pay for antialiasing, rather than rendering the whole frame at a higher resolution.
+  SupersamplingStats render_supersampled(const Scene& scene, Canvas& canvas, const Extent2D& viewport, WorkStealingPool& pool, const SupersamplingOptions& options = {});
+}
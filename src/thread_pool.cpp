@@ -0,0 +1,145 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace cgfs
+{
+  WorkStealingPool::WorkStealingPool(unsigned num_threads)
+  {
+    if (num_threads == 0)
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned i = 0; i < num_threads; ++i)
+      m_queues.push_back(std::make_unique<Queue>());
+
+    // worker 0 is whichever thread calls parallel_for()
+    for (unsigned i = 1; i < num_threads; ++i)
+      m_threads.emplace_back([this, i]{ worker_loop(i); });
+  }
+
+  WorkStealingPool::~WorkStealingPool()
+  {
+    {
+      std::lock_guard lock{m_mutex};
+      m_stop = true;
+    }
+    m_work_available.notify_all();
+
+    for (auto& thread : m_threads)
+      thread.join();
+  }
+
+  void WorkStealingPool::parallel_for(size_t num_tasks, const std::function<void(size_t)>& task)
+  {
+    if (num_tasks == 0)
+      return;
+
+    if (m_threads.empty())
+    {
+      for (size_t i = 0; i < num_tasks; ++i)
+        task(i);
+      return;
+    }
+
+    m_error = nullptr;
+    m_remaining = num_tasks;
+
+    // hand out contiguous runs of indices so that each worker starts on neighbouring tasks
+    const auto num_queues = m_queues.size();
+    for (size_t w = 0; w < num_queues; ++w)
+    {
+      auto& queue = *m_queues[w];
+      std::lock_guard lock{queue.mutex};
+      for (size_t i = w * num_tasks / num_queues; i < (w + 1) * num_tasks / num_queues; ++i)
+        queue.entries.push_back({&task, i});
+    }
+
+    {
+      std::lock_guard lock{m_mutex};
+      ++m_generation;
+    }
+    m_work_available.notify_all();
+
+    while (run_one(0))
+    {}
+
+    std::unique_lock lock{m_mutex};
+    m_batch_done.wait(lock, [this]{ return m_remaining == 0; });
+
+    if (m_error)
+      std::rethrow_exception(std::exchange(m_error, nullptr));
+  }
+
+  void WorkStealingPool::worker_loop(size_t self)
+  {
+    size_t seen = 0;
+    for (;;)
+    {
+      {
+        std::unique_lock lock{m_mutex};
+        m_work_available.wait(lock, [&]{ return m_stop || m_generation != seen; });
+        if (m_stop)
+          return;
+        seen = m_generation;
+      }
+
+      while (run_one(self))
+      {}
+    }
+  }
+
+  bool WorkStealingPool::run_one(size_t self)
+  {
+    auto entry = Entry{};
+    if (!pop(self, entry) && !steal(self, entry))
+      return false;
+
+    try
+    {
+      (*entry.job)(entry.index);
+    }
+    catch (...)
+    {
+      std::lock_guard lock{m_mutex};
+      if (!m_error)
+        m_error = std::current_exception();
+    }
+
+    if (m_remaining.fetch_sub(1) == 1)
+    {
+      std::lock_guard lock{m_mutex};
+      m_batch_done.notify_all();
+    }
+    return true;
+  }
+
+  bool WorkStealingPool::pop(size_t self, Entry& entry)
+  {
+    auto& queue = *m_queues[self];
+    std::lock_guard lock{queue.mutex};
+    if (queue.entries.empty())
+      return false;
+
+    entry = queue.entries.back();
+    queue.entries.pop_back();
+    return true;
+  }
+
+  bool WorkStealingPool::steal(size_t self, Entry& entry)
+  {
+    const auto num_queues = m_queues.size();
+    for (size_t k = 1; k < num_queues; ++k)
+    {
+      auto& victim = *m_queues[(self + k) % num_queues];
+      std::lock_guard lock{victim.mutex};
+      if (victim.entries.empty())
+        continue;
+
+      entry = victim.entries.front();
+      victim.entries.pop_front();
+      return true;
+    }
+    return false;
+  }
+}
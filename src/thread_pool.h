@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cgfs
+{
+  // A fixed set of worker threads that execute batches of indexed tasks.
+  //
+  // Each worker owns a queue of task indices. A worker pops tasks from the back of its own queue
+  // and, when that runs dry, steals from the front of the other workers' queues, so uneven
+  // tasks (e.g. tiles with many reflective objects) are balanced automatically.
+  // The thread that calls parallel_for() takes part in the work as worker 0.
+  class WorkStealingPool
+  {
+  public:
+    // num_threads is the total number of threads working on a batch, including the calling thread.
+    // 0 selects std::thread::hardware_concurrency().
+    explicit WorkStealingPool(unsigned num_threads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(m_queues.size()); }
+
+    // Call task(i) for every i in [0, num_tasks) and block until all calls have returned.
+    // Neighbouring indices are initially assigned to the same worker.
+    // If a task throws, the first exception is rethrown here once the batch has finished.
+    void parallel_for(size_t num_tasks, const std::function<void(size_t)>& task);
+
+  private:
+    using Job = const std::function<void(size_t)>;
+
+    struct Entry
+    {
+      Job* job;
+      size_t index;
+    };
+
+    struct Queue
+    {
+      std::mutex mutex;
+      std::deque<Entry> entries;
+    };
+
+    void worker_loop(size_t self);
+    bool run_one(size_t self);
+    bool pop(size_t self, Entry& entry);
+    bool steal(size_t self, Entry& entry);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_batch_done;
+    size_t m_generation = 0;
+    bool m_stop = false;
+
+    std::atomic<size_t> m_remaining = 0;
+    std::exception_ptr m_error;
+  };
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "extent.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace cgfs
+{
+  // A rectangular block of pixels [x0, x1) x [y0, y1) in screen coordinates,
+  // i.e. (0, 0) is the top left corner of the canvas and y grows downwards.
+  struct Tile
+  {
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+  };
+
+  // Split an area of w x h pixels into tiles of (at most) size x size pixels, in row-major order (a size below 1 is taken as 1)
+  inline std::vector<Tile> make_tiles(const Extent2D& area, int size)
+  {
+    const auto& [w, h] = area;
+    size = std::max(size, 1);
+    auto tiles = std::vector<Tile>{};
+    for (int y = 0; y < h; y += size)
+      for (int x = 0; x < w; x += size)
+        tiles.push_back({x, y, std::min(x + size, w), std::min(y + size, h)});
+    return tiles;
+  }
+}
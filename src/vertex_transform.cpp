@@ -0,0 +1,174 @@
+#include "vertex_transform.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CGFS_TRANSFORM_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CGFS_TRANSFORM_SSE2
+#endif
+
+namespace cgfs
+{
+  namespace
+  {
+    // row r of T applied to (x, y, z), with or without the translation, in the order the kernels compute it
+    float row(const AffineTransform& T, size_t r, float x, float y, float z, bool translate)
+    {
+      const auto& m = T.m[r];
+      const auto v = m[0] * x + m[1] * y + m[2] * z;
+      return translate ? v + m[3] : v;
+    }
+
+    // Each kernel applies T to width elements, a coordinate at a time: it gathers their x, their y and their z by name (not as
+    // an array of floats, which would assume the layout of Position3D and Vector3D) into registers, and scatters the results
+    // back the same way.
+#if defined(CGFS_TRANSFORM_AVX2)
+    struct Kernel
+    {
+      static constexpr size_t width = 8;
+
+      template<bool translate, typename Element>
+      static void apply(const AffineTransform& T, const Element* in, Element* out)
+      {
+        const auto x = _mm256_setr_ps(in[0].x, in[1].x, in[2].x, in[3].x, in[4].x, in[5].x, in[6].x, in[7].x);
+        const auto y = _mm256_setr_ps(in[0].y, in[1].y, in[2].y, in[3].y, in[4].y, in[5].y, in[6].y, in[7].y);
+        const auto z = _mm256_setr_ps(in[0].z, in[1].z, in[2].z, in[3].z, in[4].z, in[5].z, in[6].z, in[7].z);
+        float c[3][width];
+        for (size_t r = 0; r < 3; ++r)
+        {
+          const auto& m = T.m[r];
+          auto v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0]), x), _mm256_mul_ps(_mm256_set1_ps(m[1]), y)), _mm256_mul_ps(_mm256_set1_ps(m[2]), z));
+          if constexpr (translate)
+            v = _mm256_add_ps(v, _mm256_set1_ps(m[3]));
+          _mm256_storeu_ps(c[r], v);
+        }
+        for (size_t k = 0; k < width; ++k)
+          out[k] = Element{c[0][k], c[1][k], c[2][k]};
+      }
+    };
+#elif defined(CGFS_TRANSFORM_SSE2)
+    struct Kernel
+    {
+      static constexpr size_t width = 4;
+
+      template<bool translate, typename Element>
+      static void apply(const AffineTransform& T, const Element* in, Element* out)
+      {
+        const auto x = _mm_setr_ps(in[0].x, in[1].x, in[2].x, in[3].x);
+        const auto y = _mm_setr_ps(in[0].y, in[1].y, in[2].y, in[3].y);
+        const auto z = _mm_setr_ps(in[0].z, in[1].z, in[2].z, in[3].z);
+        float c[3][width];
+        for (size_t r = 0; r < 3; ++r)
+        {
+          const auto& m = T.m[r];
+          auto v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), x), _mm_mul_ps(_mm_set1_ps(m[1]), y)), _mm_mul_ps(_mm_set1_ps(m[2]), z));
+          if constexpr (translate)
+            v = _mm_add_ps(v, _mm_set1_ps(m[3]));
+          _mm_storeu_ps(c[r], v);
+        }
+        for (size_t k = 0; k < width; ++k)
+          out[k] = Element{c[0][k], c[1][k], c[2][k]};
+      }
+    };
+#else
+    struct Kernel
+    {
+      static constexpr size_t width = 4;
+
+      template<bool translate, typename Element>
+      static void apply(const AffineTransform& T, const Element* in, Element* out)
+      {
+        for (size_t k = 0; k < width; ++k)
+        {
+          const auto x = in[k].x, y = in[k].y, z = in[k].z;
+          out[k] = Element{row(T, 0, x, y, z, translate), row(T, 1, x, y, z, translate), row(T, 2, x, y, z, translate)};
+        }
+      }
+    };
+#endif
+
+    template<bool translate, typename Element>
+    void transform(const AffineTransform& T, std::span<const Element> in, std::span<Element> out)
+    {
+      constexpr auto W = Kernel::width;
+
+      size_t i = 0;
+      for (; i + W <= in.size(); i += W)
+        Kernel::apply<translate>(T, &in[i], &out[i]);
+
+      for (; i < in.size(); ++i)
+      {
+        const auto x = in[i].x, y = in[i].y, z = in[i].z;
+        out[i] = Element{row(T, 0, x, y, z, translate), row(T, 1, x, y, z, translate), row(T, 2, x, y, z, translate)};
+      }
+    }
+  }
+
+  AffineTransform affine_transform(const sp3::transform& T)
+  {
+    const auto t = T(Position3D{0, 0, 0}) - Position3D{0, 0, 0};
+    const auto a_x = T(Vector3D{1, 0, 0});
+    const auto a_y = T(Vector3D{0, 1, 0});
+    const auto a_z = T(Vector3D{0, 0, 1});
+    return {{{
+      {a_x.x, a_y.x, a_z.x, t.x},
+      {a_x.y, a_y.y, a_z.y, t.y},
+      {a_x.z, a_y.z, a_z.z, t.z}
+    }}};
+  }
+
+  AffineTransform inverse(const AffineTransform& T)
+  {
+    const auto& m = T.m;
+    // the inverse of A from its cofactors
+    const auto cofactor = [&](size_t r, size_t c){
+      const auto r0 = (r + 1) % 3, r1 = (r + 2) % 3;
+      const auto c0 = (c + 1) % 3, c1 = (c + 2) % 3;
+      return m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0];
+    };
+    const auto det = m[0][0] * cofactor(0, 0) + m[0][1] * cofactor(0, 1) + m[0][2] * cofactor(0, 2);
+
+    auto inv = AffineTransform{};
+    for (size_t r = 0; r < 3; ++r)
+      for (size_t c = 0; c < 3; ++c)
+        inv.m[r][c] = cofactor(c, r) / det;
+    // then p = A^-1 (q - t)
+    for (size_t r = 0; r < 3; ++r)
+      inv.m[r][3] = -row(inv, r, m[0][3], m[1][3], m[2][3], false);
+    return inv;
+  }
+
+  Position3D transform_point(const AffineTransform& T, const Position3D& p)
+  {
+    return {row(T, 0, p.x, p.y, p.z, true), row(T, 1, p.x, p.y, p.z, true), row(T, 2, p.x, p.y, p.z, true)};
+  }
+
+  void transform_points(const AffineTransform& T, std::span<const Position3D> in, std::span<Position3D> out)
+  {
+    transform<true>(T, in, out);
+  }
+
+  void transform_vectors(const AffineTransform& T, std::span<const Vector3D> in, std::span<Vector3D> out)
+  {
+    transform<false>(T, in, out);
+  }
+
+  void transform_points(const sp3::transform& T, std::span<const Position3D> in, std::span<Position3D> out)
+  {
+    if (in.size() >= batch_transform_threshold)
+      return transform_points(affine_transform(T), in, out);
+
+    std::ranges::transform(in, out.begin(), [&](const Position3D& p){ return T(p); });
+  }
+
+  void transform_vectors(const sp3::transform& T, std::span<const Vector3D> in, std::span<Vector3D> out)
+  {
+    if (in.size() >= batch_transform_threshold)
+      return transform_vectors(affine_transform(T), in, out);
+
+    std::ranges::transform(in, out.begin(), [&](const Vector3D& v){ return T(v); });
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "position.h"
+
+#include "sp3/transform.h"
+
+#include <array>
+#include <cstddef>
+#include <span>
+
+namespace cgfs
+{
+  // An sp3::transform as a 3x4 matrix [A | t]: it maps a point p to A p + t, and a vector v to A v.
+  struct AffineTransform
+  {
+    std::array<std::array<float, 4>, 3> m = {};
+  };
+
+  // The matrix of T, from the images of the origin and of the axes
+  AffineTransform affine_transform(const sp3::transform& T);
+
+  // The inverse of T, which must be invertible
+  AffineTransform inverse(const AffineTransform& T);
+
+  // T applied to a single point
+  Position3D transform_point(const AffineTransform& T, const Position3D& p);
+
+  // Arrays of at least this many points or vectors are transformed as a batch (see transform_points())
+  inline constexpr size_t batch_transform_threshold = 64;
+
+  // Apply T to the points (vectors) in 'in', writing them to 'out', which must be at least as large.
+  //
+  // Short arrays are transformed one element at a time by T itself. Longer ones by the matrix of T, 8 (AVX2)
+  // or 4 (SSE2) elements at a time, whose results can differ from those of T in the last bits.
+  void transform_points(const sp3::transform& T, std::span<const Position3D> in, std::span<Position3D> out);
+  void transform_vectors(const sp3::transform& T, std::span<const Vector3D> in, std::span<Vector3D> out);
+
+  // The batch transforms, for any number of elements
+  void transform_points(const AffineTransform& T, std::span<const Position3D> in, std::span<Position3D> out);
+  void transform_vectors(const AffineTransform& T, std::span<const Vector3D> in, std::span<Vector3D> out);
+}
@@ -0,0 +1,166 @@
+#include "wavefront.h"
+
+#include "render.h"
+
+#include <algorithm>
+#include <limits>
+#include <span>
+
+namespace cgfs
+{
+  namespace
+  {
+    // number of queue entries processed by a task of the pool
+    constexpr size_t CHUNK_SIZE = 1024;
+
+    // call f(first, last) for the chunks of [0, n) on the threads of the pool
+    template<typename F>
+    void for_each_chunk(WorkStealingPool& pool, size_t n, F&& f)
+    {
+      const auto num_chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+      pool.parallel_for(num_chunks, [&](size_t i){ f(i * CHUNK_SIZE, std::min(n, (i + 1) * CHUNK_SIZE)); });
+    }
+  }
+
+  WavefrontRenderer::WavefrontRenderer(size_t recursion_depth)
+  : m_recursion_depth{recursion_depth}
+  {}
+
+  void WavefrontRenderer::render(const Scene& scene, Canvas& canvas, const Extent2D& viewport, WorkStealingPool& pool)
+  {
+    const auto C_wh = canvas.extent();
+    const auto area = detail::render_area(C_wh);
+    const auto num_paths = static_cast<size_t>(area.width) * static_cast<size_t>(area.height);
+    const auto& lights = scene.light_set();
+    const auto num_lights = lights.num_blockable();
+    const auto max_bounces = m_recursion_depth + 1;
+
+    // the pixel of a path, in canvas coordinates
+    const auto pixel = [&](std::uint32_t path)
+    {
+      const auto Sx = static_cast<int>(path % area.width);
+      const auto Sy = static_cast<int>(path / area.width);
+      return Index2D{Sx - C_wh.width/2, C_wh.height/2 - Sy};
+    };
+
+    // 1. Generate the primary rays
+    m_rays.resize(num_paths);
+    m_paths.resize(num_paths);
+    m_bounces.resize(num_paths * max_bounces);
+    m_num_bounces.assign(num_paths, 0);
+    for_each_chunk(pool, num_paths, [&](size_t first, size_t last)
+    {
+      const auto O = Position3D{0, 0, 0};
+      for (auto i = first; i < last; ++i)
+      {
+        const auto path = static_cast<std::uint32_t>(i);
+        const auto V_xyz = detail::canvas_to_viewport(pixel(path), canvas.extent(), viewport);
+        m_rays[i] = {O, V_xyz - O, 1, std::numeric_limits<float>::infinity()};
+        m_paths[i] = path;
+      }
+    });
+
+    for (size_t bounce = 0; bounce < max_bounces && !m_rays.empty(); ++bounce)
+    {
+      const auto num_rays = m_rays.size();
+
+      // 2. Find the closest hits, in packets for the coherent primary rays
+      m_hits.resize(num_rays);
+      for_each_chunk(pool, num_rays, [&](size_t first, size_t last)
+      {
+        if (bounce == 0)
+          scene.intersect(std::span{m_rays}.subspan(first, last - first), std::span{m_hits}.subspan(first, last - first));
+        else
+          for (auto i = first; i < last; ++i)
+            m_hits[i] = scene.intersect(m_rays[i]);
+      });
+
+      // 3. Generate the shadow rays, one per hit and light, and queue those that need tracing
+      m_shadow_slots.resize(num_rays * num_lights);
+      for_each_chunk(pool, num_rays, [&](size_t first, size_t last)
+      {
+        for (auto i = first; i < last; ++i)
+        {
+          const auto slots = std::span{m_shadow_slots}.subspan(i * num_lights, num_lights);
+          if (!m_hits[i])
+          {
+            std::ranges::fill(slots, null_ray3d);
+            continue;
+          }
+          const auto sp = scene.surface_point(m_rays[i], m_hits[i]);
+          lights.for_each_back_ray(sp.pos, [&](size_t l, const Ray3D& back_ray){ slots[l] = Scene::shadow_ray(back_ray); });
+        }
+      });
+
+      // grouped by light, so that consecutive shadow rays are coherent
+      m_shadow_rays.clear();
+      for (size_t l = 0; l < num_lights; ++l)
+        for (auto slot = l; slot < m_shadow_slots.size(); slot += num_lights)
+          if (m_shadow_slots[slot] != null_ray3d)
+            m_shadow_rays.push_back({m_shadow_slots[slot], static_cast<std::uint32_t>(slot)});
+
+      // 4. Trace the shadow rays
+      m_blocked.assign(num_rays * num_lights, 0);
+      for_each_chunk(pool, m_shadow_rays.size(), [&](size_t first, size_t last)
+      {
+        for (auto i = first; i < last; ++i)
+          m_blocked[m_shadow_rays[i].slot] = scene.occluded(m_shadow_rays[i].ray);
+      });
+
+      // 5. Light the hits and generate the reflected rays of the paths that go on
+      m_reflected.resize(num_rays);
+      for_each_chunk(pool, num_rays, [&](size_t first, size_t last)
+      {
+        for (auto i = first; i < last; ++i)
+        {
+          const auto& ray = m_rays[i];
+          const auto& hit = m_hits[i];
+          const auto path = m_paths[i];
+          m_num_bounces[path] = static_cast<std::uint32_t>(bounce + 1);
+          m_reflected[i] = null_ray3d;
+
+          if (!hit)
+          {
+            m_bounces[path * max_bounces + bounce] = {Scene::background_color, 0};
+            continue;
+          }
+
+          // the same sum as the lighting of Scene::trace_ray(), with the shadow rays traced above
+          const auto sp = scene.surface_point(ray, hit);
+          const auto intensity = lights.intensity(sp, -ray.direction, std::span{m_blocked}.subspan(i * num_lights, num_lights));
+
+          const auto& sphere = scene.spheres()[hit.primitive];
+          m_bounces[path * max_bounces + bounce] = {sphere.color * intensity, sphere.reflective};
+
+          if (bounce < m_recursion_depth && sphere.reflective != 0)
+            m_reflected[i] = Scene::reflected_ray(ray, sp);
+        }
+      });
+
+      // 6. Compact the reflected rays into the queue of the next bounce
+      auto next = size_t{0};
+      for (size_t i = 0; i < num_rays; ++i)
+        if (m_reflected[i] != null_ray3d)
+        {
+          m_rays[next] = m_reflected[i];
+          m_paths[next] = m_paths[i];
+          ++next;
+        }
+      m_rays.resize(next);
+      m_paths.resize(next);
+    }
+
+    // 7. Blend the bounces of each path back to front and paint its pixel
+    for_each_chunk(pool, num_paths, [&](size_t first, size_t last)
+    {
+      for (auto path = first; path < last; ++path)
+      {
+        const auto bounces = std::span{m_bounces}.subspan(path * max_bounces, m_num_bounces[path]);
+        auto color = bounces.back().local_color;
+        for (auto b = bounces.size() - 1; b-- > 0;)
+          color = (1 - bounces[b].reflective) * bounces[b].local_color + bounces[b].reflective * color;
+        canvas.putPixel(pixel(static_cast<std::uint32_t>(path)), color);
+      }
+    });
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "canvas.h"
+#include "color.h"
+#include "extent.h"
+#include "ray.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cgfs
+{
+  // Ray traces a Scene breadth first, one bounce at a time, instead of recursing per pixel.
+  //
+  // All the primary rays are generated up front. Each bounce then runs as separate passes over compact queues:
+  // closest hits (in packets), shadow rays, lighting, and the reflected rays that make up the next queue.
+  // Every pass is a flat loop over its queue, split into chunks on the threads of the pool.
+  //
+  // Instead of a recursion stack, each path keeps the local color and reflectivity of its bounces. They are
+  // blended back to front once all the bounces are done, the same way Scene::trace_ray() blends them on the
+  // way out of the recursion, so the output is identical to render().
+  class WavefrontRenderer
+  {
+  public:
+    explicit WavefrontRenderer(size_t recursion_depth = 3);
+
+    void render(const Scene& scene, Canvas& canvas, const Extent2D& viewport, WorkStealingPool& pool);
+
+  private:
+    // the color seen at one bounce of a path, before adding the reflections
+    struct Bounce
+    {
+      Color local_color = {};
+      float reflective = 0;
+    };
+
+    struct ShadowRay
+    {
+      Ray3D ray;
+      std::uint32_t slot = 0; // index into m_blocked
+    };
+
+    size_t m_recursion_depth = 3;
+
+    // The queues are kept between frames to avoid reallocating them.
+    // The rays of the current bounce and, parallel to them, their paths and hits
+    std::vector<Ray3D> m_rays;
+    std::vector<std::uint32_t> m_paths;
+    std::vector<HitRecord> m_hits;
+
+    std::vector<Ray3D> m_shadow_slots;    // one per ray and light, null_ray3d if there is nothing to trace
+    std::vector<ShadowRay> m_shadow_rays; // the non null shadow slots
+    std::vector<unsigned char> m_blocked; // one per ray and light
+    std::vector<Ray3D> m_reflected;       // one per ray, null_ray3d if the path ends
+
+    std::vector<Bounce> m_bounces;            // recursion_depth + 1 per path
+    std::vector<std::uint32_t> m_num_bounces; // per path
+  };
+}
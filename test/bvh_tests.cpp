@@ -0,0 +1,101 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+  // distance to the first point on the sphere's surface hit by the ray, or infinity
+  float hit_distance(const cgfs::Ray3D& ray, const cgfs::Sphere& sphere)
+  {
+    const auto OC = ray.origin - sphere.center;
+    const auto k1 = dot(ray.direction, ray.direction);
+    const auto k2 = 2 * dot(OC, ray.direction);
+    const auto k3 = dot(OC, OC) - sphere.radius * sphere.radius;
+    const auto discriminant = k2 * k2 - 4 * k1 * k3;
+    const auto t = discriminant < 0 ? std::numeric_limits<float>::infinity() : (-k2 - std::sqrt(discriminant)) / (2 * k1);
+    return (ray.t_min < t && t < ray.t_max) ? t : std::numeric_limits<float>::infinity();
+  }
+
+  // index of the closest sphere hit by the ray, or -1
+  int brute_force_closest(const cgfs::Ray3D& ray, const std::vector<cgfs::Sphere>& spheres)
+  {
+    auto closest_t = std::numeric_limits<float>::infinity();
+    auto closest = -1;
+    for (int i = 0; i < static_cast<int>(spheres.size()); ++i)
+    {
+      const auto t = hit_distance(ray, spheres[i]);
+      if (t < closest_t)
+      {
+        closest_t = t;
+        closest = i;
+      }
+    }
+    return closest;
+  }
+
+  // the closest sphere among the leaves visited by the BVH
+  int bvh_closest(const cgfs::Ray3D& ray, const std::vector<cgfs::Sphere>& spheres, const cgfs::SphereBVH& bvh)
+  {
+    auto t_far = ray.t_max;
+    auto closest = -1;
+    bvh.traverse(ray, t_far, [&](std::uint32_t first, std::uint32_t last){
+      for (auto i = first; i < last; ++i)
+      {
+        const auto t = hit_distance(ray, spheres[bvh.primitives()[i]]);
+        if (t < t_far)
+        {
+          t_far = t;
+          closest = static_cast<int>(bvh.primitives()[i]);
+        }
+      }
+    });
+    return closest;
+  }
+}
+
+TEST_CASE("Sphere BVH")
+{
+  auto rng = std::mt19937{42};
+  auto position = std::uniform_real_distribution<float>{-10, 10};
+  auto radius = std::uniform_real_distribution<float>{0.1f, 1.f};
+
+  auto spheres = std::vector<cgfs::Sphere>{};
+  for (int i = 0; i < 500; ++i)
+    spheres.push_back({{position(rng), position(rng), position(rng) + 20}, radius(rng)});
+
+  const auto bvh = cgfs::SphereBVH{spheres};
+
+  SECTION("Every sphere is in exactly one leaf")
+  {
+    auto seen = std::vector<int>(spheres.size(), 0);
+    for (const auto& node : bvh.nodes())
+    {
+      REQUIRE(node.count <= cgfs::SphereBVH::max_leaf_size);
+      for (auto i = node.offset; node.count != 0 && i < node.offset + node.count; ++i)
+        ++seen[bvh.primitives()[i]];
+    }
+    CHECK(std::ranges::all_of(seen, [](int n){ return n == 1; }));
+  }
+
+  SECTION("Finds the same closest sphere as a brute force search")
+  {
+    auto direction = std::uniform_real_distribution<float>{-0.5f, 0.5f};
+    for (int i = 0; i < 2000; ++i)
+    {
+      const auto ray = cgfs::Ray3D{{0, 0, 0}, {direction(rng), direction(rng), 1}, 1, std::numeric_limits<float>::infinity()};
+      REQUIRE(bvh_closest(ray, spheres, bvh) == brute_force_closest(ray, spheres));
+    }
+  }
+
+  SECTION("Empty scene")
+  {
+    const auto empty = cgfs::SphereBVH{{}};
+    CHECK(bvh_closest({{0, 0, 0}, {0, 0, 1}, 1, 100}, {}, empty) == -1);
+  }
+}
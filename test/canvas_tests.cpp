@@ -4,6 +4,8 @@
 
 #include <algorithm>
 #include <span>
+#include <stdexcept>
+#include <utility>
 
 TEST_CASE("Constructing a canvas")
 {
@@ -103,3 +105,114 @@ TEST_CASE("Constructing a canvas")
     CHECK(std::equal(result.begin(), result.end(), expected.begin()));
   }
 }
+
+TEST_CASE("Depth tiles")
+{
+  // 2 x 2 tiles, the right and bottom ones partial
+  auto c = cgfs::Canvas{{12, 10}};
+  const auto top_left = cgfs::Index2D{-6, 5};
+  const auto bottom_right = cgfs::Index2D{5, -4};
+
+  SECTION("An empty canvas has nothing to hide behind")
+  {
+    CHECK(c.farthestDepth(top_left) == 0.f);
+    CHECK(c.updateFarthestDepth(bottom_right) == 0.f);
+    CHECK_THROWS_AS(c.farthestDepth({6, 0}), std::out_of_range);
+  }
+
+  SECTION("The farthest depth of a tile is a lower bound of its depths, exact once updated")
+  {
+    // cover the top left tile, pixels (-6..1, -2..5), the nearer the further right
+    for (int y = -2; y <= 5; ++y)
+      for (int x = -6; x <= 1; ++x)
+        REQUIRE(c.testAndSetDepth({x, y}, 1.f + 0.1f * (x + 6)));
+
+    CHECK(c.farthestDepth(top_left) <= 1.f);
+    CHECK(c.updateFarthestDepth(top_left) == 1.f);
+    CHECK(c.farthestDepth({1, -2}) == 1.f);
+
+    // a farther surface doesn't pass the depth test, a nearer one does (here all along the farthest column)
+    CHECK_FALSE(c.testAndSetDepth(top_left, 0.5f));
+    CHECK(std::as_const(c).depthBuffer(top_left) == 1.f);
+    for (int y = -2; y <= 5; ++y)
+      REQUIRE(c.testAndSetDepth({-6, y}, 3.f));
+    CHECK(c.farthestDepth(top_left) == 1.f);
+    CHECK(c.updateFarthestDepth(top_left) == 1.1f);
+
+    // the other tiles are untouched
+    CHECK(c.updateFarthestDepth({2, 5}) == 0.f);
+    CHECK(c.updateFarthestDepth({-6, -3}) == 0.f);
+  }
+
+  SECTION("Writing to the depth buffer directly can make a tile farther")
+  {
+    for (int y = -4; y <= -3; ++y)
+      for (int x = 2; x <= 5; ++x)
+        c.testAndSetDepth({x, y}, 2.f);
+    CHECK(c.updateFarthestDepth(bottom_right) == 2.f);
+
+    c.depthBuffer(bottom_right) = 0.25f;
+    CHECK(c.farthestDepth(bottom_right) <= 0.25f);
+    CHECK(c.updateFarthestDepth(bottom_right) == 0.25f);
+  }
+}
+
+TEST_CASE("Spans")
+{
+  SECTION("A span is clipped to the canvas")
+  {
+    auto c = cgfs::Canvas{{12, 10}};
+
+    const auto row = c.span(5, -10, 2);
+    CHECK(row.x0 == -6);
+    CHECK(row.x1 == 2);
+    CHECK(row.y == 5);
+    CHECK_FALSE(row.empty());
+
+    CHECK(c.span(0, -6, 5).x1 == 5);
+    CHECK(c.span(-4, 3, 100).x1 == 5);
+    CHECK(c.span(6, -2, 2).empty());
+    CHECK(c.span(-5, -2, 2).empty());
+    CHECK(c.span(0, 6, 10).empty());
+    CHECK(c.span(0, 2, 1).empty());
+  }
+
+  SECTION("Drawing through a span is drawing on the canvas")
+  {
+    auto expected = cgfs::Canvas{cgfs::Canvas::with_alpha_channel, {7, 5}, cgfs::Color{0, 0, 0}};
+    auto c = cgfs::Canvas{cgfs::Canvas::with_alpha_channel, {7, 5}, cgfs::Color{0, 0, 0}};
+
+    auto row = c.span(-1, -5, 1);
+    for (int x = row.x0; x <= row.x1; ++x)
+    {
+      const auto color = cgfs::Color{static_cast<unsigned char>(x + 3), 2, 3};
+      row.putPixel(x, color);
+      expected.putPixel({x, -1}, color);
+    }
+
+    CHECK(std::ranges::equal(std::span{c.data(), c.num_bytes()}, std::span{expected.data(), expected.num_bytes()}));
+  }
+
+  SECTION("Depth testing through a span is depth testing on the canvas")
+  {
+    // 2 x 2 depth tiles
+    auto c = cgfs::Canvas{{12, 10}};
+
+    auto row = c.span(-4, -6, 5);
+    for (int x = row.x0; x <= row.x1; ++x)
+      REQUIRE(row.testAndSetDepth(x, 2.f));
+    CHECK_FALSE(row.testAndSetDepth(1, 1.f));
+    CHECK(row.testAndSetDepth(1, 3.f));
+    CHECK(row.depth(1) == 3.f);
+    CHECK(std::as_const(c).depthBuffer({1, -4}) == 3.f);
+    CHECK(std::as_const(c).depthBuffer({1, -3}) == 0.f);
+
+    // the tiles written through spans are updated
+    auto next_row = c.span(-3, -6, 5);
+    for (int x = next_row.x0; x <= next_row.x1; ++x)
+      REQUIRE(next_row.testAndSetDepth(x, 2.f));
+    CHECK(c.updateFarthestDepth({-6, -4}) == 2.f);
+    CHECK(c.updateFarthestDepth({5, -4}) == 2.f);
+    CHECK(c.updateFarthestDepth({-6, 5}) == 0.f);
+  }
+}
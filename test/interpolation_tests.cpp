@@ -2,6 +2,10 @@
 
 #include "interpolation.h"
 
+#include <array>
+#include <cmath>
+#include <vector>
+
 TEST_CASE("Horizontal-ish lines")
 {
   SECTION("Given intensity")
@@ -78,4 +82,117 @@ TEST_CASE("Vertical-ish lines")
       REQUIRE(std::equal(result_ba.begin(), result_ba.end(), result.begin()));
     }
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Lines")
+{
+  SECTION("Vertical lines and points")
+  {
+    const auto vertical = cgfs::interpolate(cgfs::Index2D{2, 4}, cgfs::Index2D{2, -1});
+    REQUIRE(vertical.size() == 6);
+    for (size_t i = 0; i < vertical.size(); ++i)
+      REQUIRE(vertical[i] == cgfs::Index2D{2, -1 + static_cast<int>(i)});
+
+    const auto point = cgfs::interpolate(cgfs::Index2D{-3, 5}, cgfs::Index2D{-3, 5});
+    REQUIRE(point.size() == 1);
+    REQUIRE(point[0] == cgfs::Index2D{-3, 5});
+  }
+
+  SECTION("The pixels are the points of the line rounded to the nearest, halves away from zero")
+  {
+    // x = -251 + 127 (y + 90) / 226 is -187.5 at y = 23 ...
+    const auto ab = cgfs::interpolate(cgfs::Index2D{-251, -90}, cgfs::Index2D{-124, 136});
+    for (const auto& [x, y] : ab)
+    {
+      const auto exact = -251 + 127 * (y + 90) / 226.0;
+      REQUIRE(std::abs(x - exact) <= 0.5);
+    }
+    REQUIRE(ab[23 + 90] == cgfs::Index2D{-188, 23});
+
+    // ... and 34.5 at x = 2
+    const auto cd = cgfs::interpolate(cgfs::Index2D{0, 33}, cgfs::Index2D{4, 36});
+    REQUIRE(cd[2] == cgfs::Index2D{2, 35});
+  }
+
+  SECTION("Clipping a line leaves the rest of its pixels where they were")
+  {
+    const auto a = cgfs::Index2D{-300, 41};
+    const auto b = cgfs::Index2D{250, -77};
+    const auto lo = cgfs::Index2D{-20, -30};
+    const auto hi = cgfs::Index2D{19, 29};
+
+    auto expected = std::vector<cgfs::Index2D>{};
+    for (const auto& p : cgfs::interpolate(a, b))
+      if (lo.x <= p.x && p.x <= hi.x && lo.y <= p.y && p.y <= hi.y)
+        expected.push_back(p);
+    REQUIRE_FALSE(expected.empty());
+
+    auto clipped = std::vector<cgfs::Index2D>{};
+    cgfs::detail::line_pixels(b, a, lo, hi, [&](const cgfs::Index2D& p){ clipped.push_back(p); });
+    REQUIRE(clipped == expected);
+  }
+}
+
+TEST_CASE("Triangle sides")
+{
+  // the vertices (x, y) of triangles, sorted by y
+  const auto triangles = std::vector<std::array<cgfs::Index2D, 3>>{
+    {{{0, 0}, {5, 7}, {-3, 20}}},
+    {{{-40, -13}, {17, -13}, {2, 31}}},
+    {{{3, 1}, {-9, 8}, {11, 8}}},
+    {{{0, 0}, {1, 1}, {-250, 99}}},
+    {{{6, 4}, {6, 4}, {6, 4}}},
+  };
+
+  SECTION("The short sides step through the values of both sides, in a row")
+  {
+    for (const auto& [p0, p1, p2] : triangles)
+    {
+      auto x01 = cgfs::interpolate(p0.y, p0.x, p1.y, p1.x);
+      const auto x12 = cgfs::interpolate(p1.y, p1.x, p2.y, p2.x);
+      x01.pop_back();
+      x01.insert(x01.end(), x12.begin(), x12.end());
+
+      auto x012 = cgfs::detail::TriangleSide{cgfs::detail::rounding_stepper(p0.y, p0.x, p1.y, p1.x), p0.y, p1.y, cgfs::detail::rounding_stepper(p1.y, p1.x, p2.y, p2.x)};
+      for (size_t i = 0; i < x01.size(); ++i, x012.step())
+        REQUIRE(cgfs::detail::round(x012.value()) == x01[i]);
+    }
+  }
+
+  SECTION("The long side steps through the same values as interpolatef()")
+  {
+    for (const auto& [p0, p1, p2] : triangles)
+    {
+      const auto h02 = cgfs::interpolatef(p0.y, 0.1f * p0.x, p2.y, 0.3f * p2.x);
+
+      auto side = cgfs::detail::TriangleSide{cgfs::detail::stepper(p0.y, 0.1f * p0.x, p2.y, 0.3f * p2.x)};
+      for (size_t i = 0; i < h02.size(); ++i)
+        REQUIRE(side.value_after(static_cast<int>(i)) == h02[i]);
+      for (size_t i = 0; i < h02.size(); ++i, side.step())
+        REQUIRE(side.value() == h02[i]);
+    }
+  }
+
+  SECTION("Advancing by k rows gets to the same value as k steps, on either short side")
+  {
+    for (const auto& [p0, p1, p2] : triangles)
+    {
+      const auto x012 = cgfs::detail::TriangleSide{cgfs::detail::rounding_stepper(p0.y, p0.x, p1.y, p1.x), p0.y, p1.y, cgfs::detail::rounding_stepper(p1.y, p1.x, p2.y, p2.x)};
+      for (int k = 0; k <= p2.y - p0.y; ++k)
+      {
+        auto stepped = x012;
+        for (int i = 0; i < k; ++i)
+          stepped.step();
+        auto advanced = x012;
+        advanced.advance(k);
+        REQUIRE(advanced.value() == stepped.value());
+
+        // and on from there, to the last row
+        for (int i = k; i < p2.y - p0.y; ++i)
+          stepped.step();
+        advanced.advance(p2.y - p0.y - k);
+        REQUIRE(advanced.value() == stepped.value());
+      }
+    }
+  }
+}
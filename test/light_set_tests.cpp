@@ -0,0 +1,61 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "light.h"
+
+#include <numeric>
+#include <vector>
+
+namespace
+{
+  // the sum of the lights in the order they are given
+  float sum(const std::vector<cgfs::Light>& lights, const cgfs::SurfacePoint& sp, const cgfs::Vector3D& V)
+  {
+    return std::accumulate(lights.begin(), lights.end(), 0.0f, [&](float acc, const cgfs::Light& light){ return acc + light.intensity(sp, V); });
+  }
+}
+
+TEST_CASE("Light set")
+{
+  const auto lights = std::vector<cgfs::Light>{
+    cgfs::AmbientLight{0.2f},
+    cgfs::PointLight{0.6f, {2, 1, 0}},
+    cgfs::PointLight{0.3f, {-2, 1, 0}},
+    cgfs::DirectionalLight{0.2f, {1, 4, 4}}
+  };
+  const auto set = cgfs::LightSet{lights};
+  const auto sp = cgfs::SurfacePoint{{0, -1, 3}, {{0, 1, -1}}, 500};
+  const auto V = cgfs::Vector3D{0, 1, -3};
+
+  SECTION("Sorted by kind")
+  {
+    CHECK(set.size() == 4);
+    CHECK(set.num_blockable() == 3);
+    CHECK(cgfs::LightSet{}.empty());
+  }
+
+  SECTION("Same intensity as the lights one by one, when they are given ambient, point, directional")
+  {
+    CHECK(set.intensity(sp, V) == sum(lights, sp, V));
+  }
+
+  SECTION("Blocked lights are left out")
+  {
+    auto back_rays = std::vector<cgfs::Ray3D>{};
+    set.for_each_back_ray(sp.pos, [&](size_t, const cgfs::Ray3D& ray){ back_rays.push_back(ray); });
+    REQUIRE(back_rays.size() == 3);
+    CHECK(back_rays[0] == lights[1].back_ray(sp.pos));
+    CHECK(back_rays[2] == lights[3].back_ray(sp.pos));
+
+    const auto only_second_point_light = std::vector<unsigned char>{1, 0, 1};
+    CHECK(set.intensity(sp, V, only_second_point_light) == sum({lights[0], lights[2]}, sp, V));
+    CHECK(set.intensity(sp, V, std::vector<unsigned char>{0, 0, 0}) == set.intensity(sp, V));
+  }
+
+  SECTION("Lights are values")
+  {
+    auto copy = lights;
+    copy[0] = cgfs::AmbientLight{0.5f};
+    CHECK(copy[0].intensity(sp, V) == 0.5f);
+    CHECK(lights[0].intensity(sp, V) == 0.2f);
+  }
+}
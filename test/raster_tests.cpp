@@ -0,0 +1,998 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "bounding_sphere.h"
+#include "camera.h"
+#include "canvas.h"
+#include "draw.h"
+#include "frustum.h"
+#include "halfspace.h"
+#include "instance.h"
+#include "mesh.h"
+#include "render.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "vertex_transform.h"
+
+#include "sp3/angle.h"
+#include "sp3/axes.h"
+#include "sp3/transform.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  constexpr auto background = cgfs::Color{1, 2, 3};
+
+  // the pixels of a 3 bytes per pixel canvas
+  std::span<const unsigned char> pixels(const cgfs::Canvas& canvas)
+  {
+    return {canvas.data(), canvas.num_bytes()};
+  }
+
+  size_t count_painted(const cgfs::Canvas& canvas)
+  {
+    const auto bytes = pixels(canvas);
+    size_t painted = 0;
+    for (size_t i = 0; i < bytes.size(); i += 3)
+      painted += (bytes[i] != background.r || bytes[i + 1] != background.g || bytes[i + 2] != background.b);
+    return painted;
+  }
+
+  size_t count_different(const cgfs::Canvas& lhs, const cgfs::Canvas& rhs)
+  {
+    const auto l = pixels(lhs);
+    const auto r = pixels(rhs);
+    size_t different = 0;
+    for (size_t i = 0; i < l.size(); i += 3)
+      different += !std::equal(l.begin() + i, l.begin() + i + 3, r.begin() + i);
+    return different;
+  }
+
+  // the model with one normal per face, the same for all its vertices
+  cgfs::Mesh flat(const cgfs::MultiNormalMesh& model)
+  {
+    auto mesh = cgfs::Mesh{model.vertices, {}};
+    for (const auto& f : model.faces)
+      mesh.faces.push_back({f.a, f.b, f.c, f.col});
+    mesh.update();
+    return mesh;
+  }
+
+  cgfs::MeshScene<cgfs::MultiNormalMesh> cubes_scene()
+  {
+    return {
+      std::vector<cgfs::Instance<cgfs::MultiNormalMesh>>{
+        {cgfs::solid_cube(), sp3::transform{{-1.5f, 0.f, 7.f}, {sp3::yhat, sp3::angle{sp3::pi/12}}}},
+        {cgfs::solid_cube(), sp3::transform{{1.2f, 1.0f, 6.f}, {sp3::yhat, sp3::angle{-sp3::pi/12}}}},
+        {cgfs::solid_icosahedron(), sp3::transform{{1.0f, -2.1f, 5.f}, {}, 1.5}}
+      },
+      std::vector<cgfs::Light>{
+        cgfs::AmbientLight{0.2f},
+        cgfs::PointLight{0.6f, {-1, 1, 0}},
+        cgfs::DirectionalLight{0.2f, {0, 0, 1}}
+      }
+    };
+  }
+}
+
+TEST_CASE("Vertex cache")
+{
+  const auto same = [](const auto& lhs, const auto& rhs){ return lhs.x == rhs.x && lhs.y == rhs.y && lhs.z == rhs.z; };
+  const auto M = sp3::transform{{1.f, -2.f, 6.f}, {sp3::yhat, sp3::angle{sp3::pi/5}}, 1.5};
+
+  // one cache for both models: the larger one first
+  auto cache = cgfs::VertexCache{};
+  const auto icosahedron = cgfs::solid_icosahedron();
+  icosahedron.transform(cache, M);
+  const auto gathered = icosahedron.triangles(cache);
+  REQUIRE(std::ranges::size(gathered) == icosahedron.faces.size());
+  for (size_t i = 0; i < icosahedron.faces.size(); ++i)
+  {
+    const auto expected = icosahedron.triangles(M)[i];
+    for (size_t k = 0; k < 3; ++k)
+    {
+      REQUIRE(same(gathered[i].vertices[k], expected.vertices[k]));
+      REQUIRE(same(gathered[i].normals[k], expected.normals[k]));
+    }
+    REQUIRE(gathered[i].col == expected.col);
+  }
+
+  const auto cube = flat(cgfs::solid_cube());
+  cube.transform(cache, M);
+  REQUIRE(cache.vertices.size() == cube.vertices.size());
+  for (size_t i = 0; i < cube.faces.size(); ++i)
+  {
+    const auto t = cube.triangles(cache)[i];
+    const auto expected = cube.triangles(M)[i];
+    REQUIRE(same(t.a, expected.a));
+    REQUIRE(same(t.b, expected.b));
+    REQUIRE(same(t.c, expected.c));
+    REQUIRE(t.col == expected.col);
+  }
+}
+
+TEST_CASE("Batch vertex transform")
+{
+  const auto T = sp3::transform{{1.f, -2.f, 6.f}, {sp3::yhat, sp3::angle{sp3::pi/5}}, 1.5};
+  const auto close = [](const auto& lhs, const auto& rhs){
+    const auto tolerance = 1e-5f * (1 + std::abs(rhs.x) + std::abs(rhs.y) + std::abs(rhs.z));
+    return std::abs(lhs.x - rhs.x) <= tolerance && std::abs(lhs.y - rhs.y) <= tolerance && std::abs(lhs.z - rhs.z) <= tolerance;
+  };
+
+  for (const size_t n : {size_t{0}, size_t{5}, cgfs::batch_transform_threshold - 1, cgfs::batch_transform_threshold, size_t{101}})
+  {
+    auto points = std::vector<cgfs::Position3D>{};
+    auto vectors = std::vector<cgfs::Vector3D>{};
+    for (size_t i = 0; i < n; ++i)
+    {
+      const auto f = static_cast<float>(i);
+      points.push_back({0.1f * f - 3, 2 - 0.05f * f, 0.3f * f});
+      vectors.push_back({1 - 0.02f * f, 0.07f * f, -0.5f});
+    }
+
+    auto transformed_points = std::vector<cgfs::Position3D>(n);
+    cgfs::transform_points(T, points, transformed_points);
+    auto transformed_vectors = std::vector<cgfs::Vector3D>(n);
+    cgfs::transform_vectors(T, vectors, transformed_vectors);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      if (n < cgfs::batch_transform_threshold)
+      {
+        // one at a time, by T itself
+        REQUIRE(transformed_points[i].x == T(points[i]).x);
+        REQUIRE(transformed_points[i].z == T(points[i]).z);
+        REQUIRE(transformed_vectors[i].y == T(vectors[i]).y);
+      }
+      REQUIRE(close(transformed_points[i], T(points[i])));
+      REQUIRE(close(transformed_vectors[i], T(vectors[i])));
+    }
+  }
+
+  SECTION("The wireframe of a mesh instance projects each of its vertices once")
+  {
+    const auto extent = cgfs::Extent2D{64, 64};
+    const auto viewport = cgfs::Extent2D{1, 1};
+    const auto instance = cgfs::Instance<cgfs::Mesh>{cgfs::wireframe_icosahedron(), T};
+
+    auto canvas = cgfs::Canvas{extent, background};
+    cgfs::render_instance(canvas, *instance.model, T, viewport, 1);
+
+    auto expected = cgfs::Canvas{extent, background};
+    const auto project = [&](const cgfs::Position3D& v){ return cgfs::detail::project_vertex(T(v), 1, viewport, extent); };
+    for (const auto& t : instance.model->faces)
+      cgfs::render_triangle(expected, t, instance.model->vertices | std::views::transform(project));
+
+    REQUIRE(count_painted(canvas) > 0);
+    REQUIRE(count_different(canvas, expected) == 0);
+  }
+}
+
+TEST_CASE("Lines and wireframes")
+{
+  const auto extent = cgfs::Extent2D{64, 48};
+
+  SECTION("A line is clipped to the canvas")
+  {
+    const auto lines = std::vector<std::pair<cgfs::Index2D, cgfs::Index2D>>{
+      {{-100, -70}, {90, 60}},
+      {{-5, 400}, {7, -300}},
+      {{-40, 23}, {40, 23}},
+      {{10, -100}, {10, 100}},
+      {{500, 0}, {600, 10}},
+    };
+
+    auto canvas = cgfs::Canvas{extent, background};
+    auto expected = cgfs::Canvas{extent, background};
+    for (const auto& [a, b] : lines)
+    {
+      cgfs::draw_line(canvas, a, b, cgfs::Color{200, 100, 0});
+      for (const auto& p : cgfs::interpolate(a, b))
+        expected.putPixel(p, cgfs::Color{200, 100, 0});
+    }
+
+    REQUIRE(count_painted(canvas) > 0);
+    REQUIRE(count_different(canvas, expected) == 0);
+  }
+
+  SECTION("A mesh has each of its edges once")
+  {
+    const auto cube = cgfs::wireframe_cube();
+    // the 12 edges of the cube and a diagonal of each side
+    REQUIRE(cube.edges.size() == 18);
+    for (const auto& e : cube.edges)
+      REQUIRE(std::ranges::count_if(cube.edges, [&](const cgfs::MeshEdge& f){
+        return std::minmax(e.a, e.b) == std::minmax(f.a, f.b);
+      }) == 1);
+  }
+
+  SECTION("Drawing the edges once draws the wireframe of the faces")
+  {
+    const auto viewport = cgfs::Extent2D{1, 1};
+    const auto cube = cgfs::Cube{{0.3f, -0.2f, 4.f}};
+
+    auto canvas = cgfs::Canvas{extent, background};
+    cgfs::render_instance(canvas, cube, viewport, 1);
+
+    auto expected = cgfs::Canvas{extent, background};
+    const auto project = [&](const cgfs::Position3D& v){ return cgfs::detail::project_vertex(v, 1, viewport, extent); };
+    for (const auto& t : cube.faces())
+      cgfs::render_triangle(expected, t, cube.vertices() | std::views::transform(project));
+
+    REQUIRE(count_painted(canvas) > 0);
+    REQUIRE(count_different(canvas, expected) == 0);
+  }
+}
+
+TEST_CASE("Half-space rasterizer")
+{
+  const auto extent = cgfs::Extent2D{64, 64};
+  const auto project = cgfs::Projection{extent, cgfs::Viewport{{1, 1}, 1}};
+
+  SECTION("Two triangles sharing an edge cover every pixel of their union exactly once")
+  {
+    // a quad from (-20, -17) to (23, 19) on the canvas, split along a diagonal
+    const auto z = 2.f;
+    const auto at = [&](float x, float y){ return cgfs::Position3D{x * z / 64, y * z / 64, z}; };
+    const auto lower = cgfs::Triangle3D{at(-20, -17), at(23, -17), at(23, 19), cgfs::Red};
+    const auto upper = cgfs::Triangle3D{at(-20, -17), at(23, 19), at(-20, 19), cgfs::Green};
+
+    auto lower_only = cgfs::Canvas{extent, background};
+    cgfs::draw_filled_triangle_halfspace(lower_only, lower, project);
+    auto upper_only = cgfs::Canvas{extent, background};
+    cgfs::draw_filled_triangle_halfspace(upper_only, upper, project);
+    auto both = cgfs::Canvas{extent, background};
+    cgfs::draw_filled_triangle_halfspace(both, lower, project);
+    cgfs::draw_filled_triangle_halfspace(both, upper, project);
+
+    // the inside of the quad is the closed rectangle, less its top and right edges that no other triangle shares
+    REQUIRE(count_painted(both) == count_painted(lower_only) + count_painted(upper_only));
+    REQUIRE(count_painted(both) >= 43 * 36);
+    REQUIRE(count_painted(both) <= 44 * 37);
+  }
+
+  SECTION("The triangles of a scene are drawn like the scanline rasterizer draws them, but for the pixels along their edges")
+  {
+    const auto scene = cubes_scene();
+    const auto camera = cgfs::Camera{sp3::pose{{0, -2, -1}, {sp3::xhat, sp3::angle{-sp3::pi/12}}}, cgfs::Viewport{{1, 1}, 1}};
+
+    auto scanline = cgfs::Canvas{{160, 160}, background};
+    cgfs::render_scene(scanline, scene, camera);
+    auto half_space = cgfs::Canvas{{160, 160}, background};
+    cgfs::render_scene(half_space, scene, camera, {cgfs::Rasterizer::half_space});
+
+    REQUIRE(count_painted(half_space) > 160 * 160 / 10);
+    REQUIRE(count_different(scanline, half_space) < count_painted(scanline) / 10);
+  }
+
+  SECTION("Canvases too large for the edge functions are drawn on by the scanline rasterizer")
+  {
+    const auto wide = cgfs::Extent2D{10'000, 8};
+    const auto wide_project = cgfs::Projection{wide, cgfs::Viewport{{1, 1}, 1}};
+    const auto triangle = cgfs::Triangle3D{{-0.01f, -0.3f, 1}, {0.02f, 0.1f, 2}, {0, 0.2f, 1}, cgfs::Blue};
+
+    auto scanline = cgfs::Canvas{wide, background};
+    cgfs::draw_filled_triangle(scanline, triangle, wide_project);
+    auto half_space = cgfs::Canvas{wide, background};
+    cgfs::draw_filled_triangle_halfspace(half_space, triangle, wide_project);
+
+    REQUIRE(count_painted(half_space) > 0);
+    REQUIRE(count_different(scanline, half_space) == 0);
+  }
+}
+
+TEST_CASE("Binned parallel rasterization")
+{
+  const auto camera = cgfs::Camera{sp3::pose{{0, -2, -1}, {sp3::xhat, sp3::angle{-sp3::pi/12}}}, cgfs::Viewport{{1, 1}, 1}};
+  const auto extent = cgfs::Extent2D{150, 130};
+
+  // the models overlap each other, and one of them crosses the edge of the canvas
+  auto scene = cubes_scene();
+  scene.instances.push_back({cgfs::solid_cube(), sp3::transform{{-3.5f, 1.5f, 6.f}, {sp3::yhat, sp3::angle{sp3::pi/5}}}});
+  scene.instances.push_back({cgfs::solid_icosahedron(), sp3::transform{{-1.f, 0.f, 6.5f}, {}, 3}});
+
+  auto flat_scene = cgfs::MeshScene<cgfs::Mesh>{{}, scene.lights};
+  for (const auto& I : scene.instances)
+    flat_scene.instances.push_back({flat(*I.model), I.transform});
+
+  for (const auto rasterizer : {cgfs::Rasterizer::scanline, cgfs::Rasterizer::half_space})
+  {
+    auto serial = cgfs::Canvas{extent, background};
+    cgfs::render_scene(serial, scene, camera, {rasterizer});
+    auto flat_serial = cgfs::Canvas{extent, background};
+    cgfs::render_scene(flat_serial, flat_scene, camera, {rasterizer});
+
+    for (const unsigned num_threads : {1u, 3u})
+    {
+      auto pool = cgfs::WorkStealingPool{num_threads};
+      for (const int band_height : {1, 7, 16, 1000})
+      {
+        auto binned = cgfs::Canvas{extent, background};
+        cgfs::render_scene(binned, scene, camera, pool, {rasterizer, band_height});
+        REQUIRE(count_different(serial, binned) == 0);
+
+        auto flat_binned = cgfs::Canvas{extent, background};
+        cgfs::render_scene(flat_binned, flat_scene, camera, pool, {rasterizer, band_height});
+        REQUIRE(count_different(flat_serial, flat_binned) == 0);
+      }
+    }
+  }
+}
+
+TEST_CASE("Hierarchical depth test")
+{
+  const auto camera = cgfs::Camera{sp3::pose{{0, -2, -1}, {sp3::xhat, sp3::angle{-sp3::pi/12}}}, cgfs::Viewport{{1, 1}, 1}};
+  const auto extent = cgfs::Extent2D{150, 130};
+
+  // rows of models behind each other, drawn from the nearest to the farthest and the other way around
+  auto scene = cubes_scene();
+  for (int i = 0; i < 6; ++i)
+    scene.instances.push_back({cgfs::solid_icosahedron(), sp3::transform{{-0.5f + 0.2f * i, -0.5f, 6.f + i}, {}, 2}});
+  for (int i = 0; i < 6; ++i)
+    scene.instances.push_back({cgfs::solid_cube(), sp3::transform{{0.5f - 0.3f * i, 0.5f, 12.f - i}, {sp3::yhat, sp3::angle{sp3::pi/7 * i}}, 2}});
+
+  auto flat_scene = cgfs::MeshScene<cgfs::Mesh>{{}, scene.lights};
+  for (const auto& I : scene.instances)
+    flat_scene.instances.push_back({flat(*I.model), I.transform});
+
+  auto pool = cgfs::WorkStealingPool{3};
+  for (const auto rasterizer : {cgfs::Rasterizer::scanline, cgfs::Rasterizer::half_space})
+  {
+    // skipping what is hidden behind the depth tiles changes nothing
+    auto per_pixel = cgfs::Canvas{extent, background};
+    cgfs::render_scene(per_pixel, scene, camera, {rasterizer, 16, cgfs::DepthTest::per_pixel});
+    auto hierarchical = cgfs::Canvas{extent, background};
+    cgfs::render_scene(hierarchical, scene, camera, {rasterizer, 16, cgfs::DepthTest::hierarchical});
+    auto binned = cgfs::Canvas{extent, background};
+    cgfs::render_scene(binned, scene, camera, pool, {rasterizer, 5, cgfs::DepthTest::hierarchical});
+
+    REQUIRE(count_painted(per_pixel) > 150 * 130 / 4);
+    REQUIRE(count_different(per_pixel, hierarchical) == 0);
+    REQUIRE(count_different(per_pixel, binned) == 0);
+
+    auto flat_per_pixel = cgfs::Canvas{extent, background};
+    cgfs::render_scene(flat_per_pixel, flat_scene, camera, {rasterizer, 16, cgfs::DepthTest::per_pixel});
+    auto flat_hierarchical = cgfs::Canvas{extent, background};
+    cgfs::render_scene(flat_hierarchical, flat_scene, camera, {rasterizer, 16, cgfs::DepthTest::hierarchical});
+
+    REQUIRE(count_different(flat_per_pixel, flat_hierarchical) == 0);
+  }
+}
+
+TEST_CASE("Deferred shading")
+{
+  const auto camera = cgfs::Camera{sp3::pose{{0, -2, -1}, {sp3::xhat, sp3::angle{-sp3::pi/12}}}, cgfs::Viewport{{1, 1}, 1}};
+  const auto extent = cgfs::Extent2D{150, 130};
+
+  // models in front of each other, drawn from the farthest, so that most pixels are drawn in more than once
+  auto scene = cubes_scene();
+  for (int i = 0; i < 6; ++i)
+    scene.instances.push_back({cgfs::solid_icosahedron(), sp3::transform{{0.3f - 0.2f * i, -0.5f, 12.f - i}, {}, 2}});
+
+  auto flat_scene = cgfs::MeshScene<cgfs::Mesh>{{}, scene.lights};
+  for (const auto& I : scene.instances)
+    flat_scene.instances.push_back({flat(*I.model), I.transform});
+
+  auto pool = cgfs::WorkStealingPool{3};
+  for (const auto rasterizer : {cgfs::Rasterizer::scanline, cgfs::Rasterizer::half_space})
+  {
+    const auto forward_options = cgfs::RasterOptions{rasterizer, 16, cgfs::DepthTest::hierarchical, cgfs::Shading::forward};
+    const auto deferred_options = cgfs::RasterOptions{rasterizer, 16, cgfs::DepthTest::hierarchical, cgfs::Shading::deferred};
+
+    // shading only the visible triangles, once per pixel, gives the same colors
+    auto forward = cgfs::Canvas{extent, background};
+    cgfs::render_scene(forward, scene, camera, forward_options);
+    auto deferred = cgfs::Canvas{extent, background};
+    cgfs::render_scene(deferred, scene, camera, deferred_options);
+    auto binned = cgfs::Canvas{extent, background};
+    cgfs::render_scene(binned, scene, camera, pool, deferred_options);
+
+    REQUIRE(count_painted(forward) > 150 * 130 / 4);
+    REQUIRE(count_different(forward, deferred) == 0);
+    REQUIRE(count_different(forward, binned) == 0);
+
+    auto flat_forward = cgfs::Canvas{extent, background};
+    cgfs::render_scene(flat_forward, flat_scene, camera, forward_options);
+    auto flat_deferred = cgfs::Canvas{extent, background};
+    cgfs::render_scene(flat_deferred, flat_scene, camera, deferred_options);
+
+    REQUIRE(count_different(flat_forward, flat_deferred) == 0);
+
+    // a single model
+    const auto project = camera.projection(extent);
+    const auto& I = scene.instances.back();
+    auto model_forward = cgfs::Canvas{extent, background};
+    cgfs::render_model(model_forward, *I.model, project, I.transform, cgfs::LightSet{scene.lights}, forward_options);
+    auto model_deferred = cgfs::Canvas{extent, background};
+    cgfs::render_model(model_deferred, *I.model, project, I.transform, scene.lights, deferred_options); // (the lights as the scene lists them)
+
+    REQUIRE(count_painted(model_forward) > 0);
+    REQUIRE(count_different(model_forward, model_deferred) == 0);
+  }
+}
+
+TEST_CASE("Frustum culling")
+{
+  const auto camera = cgfs::Camera{sp3::pose{{0, -2, -1}, {sp3::xhat, sp3::angle{-sp3::pi/12}}}, cgfs::Viewport{{1, 1}, 1}};
+  const auto extent = cgfs::Extent2D{150, 130};
+
+  SECTION("Bounding spheres contain the vertices of their models")
+  {
+    const auto cube = cgfs::solid_cube();
+    const auto icosahedron = cgfs::wireframe_icosahedron();
+    for (const auto* model_vertices : {&cube.vertices, &icosahedron.vertices})
+    {
+      const auto sphere = cgfs::bounding_sphere(*model_vertices);
+      for (const auto& v : *model_vertices)
+        REQUIRE(sp3::dot(v - sphere.center, v - sphere.center) <= sphere.radius * sphere.radius);
+    }
+    REQUIRE(cube.bounds.radius == cgfs::bounding_sphere(cube.vertices).radius);
+    REQUIRE(cgfs::bounding_sphere(std::vector<cgfs::Position3D>{}).radius == 0);
+
+    const auto T = sp3::transform{{1, 2, 3}, {sp3::zhat, sp3::angle{sp3::pi/3}}, 2.5};
+    const auto moved = cgfs::transform_sphere(T, cube.bounds);
+    for (const auto& v : cube.vertices)
+      REQUIRE(sp3::dot(T(v) - moved.center, T(v) - moved.center) <= moved.radius * moved.radius * 1.0001f);
+  }
+
+  SECTION("Spheres outside the frustum")
+  {
+    const auto frustum = cgfs::Frustum{camera.projection(extent)};
+    REQUIRE_FALSE(frustum.outside({{0, 0, 5}, 1}));
+    REQUIRE_FALSE(frustum.outside({{3, 0, 5}, 1}));    // across the right side
+    REQUIRE_FALSE(frustum.outside({{0, 0, -0.5f}, 1})); // around the camera
+    REQUIRE(frustum.outside({{10, 0, 5}, 1}));
+    REQUIRE(frustum.outside({{-10, 0, 5}, 1}));
+    REQUIRE(frustum.outside({{0, 10, 5}, 1}));
+    REQUIRE(frustum.outside({{0, -10, 5}, 1}));
+    REQUIRE(frustum.outside({{0, 0, -5}, 1}));          // behind the camera
+  }
+
+  SECTION("Culled instances are not drawn, and nothing else changes")
+  {
+    auto visible_scene = cubes_scene();
+    visible_scene.instances.push_back({cgfs::solid_cube(), sp3::transform{{-3.5f, 1.5f, 6.f}, {sp3::yhat, sp3::angle{sp3::pi/5}}}}); // across the edge of the canvas
+
+    auto scene = visible_scene;
+    scene.instances.push_back({cgfs::solid_cube(), sp3::transform{{-30.f, 0.f, 6.f}}});
+    scene.instances.push_back({cgfs::solid_icosahedron(), sp3::transform{{0.f, 0.f, -15.f}, {}, 2}}); // behind the camera
+    scene.instances.insert(scene.instances.begin() + 1, {cgfs::solid_cube(), sp3::transform{{0.f, 40.f, 6.f}}});
+
+    auto pool = cgfs::WorkStealingPool{3};
+    for (const auto shading : {cgfs::Shading::forward, cgfs::Shading::deferred})
+    {
+      const auto options = cgfs::RasterOptions{cgfs::Rasterizer::scanline, 16, cgfs::DepthTest::hierarchical, shading};
+
+      auto expected = cgfs::Canvas{extent, background};
+      const auto visible_stats = cgfs::render_scene(expected, visible_scene, camera, options);
+      REQUIRE(visible_stats.instances == 4);
+      REQUIRE(visible_stats.culled_instances == 0);
+
+      auto culled = cgfs::Canvas{extent, background};
+      const auto stats = cgfs::render_scene(culled, scene, camera, options);
+      REQUIRE(stats.instances == 7);
+      REQUIRE(stats.culled_instances == 3);
+      REQUIRE(count_painted(culled) > 0);
+      REQUIRE(count_different(culled, expected) == 0);
+
+      auto binned = cgfs::Canvas{extent, background};
+      const auto binned_stats = cgfs::render_scene(binned, scene, camera, pool, options);
+      REQUIRE(binned_stats.instances == 7);
+      REQUIRE(binned_stats.culled_instances == 3);
+      REQUIRE(count_different(binned, expected) == 0);
+
+      auto unculled_options = options;
+      unculled_options.frustum_culling = false;
+      REQUIRE(cgfs::render_scene(culled, scene, camera, unculled_options).culled_instances == 0);
+    }
+  }
+}
+
+TEST_CASE("Near plane clipping")
+{
+  const auto extent = cgfs::Extent2D{64, 64};
+  const auto project = cgfs::Projection{extent, cgfs::Viewport{{1, 1}, 1}};
+  const auto planes = cgfs::detail::ClipPlanes{project};
+
+  const auto pieces = [&](const cgfs::Triangle3D& t){
+    auto result = std::vector<cgfs::Triangle3D>{};
+    cgfs::detail::clip_triangle(t, planes, [&](const cgfs::Triangle3D& piece){ result.push_back(piece); });
+    return result;
+  };
+
+  SECTION("Triangles are cut by the near plane, not by the viewport")
+  {
+    const auto near = cgfs::detail::near_plane;
+    REQUIRE(pieces({{0, 0, 2}, {1, 0, 2}, {0, 1, 3}, cgfs::Red}).size() == 1);          // in front
+    REQUIRE(pieces({{0, 0, 0.5f}, {1, 0, 0.5f}, {0, 1, 0.5f}, cgfs::Red}).size() == 1); // between the camera and the viewport
+    REQUIRE(pieces({{0, 0, -2}, {1, 0, -2}, {0, 1, near / 2}, cgfs::Red}).empty());     // behind
+    REQUIRE(pieces({{0, 0, -1}, {1, 0, 3}, {0, 1, 3}, cgfs::Red}).size() == 2);         // one vertex behind: a quadrilateral
+    REQUIRE(pieces({{0, 0, -1}, {0.1f, 0, -1}, {0, 1, 3}, cgfs::Red}).size() == 1);     // two vertices behind
+
+    for (const auto& piece : pieces({{0, 0, -1}, {1, 0, 3}, {0, 1, 3}, cgfs::Red}))
+      for (const auto& v : {piece.a, piece.b, piece.c})
+        REQUIRE(v.z >= near);
+
+    // the normals are interpolated along with the positions
+    const auto super = cgfs::SuperTriangle3D{{{{0, 0, near - 1}, {0, 0, near + 1}, {1, 0, near + 1}}}, {{{0, 0, -1}, {0, 1, 0}, {0, 1, 0}}}, cgfs::Red};
+    auto super_pieces = std::vector<cgfs::SuperTriangle3D>{};
+    cgfs::detail::clip_triangle(super, planes, [&](const cgfs::SuperTriangle3D& piece){ super_pieces.push_back(piece); });
+    REQUIRE(super_pieces.size() == 2);
+    REQUIRE(super_pieces.front().vertices[0].z == near);
+    REQUIRE(super_pieces.front().normals[0].y == 0.5f);
+    REQUIRE(super_pieces.front().normals[0].z == -0.5f);
+  }
+
+  SECTION("Triangles that reach out of the guard band are cut by its sides")
+  {
+    const auto far_out = 1e5f;
+    const auto clipped = pieces({{-far_out, -far_out, 2}, {far_out, -far_out, 2}, {0, far_out, 2}, cgfs::Red});
+    REQUIRE(clipped.size() >= 2);
+    for (const auto& piece : clipped)
+      for (const auto& v : {piece.a, piece.b, piece.c})
+      {
+        REQUIRE(std::abs(project(v).x) <= cgfs::detail::guard_band + 1);
+        REQUIRE(std::abs(project(v).y) <= cgfs::detail::guard_band + 1);
+      }
+  }
+
+  SECTION("Nothing behind the near plane is drawn, whatever the rasterizer")
+  {
+    const auto draws = {
+      +[](cgfs::Canvas& canvas, const cgfs::Triangle3D& t, const cgfs::Projection& P){ cgfs::draw_filled_triangle(canvas, t, P); },
+      +[](cgfs::Canvas& canvas, const cgfs::Triangle3D& t, const cgfs::Projection& P){ cgfs::draw_filled_triangle_halfspace(canvas, t, P); },
+    };
+    for (const auto draw : draws)
+    {
+      auto behind = cgfs::Canvas{extent, background};
+      draw(behind, {{-1, -1, -2}, {1, -1, -2}, {0, 1, -3}, cgfs::Red}, project);
+      REQUIRE(count_painted(behind) == 0);
+
+      // nearer than the viewport, but in front of the near plane
+      auto near = cgfs::Canvas{extent, background};
+      draw(near, {{-0.1f, -0.1f, 0.5f}, {0.1f, -0.1f, 0.5f}, {0, 0.1f, 0.5f}, cgfs::Red}, project);
+      REQUIRE(count_painted(near) > 0);
+
+      // a floor through the camera
+      auto crossing = cgfs::Canvas{extent, background};
+      draw(crossing, {{-1, -0.5f, -4}, {1, -0.5f, -4}, {0, -0.5f, 8}, cgfs::Red}, project);
+      REQUIRE(count_painted(crossing) > 0);
+      for (int x = -extent.width/2; x < extent.width/2; ++x)
+        for (int y = -extent.height/2 + 1; y <= extent.height/2; ++y)
+          REQUIRE(std::as_const(crossing).depthBuffer({x, y}) <= 1.0001f / cgfs::detail::near_plane);
+
+      // a wall far larger than the guard band
+      auto wall = cgfs::Canvas{extent, background};
+      draw(wall, {{-1e6f, -1e6f, 3}, {1e6f, -1e6f, 3}, {0, 1e6f, 3}, cgfs::Red}, project);
+      REQUIRE(count_painted(wall) == size_t(extent.width * extent.height));
+    }
+  }
+
+  SECTION("The projections given with a triangle are drawn from, unless it is clipped")
+  {
+    const auto clip = cgfs::detail::whole_canvas(extent);
+    const auto whole = cgfs::Triangle3D{{-1, -1, 2}, {1, -1, 2}, {0, 1, 2}, cgfs::Red};
+    const auto crossing = cgfs::Triangle3D{{-1, -0.5f, -4}, {1, -0.5f, -4}, {0, -0.5f, 8}, cgfs::Red};
+    const auto shifted = [&](const cgfs::Triangle3D& t){
+      auto p = cgfs::detail::projections(t, project);
+      for (auto& q : p)
+        q.x += 5;
+      return p;
+    };
+
+    const auto draw = [&](const cgfs::Triangle3D& t, const std::array<cgfs::Index2D, 3>* projected){
+      auto scanline = cgfs::Canvas{extent, background};
+      cgfs::draw_filled_triangle(scanline, t, project, {}, clip, cgfs::DepthTest::hierarchical, projected);
+      auto half_space = cgfs::Canvas{extent, background};
+      cgfs::draw_filled_triangle_halfspace(half_space, t, project, {}, clip, cgfs::DepthTest::hierarchical, projected);
+      return std::pair{std::move(scanline), std::move(half_space)};
+    };
+
+    const auto exact = cgfs::detail::projections(whole, project);
+    REQUIRE(count_different(draw(whole, &exact).first, draw(whole, nullptr).first) == 0);
+    REQUIRE(count_different(draw(whole, &exact).second, draw(whole, nullptr).second) == 0);
+
+    const auto moved = shifted(whole);
+    REQUIRE(count_different(draw(whole, &moved).first, draw(whole, nullptr).first) > 0);
+    REQUIRE(count_different(draw(whole, &moved).second, draw(whole, nullptr).second) > 0);
+
+    const auto ignored = shifted(crossing);
+    REQUIRE(count_different(draw(crossing, &ignored).first, draw(crossing, nullptr).first) == 0);
+    REQUIRE(count_different(draw(crossing, &ignored).second, draw(crossing, nullptr).second) == 0);
+
+    // the vertices behind the near plane (or on the camera) are not projected
+    auto cache = cgfs::VertexCache{};
+    cache.vertices = {{0.5f, 0.5f, 2}, {1, 1, 0}, {1, 1, -3}};
+    cgfs::detail::project_vertices(cache, project);
+    REQUIRE(cache.projected == std::vector<cgfs::Index2D>{project(cache.vertices[0]), {0, 0}, {0, 0}});
+  }
+
+  SECTION("A model around the camera, drawn binned")
+  {
+    const auto camera = cgfs::Camera{sp3::pose{{0, -2, -1}, {sp3::xhat, sp3::angle{-sp3::pi/12}}}, cgfs::Viewport{{1, 1}, 1}};
+    const auto scene_extent = cgfs::Extent2D{150, 130};
+    auto scene = cubes_scene();
+    scene.instances.push_back({cgfs::solid_cube(), sp3::transform{{0.5f, -2.f, 0.f}, {sp3::yhat, sp3::angle{sp3::pi/9}}, 2}});
+
+    auto pool = cgfs::WorkStealingPool{3};
+    for (const auto rasterizer : {cgfs::Rasterizer::scanline, cgfs::Rasterizer::half_space})
+    {
+      auto serial = cgfs::Canvas{scene_extent, background};
+      REQUIRE(cgfs::render_scene(serial, scene, camera, {rasterizer}).culled_instances == 0);
+      REQUIRE(count_painted(serial) > 0);
+
+      for (const int band_height : {8, 1000})
+      {
+        auto binned = cgfs::Canvas{scene_extent, background};
+        cgfs::render_scene(binned, scene, camera, pool, {rasterizer, band_height});
+        REQUIRE(count_different(serial, binned) == 0);
+      }
+    }
+  }
+}
+
+TEST_CASE("Back-face culling in model coordinates")
+{
+  const auto icosahedron = cgfs::solid_icosahedron();
+  const auto flat_icosahedron = flat(icosahedron);
+  REQUIRE(icosahedron.face_normals.size() == icosahedron.faces.size());
+  REQUIRE(flat_icosahedron.face_normals.size() == flat_icosahedron.faces.size());
+
+  for (const auto& M : {
+    sp3::transform{{0.f, 0.f, 5.f}},
+    sp3::transform{{1.f, -2.f, 6.f}, {sp3::yhat, sp3::angle{sp3::pi/5}}, 1.5},
+    sp3::transform{{-3.f, 1.f, 2.f}, {sp3::xhat, sp3::angle{2.f}}, 0.25},
+  })
+  {
+    // the camera, in model coordinates
+    const auto eye = cgfs::detail::model_eye(M);
+    const auto back_to_model = cgfs::inverse(cgfs::affine_transform(M));
+    const auto origin = cgfs::transform_point(cgfs::affine_transform(M), eye);
+    REQUIRE(std::abs(origin.x) + std::abs(origin.y) + std::abs(origin.z) < 1e-4f);
+    const auto p = cgfs::Position3D{0.3f, -0.2f, 0.9f};
+    const auto q = cgfs::transform_point(back_to_model, M(p));
+    REQUIRE(std::abs(q.x - p.x) + std::abs(q.y - p.y) + std::abs(q.z - p.z) < 1e-4f);
+
+    // the same faces as culled in camera coordinates
+    for (size_t i = 0; i < icosahedron.faces.size(); ++i)
+    {
+      REQUIRE(icosahedron.face_normals[i].back_facing(eye) == cgfs::detail::is_back_facing(icosahedron.triangles(M)[i]));
+      REQUIRE(flat_icosahedron.face_normals[i].back_facing(eye) == cgfs::detail::is_back_facing(flat_icosahedron.triangles(M)[i]));
+    }
+
+    auto cache = cgfs::VertexCache{};
+    auto stats = cgfs::RasterStats{};
+    cgfs::detail::front_faces(icosahedron, M, nullptr, cache, stats);
+    REQUIRE(!cache.faces.empty());
+    REQUIRE(cache.faces.size() < icosahedron.faces.size());
+  }
+}
+
+TEST_CASE("Levels of detail")
+{
+  const auto sphere = cgfs::solid_sphere(3);
+  const auto chain = cgfs::make_lod_chain(sphere);
+
+  SECTION("Each level has fewer faces, on the vertices of the model, with their colors and normals")
+  {
+    REQUIRE(sphere.faces.size() == 20 * 64);
+    REQUIRE(chain.levels.size() > 3);
+    REQUIRE(chain.levels.size() == chain.errors.size());
+    REQUIRE(chain.errors.front() == 0);
+    REQUIRE(chain.levels.front().faces.size() == sphere.faces.size());
+
+    const auto has = [](const auto& range, const auto& value){
+      return std::ranges::any_of(range, [&](const auto& other){ return other.x == value.x && other.y == value.y && other.z == value.z; });
+    };
+    const auto colors = [&]{
+      auto colors = std::vector<cgfs::Color>{};
+      for (const auto& f : sphere.faces)
+        colors.push_back(f.col);
+      return colors;
+    }();
+
+    // which way the faces of the sphere turn (outward, or inward)
+    const auto facing = [](const auto& level, const auto& f){
+      const auto& a = level.vertices[f.a];
+      return sp3::dot(sp3::cross(level.vertices[f.b] - a, level.vertices[f.c] - a), a - cgfs::Position3D{0, 0, 0}) > 0;
+    };
+    const auto outward = facing(sphere, sphere.faces.front());
+
+    for (size_t i = 1; i < chain.levels.size(); ++i)
+    {
+      const auto& level = chain.levels[i];
+      REQUIRE(level.faces.size() < chain.levels[i - 1].faces.size());
+      REQUIRE(chain.errors[i] >= chain.errors[i - 1]);
+      REQUIRE(level.face_normals.size() == level.faces.size());
+      for (const auto& f : level.faces)
+      {
+        REQUIRE(std::max({f.a, f.b, f.c}) < level.vertices.size());
+        REQUIRE(std::max({f.na, f.nb, f.nc}) < level.normals.size());
+        REQUIRE(std::ranges::find(colors, f.col) != colors.end());
+        // a vertex of the sphere keeps its normal where it is left
+        REQUIRE(has(sphere.vertices, level.vertices[f.a]));
+        REQUIRE(has(sphere.normals, level.normals[f.na]));
+        REQUIRE(facing(level, f) == outward);
+      }
+    }
+  }
+
+  SECTION("A corner moved onto another vertex takes the normal of that vertex")
+  {
+    // the normal of each vertex of the sphere is its position
+    for (const auto& level : chain.levels)
+      for (const auto& f : level.faces)
+        for (const auto& [v, n] : {std::pair{f.a, f.na}, std::pair{f.b, f.nb}, std::pair{f.c, f.nc}})
+        {
+          const auto expected = level.vertices[v] - cgfs::Position3D{0, 0, 0};
+          REQUIRE(level.normals[n].x == expected.x);
+          REQUIRE(level.normals[n].y == expected.y);
+          REQUIRE(level.normals[n].z == expected.z);
+        }
+  }
+
+  SECTION("A flat mesh is simplified without error, and keeps its border")
+  {
+    auto grid = cgfs::Mesh{};
+    constexpr size_t N = 8;
+    constexpr float side = N;
+    for (size_t y = 0; y <= N; ++y)
+      for (size_t x = 0; x <= N; ++x)
+        grid.vertices.push_back({static_cast<float>(x), static_cast<float>(y), 0});
+    for (size_t y = 0; y < N; ++y)
+      for (size_t x = 0; x < N; ++x)
+      {
+        const auto a = y * (N + 1) + x;
+        grid.faces.push_back({a, a + 1, a + N + 2, cgfs::Red});
+        grid.faces.push_back({a, a + N + 2, a + N + 1, cgfs::Blue});
+      }
+    grid.update();
+
+    const auto grid_chain = cgfs::make_lod_chain(grid, {0.5f, 2, 10});
+    const auto& coarsest = grid_chain.levels.back();
+    REQUIRE(coarsest.faces.size() == 2);
+    REQUIRE(grid_chain.errors.back() == 0);
+    for (const auto& [x, y] : {std::pair{0.f, 0.f}, std::pair{side, 0.f}, std::pair{0.f, side}, std::pair{side, side}})
+      REQUIRE(std::ranges::any_of(coarsest.vertices, [&](const cgfs::Position3D& v){ return v.x == x && v.y == y && v.z == 0; }));
+  }
+
+  SECTION("The farther an instance, the coarser its level")
+  {
+    const auto P = cgfs::Projection{{200, 200}, cgfs::Viewport{{1, 1}, 1}};
+    const auto level = [&](float z, float max_error){
+      return &chain.select(P, sp3::transform{{0, 0, z}}, max_error) - chain.levels.data();
+    };
+    REQUIRE(level(1.5f, 1) == 0);
+    REQUIRE(level(0.2f, 1) == 0); // around the camera
+    auto previous = level(2, 1);
+    for (const auto z : {4.f, 8.f, 16.f, 32.f, 64.f})
+    {
+      REQUIRE(level(z, 1) >= previous);
+      previous = level(z, 1);
+    }
+    REQUIRE(previous > 0);
+    REQUIRE(level(1000, 1) == static_cast<std::ptrdiff_t>(chain.levels.size()) - 1);
+    REQUIRE(level(1000, 0) == 0);
+  }
+
+  SECTION("A scene of LodChains is drawn like the scene of their models at the level the options call for")
+  {
+    const auto camera = cgfs::Camera{};
+    const auto extent = cgfs::Extent2D{120, 100};
+    const auto transforms = std::array{
+      sp3::transform{{-0.6f, 0.f, 3.f}},
+      sp3::transform{{0.5f, 0.2f, 6.f}, {}, 1.5f},
+      sp3::transform{{0.f, -0.3f, 40.f}, {}, 4.f},
+    };
+
+    auto lod_scene = cgfs::MeshScene<cgfs::LodChain<cgfs::MultiNormalMesh>>{{}, {cgfs::AmbientLight{0.3f}, cgfs::PointLight{0.7f, {-1, 1, 0}}}};
+    auto scene = cgfs::MeshScene<cgfs::MultiNormalMesh>{{}, lod_scene.lights};
+    auto levels_scene = scene;
+    const auto P = camera.projection(extent);
+    for (const auto& T : transforms)
+    {
+      lod_scene.instances.push_back({chain, T});
+      scene.instances.push_back({sphere, T});
+      levels_scene.instances.push_back({chain.select(P, T, cgfs::RasterOptions{}.lod_error), T});
+    }
+    REQUIRE(levels_scene.instances.back().model->faces.size() < sphere.faces.size());
+
+    auto pool = cgfs::WorkStealingPool{3};
+    for (const auto lod_error : {0.f, cgfs::RasterOptions{}.lod_error})
+    {
+      auto options = cgfs::RasterOptions{};
+      options.lod_error = lod_error;
+
+      auto expected = cgfs::Canvas{extent, background};
+      cgfs::render_scene(expected, lod_error == 0 ? scene : levels_scene, camera, options);
+
+      auto canvas = cgfs::Canvas{extent, background};
+      cgfs::render_scene(canvas, lod_scene, camera, options);
+      REQUIRE(count_painted(canvas) > 0);
+      REQUIRE(count_different(canvas, expected) == 0);
+
+      auto binned = cgfs::Canvas{extent, background};
+      cgfs::render_scene(binned, lod_scene, camera, pool, options);
+      REQUIRE(count_different(binned, expected) == 0);
+    }
+  }
+}
+
+TEST_CASE("Meshlets")
+{
+  const auto sphere = cgfs::solid_sphere(3);
+
+  SECTION("The meshlets partition the faces, each within its bounds and its normal cone")
+  {
+    REQUIRE(sphere.meshlets.size() > 1);
+    REQUIRE(cgfs::solid_icosahedron().meshlets.empty());
+
+    auto meshlet_of = std::vector<size_t>(sphere.faces.size(), sphere.meshlets.size());
+    for (size_t m = 0; m < sphere.meshlets.size(); ++m)
+    {
+      const auto& meshlet = sphere.meshlets[m];
+      REQUIRE(!meshlet.faces.empty());
+      REQUIRE(meshlet.faces.size() <= cgfs::MeshletLimits{}.max_faces);
+      REQUIRE(meshlet.vertices.size() <= cgfs::MeshletLimits{}.max_vertices);
+      REQUIRE(std::ranges::is_sorted(meshlet.faces));
+
+      auto vertices = std::vector<std::uint32_t>{};
+      for (const auto f : meshlet.faces)
+      {
+        REQUIRE(meshlet_of[f] == sphere.meshlets.size());
+        meshlet_of[f] = m;
+        const auto& face = sphere.faces[f];
+        for (const auto v : {face.a, face.b, face.c})
+          vertices.push_back(static_cast<std::uint32_t>(v));
+
+        const auto& n = sphere.face_normals[f].normal;
+        REQUIRE(sp3::dot(meshlet.cone.axis, n) >= meshlet.cone.cos_angle * std::sqrt(sp3::dot(n, n)));
+      }
+      std::ranges::sort(vertices);
+      vertices.erase(std::ranges::unique(vertices).begin(), vertices.end());
+      auto meshlet_vertices = meshlet.vertices;
+      std::ranges::sort(meshlet_vertices);
+      REQUIRE(meshlet_vertices == vertices);
+
+      for (const auto v : meshlet.vertices)
+      {
+        const auto d = sphere.vertices[v] - meshlet.bounds.center;
+        REQUIRE(sp3::dot(d, d) <= meshlet.bounds.radius * meshlet.bounds.radius);
+      }
+      REQUIRE(meshlet.cone.cos_angle > 0);
+    }
+    REQUIRE(std::ranges::count(meshlet_of, sphere.meshlets.size()) == 0);
+  }
+
+  SECTION("A meshlet is back facing only where all of its faces are")
+  {
+    auto back_facing = 0;
+    for (int i = -4; i <= 4; ++i)
+      for (int j = -4; j <= 4; ++j)
+        for (const auto scale : {0.15f, 0.3f, 1.f, 5.f})
+        {
+          const auto eye = cgfs::Position3D{scale * (i + 0.5f), scale * (j + 0.25f), scale * (2.f - i)};
+          for (const auto& meshlet : sphere.meshlets)
+          {
+            if (!meshlet.cone.back_facing(meshlet.bounds, eye))
+              continue;
+
+            ++back_facing;
+            for (const auto f : meshlet.faces)
+              REQUIRE(sphere.face_normals[f].back_facing(eye));
+          }
+        }
+    REQUIRE(back_facing > 0);
+  }
+
+  SECTION("Culling meshlets changes nothing on the canvas")
+  {
+    const auto camera = cgfs::Camera{};
+    const auto extent = cgfs::Extent2D{120, 100};
+    auto scene = cgfs::MeshScene<cgfs::MultiNormalMesh>{{}, {cgfs::AmbientLight{0.3f}, cgfs::PointLight{0.7f, {-1, 1, 0}}}};
+    const auto shared_sphere = cgfs::share(sphere);
+    scene.instances.push_back({shared_sphere, sp3::transform{{-0.4f, 0.f, 3.f}}});
+    scene.instances.push_back({shared_sphere, sp3::transform{{1.2f, 0.3f, 2.f}, {sp3::yhat, sp3::angle{1.f}}, 1.5f}}); // across the right edge
+    scene.instances.push_back({shared_sphere, sp3::transform{{0.f, -1.f, 1.2f}}}); // across the bottom edge and the near plane
+    auto whole_sphere = sphere;
+    whole_sphere.meshlets.clear();
+    auto whole_scene = scene;
+    for (auto& I : whole_scene.instances)
+      I.model = cgfs::share(whole_sphere);
+
+    auto pool = cgfs::WorkStealingPool{3};
+    for (const auto shading : {cgfs::Shading::forward, cgfs::Shading::deferred})
+    {
+      auto options = cgfs::RasterOptions{};
+      options.shading = shading;
+
+      auto expected = cgfs::Canvas{extent, background};
+      const auto whole_stats = cgfs::render_scene(expected, whole_scene, camera, options);
+      REQUIRE(whole_stats.meshlets == 0);
+
+      auto canvas = cgfs::Canvas{extent, background};
+      const auto stats = cgfs::render_scene(canvas, scene, camera, options);
+      REQUIRE(count_painted(canvas) > 0);
+      REQUIRE(count_different(canvas, expected) == 0);
+      REQUIRE(stats.meshlets == 3 * sphere.meshlets.size());
+      REQUIRE(stats.culled_meshlets > 0);
+      REQUIRE(stats.back_facing_meshlets > 0);
+      REQUIRE(stats.culled_meshlets + stats.back_facing_meshlets < stats.meshlets);
+
+      auto binned = cgfs::Canvas{extent, background};
+      const auto binned_stats = cgfs::render_scene(binned, scene, camera, pool, options);
+      REQUIRE(count_different(binned, expected) == 0);
+      REQUIRE(binned_stats.meshlets == stats.meshlets);
+      REQUIRE(binned_stats.culled_meshlets == stats.culled_meshlets);
+      REQUIRE(binned_stats.back_facing_meshlets == stats.back_facing_meshlets);
+    }
+
+    // without frustum culling, only the back facing meshlets are culled
+    auto options = cgfs::RasterOptions{};
+    options.frustum_culling = false;
+    auto canvas = cgfs::Canvas{extent, background};
+    const auto stats = cgfs::render_scene(canvas, scene, camera, options);
+    REQUIRE(stats.culled_meshlets == 0);
+    REQUIRE(stats.back_facing_meshlets > 0);
+  }
+}
+
+TEST_CASE("Shared models")
+{
+  const auto cube = cgfs::share(cgfs::solid_cube());
+  const auto icosahedron = cgfs::share(cgfs::solid_icosahedron());
+  const auto transforms = std::array{
+    sp3::transform{{-1.5f, 0.5f, 6.f}},
+    sp3::transform{{1.5f, -0.5f, 5.f}, {sp3::yhat, sp3::angle{0.5f}}},
+    sp3::transform{{0.f, 1.f, 8.f}, {}, 1.5f},
+    sp3::transform{{-0.5f, -1.f, 4.f}},
+  };
+
+  // the cubes and the icosahedra alternate, and they either share two models or each have one of their own
+  auto scene = cgfs::MeshScene<cgfs::MultiNormalMesh>{{}, {cgfs::AmbientLight{0.3f}, cgfs::PointLight{0.7f, {-1, 1, 0}}}};
+  auto own_scene = scene;
+  for (size_t i = 0; i < transforms.size(); ++i)
+  {
+    const auto& model = i % 2 == 0 ? cube : icosahedron;
+    scene.instances.push_back({model, transforms[i]});
+    own_scene.instances.push_back({*model, transforms[i]});
+  }
+
+  SECTION("Instances made from the same handle share their model")
+  {
+    REQUIRE(scene.instances[0].model == scene.instances[2].model);
+    REQUIRE(scene.instances[0].model != scene.instances[1].model);
+    REQUIRE(cube.use_count() == 3);
+    REQUIRE(own_scene.instances[0].model != own_scene.instances[2].model);
+    REQUIRE(cgfs::Instance<cgfs::MultiNormalMesh>{}.model != nullptr);
+    REQUIRE(cgfs::Instance<cgfs::MultiNormalMesh>{}.model == cgfs::Instance<cgfs::MultiNormalMesh>{}.model);
+  }
+
+  SECTION("A scene of shared models is drawn like the scene of their copies")
+  {
+    const auto camera = cgfs::Camera{};
+    const auto extent = cgfs::Extent2D{120, 100};
+    auto pool = cgfs::WorkStealingPool{3};
+
+    auto expected = cgfs::Canvas{extent, background};
+    REQUIRE(cgfs::render_scene(expected, own_scene, camera).instances == 4);
+    REQUIRE(count_painted(expected) > 0);
+
+    auto canvas = cgfs::Canvas{extent, background};
+    const auto stats = cgfs::render_scene(canvas, scene, camera);
+    REQUIRE(stats.instances == 4);
+    REQUIRE(count_different(canvas, expected) == 0);
+
+    auto binned = cgfs::Canvas{extent, background};
+    REQUIRE(cgfs::render_scene(binned, scene, camera, pool).instances == 4);
+    REQUIRE(count_different(binned, expected) == 0);
+  }
+}
@@ -0,0 +1,200 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "canvas.h"
+#include "progressive.h"
+#include "render.h"
+#include "scene.h"
+#include "supersampling.h"
+#include "wavefront.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <span>
+
+namespace
+{
+  cgfs::Scene spheres_scene()
+  {
+    return cgfs::Scene{
+      {
+        cgfs::Sphere{{0, -1, 3}, 1, cgfs::Palette1::Orange, 500, 0.2f},
+        cgfs::Sphere{{2, 0, 4}, 1, cgfs::Palette1::Pink, 500, 0.3f},
+        cgfs::Sphere{{-2, 0, 4}, 1, cgfs::Palette1::Purple, 10, 0.4f},
+        cgfs::Sphere{{0, -5001, 0}, 5000, cgfs::Palette1::Yellow, 1000, 0.5f}
+      },
+      {
+        cgfs::AmbientLight{0.2f},
+        cgfs::PointLight{0.6f, {2, 1, 0}},
+        cgfs::DirectionalLight{0.2f, {1, 4, 4}}
+      }
+    };
+  }
+
+  bool same_pixels(const cgfs::Canvas& lhs, const cgfs::Canvas& rhs)
+  {
+    const auto l = std::span{lhs.data(), lhs.num_bytes()};
+    const auto r = std::span{rhs.data(), rhs.num_bytes()};
+    return std::ranges::equal(l, r);
+  }
+}
+
+TEST_CASE("Parallel ray tracing")
+{
+  const auto scene = spheres_scene();
+  const auto viewport = cgfs::Extent2D{1, 1};
+
+  SECTION("Matches the serial render")
+  {
+    auto serial = cgfs::Canvas{{64, 48}};
+    cgfs::render(scene, serial, viewport);
+
+    auto parallel = cgfs::Canvas{{64, 48}};
+    cgfs::render(scene, parallel, viewport, cgfs::RenderOptions{4, 16});
+
+    CHECK(same_pixels(serial, parallel));
+  }
+
+  SECTION("Tiles that don't divide the canvas, odd canvas size")
+  {
+    auto serial = cgfs::Canvas{{37, 23}};
+    cgfs::render(scene, serial, viewport);
+
+    auto pool = cgfs::WorkStealingPool{3};
+    auto parallel = cgfs::Canvas{{37, 23}};
+    cgfs::render(scene, parallel, viewport, pool, 5);
+
+    CHECK(same_pixels(serial, parallel));
+  }
+}
+
+TEST_CASE("Packet ray tracing")
+{
+  const auto scene = spheres_scene();
+  const auto viewport = cgfs::Extent2D{1, 1};
+
+  auto serial = cgfs::Canvas{{37, 23}};
+  cgfs::render(scene, serial, viewport);
+
+  for (const auto packet_size : {4, 8, 16})
+  {
+    auto packets = cgfs::Canvas{{37, 23}};
+    cgfs::render(scene, packets, viewport, cgfs::RenderOptions{2, 7, packet_size});
+    CHECK(same_pixels(serial, packets));
+  }
+}
+
+TEST_CASE("Wavefront ray tracing")
+{
+  const auto scene = spheres_scene();
+  const auto viewport = cgfs::Extent2D{1, 1};
+  auto pool = cgfs::WorkStealingPool{3};
+
+  SECTION("Matches the serial render")
+  {
+    auto serial = cgfs::Canvas{{64, 48}};
+    cgfs::render(scene, serial, viewport);
+
+    auto wavefront = cgfs::Canvas{{64, 48}};
+    cgfs::WavefrontRenderer{}.render(scene, wavefront, viewport, pool);
+
+    CHECK(same_pixels(serial, wavefront));
+  }
+
+  SECTION("Recursion depth, odd canvas size and reuse of the queues")
+  {
+    auto renderer = cgfs::WavefrontRenderer{1};
+    for (const auto extent : {cgfs::Extent2D{37, 23}, cgfs::Extent2D{20, 30}})
+    {
+      auto serial = cgfs::Canvas{extent};
+      const auto [Cw, Ch] = extent;
+      for (int x = -Cw/2; x < Cw/2; ++x)
+        for (int y = Ch/2; y > -Ch/2; --y)
+        {
+          const auto V_xyz = cgfs::detail::canvas_to_viewport({x, y}, extent, viewport);
+          serial.putPixel({x, y}, scene.trace_ray({{0, 0, 0}, V_xyz - cgfs::Position3D{0, 0, 0}, 1, std::numeric_limits<float>::infinity()}, 1));
+        }
+
+      auto wavefront = cgfs::Canvas{extent};
+      renderer.render(scene, wavefront, viewport, pool);
+
+      CHECK(same_pixels(serial, wavefront));
+    }
+  }
+}
+
+TEST_CASE("Adaptive supersampling")
+{
+  const auto scene = spheres_scene();
+  const auto viewport = cgfs::Extent2D{1, 1};
+  auto pool = cgfs::WorkStealingPool{2};
+
+  auto serial = cgfs::Canvas{{64, 48}};
+  cgfs::render(scene, serial, viewport);
+
+  SECTION("A single sample per pixel is the serial render")
+  {
+    auto canvas = cgfs::Canvas{{64, 48}};
+    const auto stats = cgfs::render_supersampled(scene, canvas, viewport, pool, {1, 0});
+
+    CHECK(same_pixels(serial, canvas));
+    CHECK(stats.pixels == 64 * 48);
+    CHECK(stats.extra_rays == 0);
+  }
+
+  SECTION("Only the pixels at edges get more samples")
+  {
+    auto canvas = cgfs::Canvas{{64, 48}};
+    const auto stats = cgfs::render_supersampled(scene, canvas, viewport, pool, {8, 16});
+
+    CHECK(stats.refined_pixels > 0);
+    CHECK(stats.refined_pixels < stats.pixels / 2);
+    CHECK(stats.extra_rays == 7 * stats.refined_pixels);
+
+    // every pixel that wasn't refined is the same as in the serial render
+    auto changed = size_t{0};
+    for (size_t i = 0; i < canvas.num_bytes(); i += 3)
+      changed += !std::equal(canvas.data() + i, canvas.data() + i + 3, serial.data() + i);
+    CHECK(changed > 0);
+    CHECK(changed <= stats.refined_pixels);
+  }
+}
+
+TEST_CASE("Progressive ray tracing")
+{
+  using namespace std::chrono_literals;
+
+  const auto scene = spheres_scene();
+  const auto viewport = cgfs::Extent2D{1, 1};
+
+  auto serial = cgfs::Canvas{{37, 23}};
+  cgfs::render(scene, serial, viewport);
+
+  SECTION("No budget, no pixels")
+  {
+    auto canvas = cgfs::Canvas{{37, 23}};
+    CHECK(cgfs::render_progressive(scene, canvas, viewport, 0s) == 0);
+  }
+
+  SECTION("A complete render is the serial render")
+  {
+    auto canvas = cgfs::Canvas{{37, 23}};
+    CHECK(cgfs::render_progressive(scene, canvas, viewport, 1h) == 1);
+    CHECK(same_pixels(serial, canvas));
+  }
+
+  SECTION("Refining in small steps")
+  {
+    auto canvas = cgfs::Canvas{{37, 23}};
+    auto renderer = cgfs::ProgressiveRenderer{scene, canvas, viewport, 4};
+    auto previous = 0.0f;
+    while (!renderer.done())
+    {
+      const auto progress = renderer.refine(10us);
+      REQUIRE(progress >= previous);
+      previous = progress;
+    }
+    CHECK(renderer.progress() == 1);
+    CHECK(same_pixels(serial, canvas));
+  }
+}
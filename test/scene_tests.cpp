@@ -0,0 +1,91 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "scene.h"
+
+#include <array>
+#include <limits>
+
+TEST_CASE("Occlusion queries")
+{
+  const auto scene = cgfs::Scene{{
+    cgfs::Sphere{{0, 0, 5}, 1, cgfs::Red},
+    cgfs::Sphere{{3, 0, 5}, 1, cgfs::Green},
+  }};
+  const auto inf = std::numeric_limits<float>::infinity();
+
+  SECTION("Rays that hit a sphere")
+  {
+    CHECK(scene.occluded({{0, 0, 0}, {0, 0, 1}, 0, inf}));
+    CHECK(scene.occluded({{3, 0, 0}, {0, 0, 1}, 0, inf}));
+    CHECK(scene.occluded({{0, 0, 0}, {3, 0, 5}, 0.001f, 1}));
+  }
+
+  SECTION("Rays that miss")
+  {
+    CHECK_FALSE(scene.occluded({{0, 0, 0}, {0, 1, 0}, 0, inf}));
+    CHECK_FALSE(scene.occluded({{1.5f, 0, 0}, {0, 0, 1}, 0, inf}));
+  }
+
+  SECTION("Hits outside of (t_min, t_max) don't count")
+  {
+    CHECK_FALSE(scene.occluded({{0, 0, 0}, {0, 0, 1}, 0, 3.9f}));
+    CHECK_FALSE(scene.occluded({{0, 0, 0}, {0, 0, 1}, 6.1f, inf}));
+    CHECK(scene.occluded({{0, 0, 0}, {0, 0, 1}, 4.5f, inf}));
+  }
+}
+
+TEST_CASE("Closest hit queries")
+{
+  const auto scene = cgfs::Scene{{
+    cgfs::Sphere{{0, 0, 5}, 1, cgfs::Red},
+    cgfs::Sphere{{0, 0, 8}, 1, cgfs::Green},
+  }};
+  const auto inf = std::numeric_limits<float>::infinity();
+
+  SECTION("The hit refers to the closest sphere")
+  {
+    const auto hit = scene.intersect({{0, 0, 0}, {0, 0, 1}, 0, inf});
+    REQUIRE(hit);
+    CHECK(hit.primitive == 0);
+    CHECK(hit.t == 4);
+  }
+
+  SECTION("Spheres in front of t_min are skipped")
+  {
+    const auto hit = scene.intersect({{0, 0, 0}, {0, 0, 1}, 6.5f, inf});
+    REQUIRE(hit);
+    CHECK(hit.primitive == 1);
+    CHECK(hit.t == 7);
+  }
+
+  SECTION("Misses")
+  {
+    CHECK_FALSE(scene.intersect({{0, 0, 0}, {0, 1, 0}, 0, inf}));
+    CHECK_FALSE(scene.intersect({{0, 0, 0}, {0, 0, 1}, 0, 3.5f}));
+  }
+}
+
+TEST_CASE("Packets of closest hit queries")
+{
+  const auto scene = cgfs::Scene{{
+    cgfs::Sphere{{0, 0, 5}, 1, cgfs::Red},
+    cgfs::Sphere{{0, 0, 8}, 1, cgfs::Green},
+    cgfs::Sphere{{3, 0, 5}, 1, cgfs::Blue},
+  }};
+  const auto inf = std::numeric_limits<float>::infinity();
+
+  // more rays than fit in a packet, some of which miss
+  auto rays = std::array<cgfs::Ray3D, 20>{};
+  for (size_t i = 0; i < rays.size(); ++i)
+    rays[i] = {{0.25f * i - 1, 0.1f * (i % 3), 0}, {0, 0, 1}, i % 4 == 3 ? 6.5f : 0, inf};
+
+  auto hits = std::array<cgfs::HitRecord, 20>{};
+  scene.intersect(rays, hits);
+
+  for (size_t i = 0; i < rays.size(); ++i)
+  {
+    const auto expected = scene.intersect(rays[i]);
+    CHECK(hits[i].primitive == expected.primitive);
+    CHECK(hits[i].t == expected.t);
+  }
+}